@@ -5,10 +5,15 @@
      header file for use with the data structures to define the event checking
      functions and the function to loop through the array calling the checkers
  Notes
-
+     The checkers come from EVENT_CHECK_TABLE in ES_Configure.h. A polled
+     checker is called once its interval is up, a signalled checker only
+     after an ISR has called ES_SignalChecker for it.
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 13:00 as       polled & signalled checkers from EVENT_CHECK_TABLE,
+                         added ES_SignalChecker, ES_IsAnyCheckerSignalled
+                         and ES_GetTicksToNextPoll
  08/05/13 15:19 jec      modifications to suit new portable type definitions
  01/15/12 12:00 jec      new header for local types
  10/16/11 17:17 jec      started coding
@@ -17,13 +22,64 @@
 #ifndef ES_CheckEvents_H
 #define ES_CheckEvents_H
 
+#include "ES_Configure.h"
 #include "ES_Types.h"
 
 typedef bool CheckFunc( void );
 
 typedef CheckFunc (*pCheckFunc);
 
+// the signalled checkers, named and counted from EVENT_CHECK_TABLE. The count
+// must match NUM_CHECKER_SIGNALS in ES_Configure.h, which the preprocessor
+// can see.
+typedef enum {
+#define ES_CHECKER_POLLED( Func, Interval )
+#define ES_CHECKER_SIGNALLED( Func, Name ) Name,
+  EVENT_CHECK_TABLE
+#undef ES_CHECKER_POLLED
+#undef ES_CHECKER_SIGNALLED
+  NUM_CHECKER_SIGNALS_IN_TABLE
+} ES_CheckerSignal_t;
+
 bool ES_CheckUserEvents( void );
 
+/****************************************************************************
+ Function
+   ES_SignalChecker
+ Parameters
+   ES_CheckerSignal_t : the name of the checker from EVENT_CHECK_TABLE
+ Returns
+   None
+ Description
+   has ES_Run call a signalled checker on its next idle pass, call it from
+   the ISR that sees the hardware event
+****************************************************************************/
+void ES_SignalChecker( ES_CheckerSignal_t WhichChecker );
+
+/****************************************************************************
+ Function
+   ES_IsAnyCheckerSignalled
+ Parameters
+   None
+ Returns
+   bool : true if a signalled checker is waiting to be called
+ Description
+   for the port's idle routine, which must not sleep if this is true
+****************************************************************************/
+bool ES_IsAnyCheckerSignalled( void );
+
+/****************************************************************************
+ Function
+   ES_GetTicksToNextPoll
+ Parameters
+   None
+ Returns
+   uint32_t : the number of ticks until the next polled checker is due,
+              ES_TIMER_NO_EXPIRY if none has an interval
+ Description
+   for the port's idle routine, so that the tickless sleep ends in time for
+   the polled checkers
+****************************************************************************/
+uint32_t ES_GetTicksToNextPoll( void );
 
 #endif  // ES_CheckEvents_H
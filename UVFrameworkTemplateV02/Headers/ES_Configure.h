@@ -9,6 +9,34 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 17:00 as       added ES_CAN_TRANSPORT_RX, ES_CAN_TRANSPORT_DONE and
+                         CAN_TRANSPORT_TIMER
+ 10/18/26 16:00 as       added ES_CAN_POLL_DONE and CAN_POLL_TIMER
+ 10/18/26 15:00 as       added ES_CAN_TX_READY
+ 10/18/26 14:00 as       added ES_CAN_RX and the ISR channel for the CAN
+                         receive path
+ 10/18/26 13:00 as       EVENT_CHECK_LIST replaced by EVENT_CHECK_TABLE, with
+                         polled and signalled checkers, and NUM_CHECKER_SIGNALS
+ 10/18/26 12:00 as       added ES_DEFER_TELEMETRY
+ 10/18/26 11:00 as       added ES_NUM_PUBLISH_TYPES
+ 10/18/26 10:00 as       added ES_TRACE_SIZE
+ 10/18/26 09:00 as       added ES_LATENCY_MONITOR, ES_LATENCY_OVERRUN and the
+                         latency budget to SERVICE_TABLE
+  10/17/26 23:00 as       added the short timer pool definitions and its ISR
+                         channel
+ 10/17/26 21:00 as       added ES_TIMER_BITS
+ 10/17/26 20:00 as       added ES_TICKLESS_IDLE
+  10/17/26 18:00 as       added ES_BATCH_DISPATCH and the batch limit to
+                         SERVICE_TABLE
+  10/17/26 17:00 as       added the coalescing policy to SERVICE_TABLE and
+                         ES_NUM_COALESCE_TYPES
+  10/17/26 16:00 as       added ES_QUEUE_TELEMETRY
+  10/17/26 15:00 as       added ES_PROFILE_SERVICES
+  10/17/26 14:00 as       replaced the per service and per timer definitions
+                         with SERVICE_TABLE and TIMER_TABLE
+  10/17/26 13:00 as       added the payload pool definitions and ES_CAN_FRAME
+  10/17/26 12:00 as       added the ISR to service channel definitions
+  10/17/26 11:00 as       added SERV_n_QUEUE_RING to select the queue engine
   10/11/15 18:00 jec      added new event type ES_SHORT_TIMEOUT
   10/21/13 20:54 jec      lots of added entries to bring the number of timers
                          and services up to 16 each
@@ -23,228 +51,103 @@
 
 /****************************************************************************/
 // The maximum number of services sets an upper bound on the number of 
-// services that the framework will handle. Reasonable values are 8 and 16
-// corresponding to an 8-bit(uint8_t) and 16-bit(uint16_t) Ready variable size
+// services that the framework will handle. Reasonable values are 16, 32 and
+// 64 corresponding to a 16-bit(uint16_t), 32-bit(uint32_t) or multi-word
+// Ready variable
 #define MAX_NUM_SERVICES 16
 
 /****************************************************************************/
 // This macro determines that nuber of services that are *actually* used in
 // a particular application. It will vary in value from 1 to MAX_NUM_SERVICES
+// and must match the number of entries in SERVICE_TABLE
 #define NUM_SERVICES 1
 
 /****************************************************************************/
-// These are the definitions for Service 0, the lowest priority service.
-// Every Events and Services application must have a Service 0. Further 
-// services are added in numeric sequence (1,2,3,...) with increasing 
-// priorities
-// the header file with the public function prototypes
-#define SERV_0_HEADER "Master_Main_Service.h"
-// the name of the Init function
-#define SERV_0_INIT Init_Master_Main_Service
-// the name of the run function
-#define SERV_0_RUN Run_Master_Main_Service
-// How big should this services Queue be?
-#define SERV_0_QUEUE_SIZE 5
+// This is the table of services, one ES_SERVICE entry per service. The first
+// entry is Service 0, the lowest priority service. Every Events and Services
+// application must have a Service 0. Each further entry has a higher
+// priority than the one before it. The fields of each entry are:
+//   the name of the Init function
+//   the name of the Run function
+//   the name of the Post function
+//   how big this service's Queue should be
+//   whether to use the modulo-free ring engine for the queue (1 = yes,
+//   0 = no), the size is rounded up to the next power of two if so
+//   what to do with a post when an event of the same EventType is already
+//   waiting in the queue:
+//     ES_COALESCE_NONE    queue it anyway, as usual
+//     ES_COALESCE_REPLACE overwrite the waiting event with the new one
+//     ES_COALESCE_DROP    keep the waiting event and drop the new one
+//   only use the last two for services where one event of each type carries
+//   all the information that matters (the latest reading, say), since two
+//   ES_TIMEOUTs from different timers are merged just the same
+//   the most events to run back to back, see ES_BATCH_DISPATCH (1 or more)
+//   the latency budget, the most ES_ReadCycleCounter counts (CPU cycles on
+//   the target, 40 per uS) from posting an event to the return of the run
+//   function that handled it, see ES_LATENCY_MONITOR (0 for no budget)
+// The framework declares the three functions from this table, so service
+// headers no longer need to be listed here.
+#define SERVICE_TABLE \
+  ES_SERVICE( Init_Master_Main_Service, Run_Master_Main_Service, \
+              Post_Master_Main_Service, 5, 1, ES_COALESCE_NONE, 1, 0 )
 
 /****************************************************************************/
-// The following sections are used to define the parameters for each of the
-// services. You only need to fill out as many as the number of services 
-// defined by NUM_SERVICES
-/****************************************************************************/
-// These are the definitions for Service 1
-#if NUM_SERVICES > 1
-// the header file with the public function prototypes
-#define SERV_1_HEADER "TestHarnessService1.h"
-// the name of the Init function
-#define SERV_1_INIT InitTestHarnessService1
-// the name of the run function
-#define SERV_1_RUN RunTestHarnessService1
-// How big should this services Queue be?
-#define SERV_1_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 2
-#if NUM_SERVICES > 2
-// the header file with the public function prototypes
-#define SERV_2_HEADER "TestHarnessService2.h"
-// the name of the Init function
-#define SERV_2_INIT InitTestHarnessService2
-// the name of the run function
-#define SERV_2_RUN RunTestHarnessService2
-// How big should this services Queue be?
-#define SERV_2_QUEUE_SIZE 3
-#endif
+// Set ES_PROFILE_SERVICES to 1 to have ES_Run time every call to a service's
+// run function (in CPU cycles) and track the depth of each service's queue.
+// Read the results with ES_GetServiceProfile or ES_PrintServiceProfiles.
+#define ES_PROFILE_SERVICES 0
 
 /****************************************************************************/
-// These are the definitions for Service 3
-#if NUM_SERVICES > 3
-// the header file with the public function prototypes
-#define SERV_3_HEADER "TestHarnessService3.h"
-// the name of the Init function
-#define SERV_3_INIT InitTestHarnessService3
-// the name of the run function
-#define SERV_3_RUN RunTestHarnessService3
-// How big should this services Queue be?
-#define SERV_3_QUEUE_SIZE 3
-#endif
+// Set ES_QUEUE_TELEMETRY to 1 to have every queue count its posts and drops
+// and keep its high water mark. Use the results to size the queues in
+// SERVICE_TABLE. It adds 8 bytes to the header of every queue.
+#define ES_QUEUE_TELEMETRY 0
 
 /****************************************************************************/
-// These are the definitions for Service 4
-#if NUM_SERVICES > 4
-// the header file with the public function prototypes
-#define SERV_4_HEADER "TestHarnessService4.h"
-// the name of the Init function
-#define SERV_4_INIT InitTestHarnessService4
-// the name of the run function
-#define SERV_4_RUN RunTestHarnessService4
-// How big should this services Queue be?
-#define SERV_4_QUEUE_SIZE 3
-#endif
+// Set ES_LATENCY_MONITOR to 1 to have the framework stamp every event with
+// ES_ReadCycleCounter as it is posted, and have ES_Run measure how long it
+// waited in the queue and how long the run function took with it. Each
+// service keeps a histogram of the total, in ES_LATENCY_HIST_BINS bins
+// that double in width, the first holding totals below
+// 2^ES_LATENCY_HIST_SHIFT counts. An event that takes longer than its
+// service's budget from SERVICE_TABLE is counted as an overrun, and
+// ES_LATENCY_OVERRUN, with the service number in EventParam, is posted to
+// ES_LATENCY_OVERRUN_SERVICE. Read the results with ES_GetLatencyStats or
+// ES_PrintLatencyStats.
+#define ES_LATENCY_MONITOR 0
+#define ES_LATENCY_HIST_BINS 16
+#define ES_LATENCY_HIST_SHIFT 6
+#define ES_LATENCY_OVERRUN_SERVICE 0
 
 /****************************************************************************/
-// These are the definitions for Service 5
-#if NUM_SERVICES > 5
-// the header file with the public function prototypes
-#define SERV_5_HEADER "TestHarnessService5.h"
-// the name of the Init function
-#define SERV_5_INIT InitTestHarnessService5
-// the name of the run function
-#define SERV_5_RUN RunTestHarnessService5
-// How big should this services Queue be?
-#define SERV_5_QUEUE_SIZE 3
-#endif
+// Set ES_DEFER_TELEMETRY to 1 to have each deferral queue time stamp its
+// events, so that ES_GetDeferralStats can report how long the oldest has
+// been waiting. Size the blocks with ES_DEFERRAL_BLOCK_SIZE.
+#define ES_DEFER_TELEMETRY 0
 
 /****************************************************************************/
-// These are the definitions for Service 6
-#if NUM_SERVICES > 6
-// the header file with the public function prototypes
-#define SERV_6_HEADER "TestHarnessService6.h"
-// the name of the Init function
-#define SERV_6_INIT InitTestHarnessService6
-// the name of the run function
-#define SERV_6_RUN RunTestHarnessService6
-// How big should this services Queue be?
-#define SERV_6_QUEUE_SIZE 3
-#endif
+// ES_TRACE_SIZE is the number of records in the event trace (see ES_Trace.h),
+// a record of every post and dispatch, kept for post-mortem analysis. It
+// must be a power of two no larger than 32768, each record takes 12 bytes.
+// Set it to 0 to leave the trace out altogether.
+#define ES_TRACE_SIZE 0
 
 /****************************************************************************/
-// These are the definitions for Service 7
-#if NUM_SERVICES > 7
-// the header file with the public function prototypes
-#define SERV_7_HEADER "TestHarnessService7.h"
-// the name of the Init function
-#define SERV_7_INIT InitTestHarnessService7
-// the name of the run function
-#define SERV_7_RUN RunTestHarnessService7
-// How big should this services Queue be?
-#define SERV_7_QUEUE_SIZE 3
-#endif
+// Set ES_BATCH_DISPATCH to 1 to have ES_Run pass up to the batch limit from
+// SERVICE_TABLE of a service's queued events to it back to back, before it
+// processes pending interrupts and looks for a higher priority service again.
+// A higher priority service can then wait for a whole batch, so keep the
+// limits of the services with slow run functions small.
+#define ES_BATCH_DISPATCH 0
 
 /****************************************************************************/
-// These are the definitions for Service 8
-#if NUM_SERVICES > 8
-// the header file with the public function prototypes
-#define SERV_8_HEADER "TestHarnessService8.h"
-// the name of the Init function
-#define SERV_8_INIT InitTestHarnessService8
-// the name of the run function
-#define SERV_8_RUN RunTestHarnessService8
-// How big should this services Queue be?
-#define SERV_8_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 9
-#if NUM_SERVICES > 9
-// the header file with the public function prototypes
-#define SERV_9_HEADER "TestHarnessService9.h"
-// the name of the Init function
-#define SERV_9_INIT InitTestHarnessService9
-// the name of the run function
-#define SERV_9_RUN RunTestHarnessService9
-// How big should this services Queue be?
-#define SERV_9_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 10
-#if NUM_SERVICES > 10
-// the header file with the public function prototypes
-#define SERV_10_HEADER "TestHarnessService10.h"
-// the name of the Init function
-#define SERV_10_INIT InitTestHarnessService10
-// the name of the run function
-#define SERV_10_RUN RunTestHarnessService10
-// How big should this services Queue be?
-#define SERV_10_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 11
-#if NUM_SERVICES > 11
-// the header file with the public function prototypes
-#define SERV_11_HEADER "TestHarnessService11.h"
-// the name of the Init function
-#define SERV_11_INIT InitTestHarnessService11
-// the name of the run function
-#define SERV_11_RUN RunTestHarnessService11
-// How big should this services Queue be?
-#define SERV_11_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 12
-#if NUM_SERVICES > 12
-// the header file with the public function prototypes
-#define SERV_12_HEADER "TestHarnessService12.h"
-// the name of the Init function
-#define SERV_12_INIT InitTestHarnessService12
-// the name of the run function
-#define SERV_12_RUN RunTestHarnessService12
-// How big should this services Queue be?
-#define SERV_12_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 13
-#if NUM_SERVICES > 13
-// the header file with the public function prototypes
-#define SERV_13_HEADER "TestHarnessService13.h"
-// the name of the Init function
-#define SERV_13_INIT InitTestHarnessService13
-// the name of the run function
-#define SERV_13_RUN RunTestHarnessService13
-// How big should this services Queue be?
-#define SERV_13_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 14
-#if NUM_SERVICES > 14
-// the header file with the public function prototypes
-#define SERV_14_HEADER "TestHarnessService14.h"
-// the name of the Init function
-#define SERV_14_INIT InitTestHarnessService14
-// the name of the run function
-#define SERV_14_RUN RunTestHarnessService14
-// How big should this services Queue be?
-#define SERV_14_QUEUE_SIZE 3
-#endif
-
-/****************************************************************************/
-// These are the definitions for Service 15
-#if NUM_SERVICES > 15
-// the header file with the public function prototypes
-#define SERV_15_HEADER "TestHarnessService15.h"
-// the name of the Init function
-#define SERV_15_INIT InitTestHarnessService15
-// the name of the run function
-#define SERV_15_RUN RunTestHarnessService15
-// How big should this services Queue be?
-#define SERV_15_QUEUE_SIZE 3
-#endif
-
+// Set ES_TICKLESS_IDLE to 1 to have ES_Run sleep the core whenever all of the
+// queues are empty and no event checker found an event. The tick is then
+// stretched to wake the core when the next timer expires or the next polled
+// event checker is due, rather than every tick. Checkers polled with an
+// interval of 0 only run after an interrupt, so anything that they check
+// for must come with an interrupt that can wake the core.
+#define ES_TICKLESS_IDLE 0
 
 /****************************************************************************/
 // Name/define the events of interest
@@ -254,13 +157,47 @@ typedef enum {  ES_NO_EVENT = 0,
                 ES_INIT,   /* used to transition from initial pseudo-state */
                 ES_TIMEOUT, /* signals that the timer has expired */
                 ES_SHORT_TIMEOUT, /* signals that a short timer has expired */
+                ES_LATENCY_OVERRUN, /* a service went over its budget */
                 /* User-defined events start here */
                 ES_NEW_KEY, /* signals a new key received from terminal */
                 ES_LOCK,
-                ES_UNLOCK} ES_EventTyp_t ;
+                ES_UNLOCK,
+                ES_CAN_RX, /* frames are waiting in the CAN receive ring */
+                ES_CAN_TX_READY, /* the CAN transmit queue has room again */
+                ES_CAN_POLL_DONE, /* a poll of the CAN slaves is over */
+                ES_CAN_TRANSPORT_RX, /* a CAN transfer is in, EventParam its length */
+                ES_CAN_TRANSPORT_DONE, /* a CAN transfer is sent or failed */
+                /* Events that carry a payload handle in EventParam go here,
+                   starting at ES_FIRST_PAYLOAD_EVENT */
+                ES_CAN_FRAME /* a CAN frame: Tag is the ID, Length the DLC */
+                } ES_EventTyp_t ;
+
+/****************************************************************************/
+// These are the definitions for the event payload pool. Events at or above
+// ES_FIRST_PAYLOAD_EVENT carry a payload handle in EventParam. Set
+// ES_PAYLOAD_POOL_SIZE to 0 to leave the pool out altogether.
+#define ES_PAYLOAD_POOL_SIZE 16
+#define ES_PAYLOAD_DATA_SIZE 8
+#define ES_FIRST_PAYLOAD_EVENT ES_CAN_FRAME
+
+/****************************************************************************/
+// Only events with an EventType below ES_NUM_COALESCE_TYPES are coalesced.
+// Services with a coalescing policy keep a byte for every one of these types,
+// and payload events are never coalesced, so this may not be more than
+// ES_FIRST_PAYLOAD_EVENT.
+#define ES_NUM_COALESCE_TYPES ES_FIRST_PAYLOAD_EVENT
 
 /****************************************************************************/
-// These are the definitions for the Distribution lists. Each definition
+// Services subscribe to event types at run time with ES_Subscribe, and
+// ES_Publish posts an event to every subscriber of its type. Only events
+// with an EventType below ES_NUM_PUBLISH_TYPES can be published, each of
+// these types takes one bit per service.
+#define ES_NUM_PUBLISH_TYPES 16
+
+/****************************************************************************/
+// These are the definitions for the Distribution lists. ES_Publish does the
+// same job without editing this file, and posts to all or none of the
+// services, so prefer it for new code. Each definition
 // should be a comma separated list of post functions to indicate which
 // services are on that distribution list.
 #define NUM_DIST_LISTS 0
@@ -294,41 +231,60 @@ typedef enum {  ES_NO_EVENT = 0,
 #define EVENT_CHECK_HEADER "EventCheckers.h"
 
 /****************************************************************************/
-// This is the list of event checking functions 
-#define EVENT_CHECK_LIST Check4Keystroke
+// This is the table of event checking functions, one entry per checker:
+//   ES_CHECKER_POLLED( Function, Interval ) is called when at least Interval
+//     ticks of the ES_Timer have gone by since its last call. An Interval of
+//     0 has it called on every idle pass of ES_Run, as all checkers once were.
+//   ES_CHECKER_SIGNALLED( Function, Name ) is only called after an ISR (GPIO
+//     edge, UART receive, CAN and so on) calls ES_SignalChecker( Name ).
+// Signalled checkers are called first, then polled ones, each in the order
+// listed. There can be up to 32 signalled checkers, NUM_CHECKER_SIGNALS must
+// be set to the number in the table.
+#define EVENT_CHECK_TABLE \
+  ES_CHECKER_POLLED( Check4Keystroke, 10 )
+#define NUM_CHECKER_SIGNALS 0
 
 /****************************************************************************/
-// These are the definitions for the post functions to be executed when the
-// corresponding timer expires. All 16 must be defined. If you are not using
-// a timer, then you should use TIMER_UNUSED
-// Unlike services, any combination of timers may be used and there is no
-// priority in servicing them
-#define TIMER_UNUSED ((pPostFunc)0)
-#define TIMER0_RESP_FUNC Post_Master_Main_Service
-#define TIMER1_RESP_FUNC TIMER_UNUSED
-#define TIMER2_RESP_FUNC TIMER_UNUSED
-#define TIMER3_RESP_FUNC TIMER_UNUSED
-#define TIMER4_RESP_FUNC TIMER_UNUSED
-#define TIMER5_RESP_FUNC TIMER_UNUSED
-#define TIMER6_RESP_FUNC TIMER_UNUSED
-#define TIMER7_RESP_FUNC TIMER_UNUSED
-#define TIMER8_RESP_FUNC TIMER_UNUSED
-#define TIMER9_RESP_FUNC TIMER_UNUSED
-#define TIMER10_RESP_FUNC TIMER_UNUSED
-#define TIMER11_RESP_FUNC TIMER_UNUSED
-#define TIMER12_RESP_FUNC TIMER_UNUSED
-#define TIMER13_RESP_FUNC TIMER_UNUSED
-#define TIMER14_RESP_FUNC TIMER_UNUSED
-#define TIMER15_RESP_FUNC TIMER_UNUSED
+// These are the definitions for the ISR to service channels. Each interrupt
+// response routine that posts events gets its own channel (one writer only).
+// ISR_CHANNEL_SIZE is the number of events a channel holds and must be a
+// power of two no larger than 128. Set NUM_ISR_CHANNELS to 0 to leave the
+// channels out altogether.
+#define NUM_ISR_CHANNELS 4
+#define ISR_CHANNEL_SIZE 8
+
+#define ISR_CHANNEL_SHORT_TIMER_A 0
+#define ISR_CHANNEL_SHORT_TIMER_B 1
+#define ISR_CHANNEL_SHORT_TIMER_POOL 2
+#define ISR_CHANNEL_CAN_INTERNAL_BUS 3
+
+/****************************************************************************/
+// These are the definitions for the short timer pool, the microsecond one
+// shot timers that share Timer 4 (see ES_ShortTimerPool.c). Each channel is
+// one timer, numbered from 0, and its timeout is an ES_SHORT_TIMEOUT with
+// the channel number in EventParam.
+#define NUM_SHORT_TIMER_CHANNELS 8
 
 /****************************************************************************/
-// Give the timer numbers symbolc names to make it easier to move them
-// to different timers if the need arises. Keep these definitions close to the
-// definitions for the response functions to make it easier to check that
-// the timer number matches where the timer event will be routed
-// These symbolic names should be changed to be relevant to your application 
+// ES_TIMER_BITS sets the width of the times given to the timers and returned
+// by ES_Timer_GetTime, 16 or 32. At the 1mS rate 16 bits reach a little over
+// 65 seconds, 32 bits a little over 49 days. ES_Timer_GetTime64 is there
+// either way for a time that never wraps.
+#define ES_TIMER_BITS 16
 
-#define SERVICE0_TIMER 15
-#define MASTER_NODE_TIMER 0
+/****************************************************************************/
+// This is the table of timers, one entry per timer. Each entry gives the
+// symbolic name for the timer number and the post function to be executed
+// when the timer expires:
+//   ES_TIMER( Name, PostFunction )
+// Use ES_TIMER_UNUSED( Name ) to reserve a name for a timer that has no
+// service attached. Timers are numbered in the order listed, and there is no
+// priority in servicing them. The number of timers is set by the table.
+#define TIMER_UNUSED ((pPostFunc)0)
+#define TIMER_TABLE \
+  ES_TIMER( MASTER_NODE_TIMER, Post_Master_Main_Service ) \
+  ES_TIMER( CAN_POLL_TIMER, CAN_Internal_Bus_Post_Poll_Timeout ) \
+  ES_TIMER( CAN_TRANSPORT_TIMER, CAN_Internal_Bus_Post_Transport_Timeout ) \
+  ES_TIMER_UNUSED( SERVICE0_TIMER )
 
 #endif /* CONFIGURE_H */
@@ -1,12 +1,31 @@
 #ifndef DEFER_RECALL_H
 #define DEFER_RECALL_H
 
+#include "ES_Configure.h"
 #include "ES_Queue.h"
 #include "ES_Events.h"
 
+// the number of ES_Event to declare for a deferral queue of Entries events,
+// with room for the time stamps when ES_DEFER_TELEMETRY is set
+#if ES_DEFER_TELEMETRY
+#define ES_DEFERRAL_BLOCK_SIZE(Entries) \
+                   (ES_QUEUE_BLOCK_SIZE(Entries, 0) + (((Entries) + 1) / 2))
+#else
+#define ES_DEFERRAL_BLOCK_SIZE(Entries) ES_QUEUE_BLOCK_SIZE(Entries, 0)
+#endif
+
+#if ES_DEFER_TELEMETRY
+// what ES_GetDeferralStats reports about a deferral queue
+typedef struct {
+  uint8_t Depth;        // events waiting to be recalled
+  uint16_t OldestAge;   // ES_Timer ticks since the oldest was deferred,
+                        // modulo 65536 whatever ES_TIMER_BITS is
+} ES_DeferralStats_t;
+#endif
+
 /****************************************************************************
  Function
-   ES_InitDeferralQueueWith  (wrapper for ES_InitQueue )
+   ES_InitDeferralQueueWith  (wrapper for ES_InitDeferralQueue )
    this is a straight re-naming to aid readability 
  Parameters
    EF_Event * pBlock : pointer to the block of memory to use for the Queue
@@ -16,27 +35,25 @@
  Description
    Initializes a queue structure at the beginning of the block of memory
  Notes
-   you should pass it a block that is at least sizeof(ES_Queue_t) larger than 
-   the number of entries that you want in the queue. Since the size of an 
-   ES_Event (at 4 bytes; 2 enum, 2 param) is greater than the 
-   sizeof(ES_Queue_t), you only need to declare an array of ES_Event
-   with 1 more element than you need for the actual queue.
+   Declare the array of ES_Event with ES_DEFERRAL_BLOCK_SIZE( Entries)
+   elements to get a queue of Entries events.
 ****************************************************************************/
-#define ES_InitDeferralQueueWith( a,b ) ES_InitQueue( a, b )
+#define ES_InitDeferralQueueWith( a,b ) ES_InitDeferralQueue( a, b )
+uint8_t ES_InitDeferralQueue( ES_Event * pBlock, uint8_t BlockSize );
 
 /****************************************************************************
  Function
-   ES_DeferEvent  (wrapper for ES_EnQueueLIFO)
-   this is a straight re-naming to aid readability
+   ES_DeferEvent
  Parameters
    ES_Event * pBlock : pointer to the block of memory in use as the Queue
    ES_Event Event2Add : event to be added to the Queue
  Returns
    bool : true if the add was successful, false if not
  Description
-   if it will fit, adds Event2Add to the Queue
+   if it will fit, adds Event2Add to the Queue (FIFO). The deferral queue
+   keeps its own reference to any payload that the event carries.
  ***************************************************************************/
-#define ES_DeferEvent( a,b ) ES_EnQueueLIFO( a, b )
+bool ES_DeferEvent( ES_Event * pBlock, ES_Event Event2Add );
 
 /****************************************************************************
  Function
@@ -48,14 +65,32 @@
  Returns
      bool true if an event was recalled, false if no event was left in queue
  Description
-     pulls an event off the deferral queue if one is available. It there was
-     something in the queue, then it posts it LIFO fashion to the queue 
-     indicated by WhichService
- Notes
-     None.
+     moves all events off the deferral queue to the front of the queue
+     indicated by WhichService, in one critical region. They come out of it
+     in the order that they were deferred, ahead of anything that was
+     already waiting. Any that do not fit stay deferred.
  Author
      J. Edward Carryer, 11/20/13 16:49
 ****************************************************************************/
 bool ES_RecallEvents( uint8_t WhichService, ES_Event * pBlock );
 
+#if ES_DEFER_TELEMETRY
+/****************************************************************************
+ Function
+     ES_GetDeferralStats
+ Parameters
+     ES_Event * pBlock : the deferral queue
+     ES_DeferralStats_t * pStats : where to put the statistics
+ Returns
+     bool : false if the queue is empty
+ Description
+     reports the depth of the deferral queue and the age of the oldest
+     event in it, the queue must have been set up with
+     ES_InitDeferralQueueWith. The deferral times are kept as 16 bits, so
+     an event deferred for more than 65535 ticks (65 s at the 1 mS rate)
+     shows a wrapped age.
+****************************************************************************/
+bool ES_GetDeferralStats( ES_Event * pBlock, ES_DeferralStats_t * pStats );
+#endif
+
 #endif
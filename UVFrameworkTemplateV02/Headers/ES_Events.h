@@ -8,6 +8,7 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/17/26 13:00 as       EventParam doubles as the payload handle, see ES_Payload.h
  08/05/13 15:19 jec      modifications to suit new portable type definitions
  01/15/12 11:46 jec      moved event enum to config file, changed prefixes to ES
  10/23/11 22:01 jec      customized for Remote Lock problem
@@ -23,6 +24,7 @@
 typedef struct ES_Event_t {
     ES_EventTyp_t EventType;    // what kind of event?
     uint16_t   EventParam;      // parameter value for use w/ this event
+                                // or the payload handle, see ES_Payload.h
 }ES_Event;
 
 
@@ -8,6 +8,13 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 12:00 as       added ES_SpliceToService
+ 10/18/26 11:00 as       added ES_Subscribe, ES_Unsubscribe & ES_Publish
+ 10/18/26 09:00 as       added the latency monitor functions and
+                         ES_PostToServiceAt
+ 10/17/26 17:00 as       added the ES_COALESCE_ policies
+ 10/17/26 16:00 as       added ES_GetServiceQueueStats
+ 10/17/26 15:00 as       added the service profiling functions
  11/02/13 17:06 jec      added ES_PostToServiceLIFO prototype
  08/05/13 15:00 jec      added #include for ES_Port.h to get portability stuff
  10/17/06 07:41 jec      started coding
@@ -16,6 +23,7 @@
 #ifndef ES_Framework_H
 #define ES_Framework_H
 
+#include "ES_Configure.h"
 #include "ES_Port.h"
 #include "ES_Types.h"
 #include "ES_General.h"
@@ -23,6 +31,7 @@
 #include "ES_PostList.h"
 #include "ES_Events.h"
 #include "ES_Timers.h"
+#include "ES_Queue.h"
 
 typedef enum {
               Success = 0,
@@ -33,10 +42,67 @@ typedef enum {
               FailedInit
 } ES_Return_t;
 
+// event coalescing policies, for the last field of SERVICE_TABLE entries
+#define ES_COALESCE_NONE    0
+#define ES_COALESCE_REPLACE 1
+#define ES_COALESCE_DROP    2
+
 ES_Return_t ES_Initialize( TimerRate_t NewRate  );
 ES_Return_t ES_Run( void );
 bool ES_PostAll( ES_Event ThisEvent );
 bool ES_PostToService( uint8_t WhichService, ES_Event ThisEvent);
 bool ES_PostToServiceLIFO( uint8_t WhichService, ES_Event TheEvent);
+uint8_t ES_SpliceToService( uint8_t WhichService, ES_Event * pBlock );
+bool ES_Subscribe( uint8_t WhichService, ES_EventTyp_t EventType );
+bool ES_Unsubscribe( uint8_t WhichService, ES_EventTyp_t EventType );
+bool ES_Publish( ES_Event ThisEvent );
+#if ES_LATENCY_MONITOR
+bool ES_PostToServiceAt( uint8_t WhichService, ES_Event TheEvent,
+                         uint32_t PostTime );
+#endif
+
+#if ES_QUEUE_TELEMETRY
+bool ES_GetServiceQueueStats( uint8_t WhichService,
+                              ES_QueueStats_t * pStats );
+#endif
+
+#if ES_PROFILE_SERVICES
+// run time statistics for a service, kept when ES_PROFILE_SERVICES is 1
+typedef struct {
+  uint32_t NumDispatches;     // number of times the run function was called
+  uint64_t TotalCycles;       // time spent in the run function, all calls
+  uint32_t MinCycles;         // shortest single call
+  uint32_t MaxCycles;         // longest single call
+  uint8_t  QueueHighWater;    // most events ever waiting in the queue
+} ES_ServiceProfile_t;
+
+bool ES_GetServiceProfile( uint8_t WhichService,
+                           ES_ServiceProfile_t * pProfile );
+void ES_ResetServiceProfiles( void );
+void ES_PrintServiceProfiles( void );
+#endif
+
+#if ES_LATENCY_MONITOR
+// latency statistics for a service, kept when ES_LATENCY_MONITOR is 1. All
+// of the times are in ES_ReadCycleCounter counts.
+typedef struct {
+  uint32_t NumEvents;         // number of events measured
+  uint32_t NumOverruns;       // events that took longer than the budget
+  uint32_t MaxWait;           // longest time from the post to the dispatch
+  uint32_t MaxRun;            // longest time in the run function
+  uint32_t MaxTotal;          // longest time from the post to the return
+  uint32_t Histogram[ES_LATENCY_HIST_BINS];  // of the totals, see below
+} ES_LatencyStats_t;
+
+// Histogram[0] counts totals below 2^ES_LATENCY_HIST_SHIFT, Histogram[n]
+// those from ES_LATENCY_BIN_LOW(n) up to twice that, and the last bin counts
+// everything from ES_LATENCY_BIN_LOW(ES_LATENCY_HIST_BINS - 1) up
+#define ES_LATENCY_BIN_LOW(n) \
+              ((n) == 0 ? 0UL : 1UL << ((n) + ES_LATENCY_HIST_SHIFT - 1))
+
+bool ES_GetLatencyStats( uint8_t WhichService, ES_LatencyStats_t * pStats );
+void ES_ResetLatencyStats( void );
+void ES_PrintLatencyStats( void );
+#endif
 
 #endif   // ES_Framework_H
@@ -0,0 +1,74 @@
+/****************************************************************************
+ Module
+     ES_IsrChannel.h
+ Description
+     header file for the lock free ISR to service event channels of the
+     Events & Services Framework
+ Notes
+     Each channel has exactly one producer (one interrupt response routine)
+     and one consumer (ES_Run), so give every ISR that posts events its own
+     channel in ES_Configure.h.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/17/26 20:00 as      added ES_IsrChannelAllEmpty
+ 10/17/26 12:00 as      started coding
+*****************************************************************************/
+#ifndef ES_IsrChannel_H
+#define ES_IsrChannel_H
+
+#include "ES_Configure.h"
+#include "ES_Types.h"
+#include "ES_Events.h"
+
+/****************************************************************************
+ Function
+   ES_IsrChannelPost
+ Parameters
+   uint8_t WhichChannel : the channel owned by the calling ISR
+   uint8_t WhichService : number of the service to post to
+   ES_Event ThisEvent : the event to be posted
+ Returns
+   bool : false if the channel was full or the channel/service do not exist
+ Description
+   posts an event from an interrupt response routine without disabling
+   interrupts. ES_Run moves it on to the service's queue.
+****************************************************************************/
+bool ES_IsrChannelPost( uint8_t WhichChannel, uint8_t WhichService,
+                        ES_Event ThisEvent );
+
+/****************************************************************************
+ Function
+   ES_IsrChannelDrainAll
+ Parameters
+   None
+ Returns
+   bool : always true, so that it can be used in the loop test in ES_Run
+ Description
+   moves every event waiting in the channels on to its service's queue
+****************************************************************************/
+bool ES_IsrChannelDrainAll( void );
+
+/****************************************************************************
+ Function
+   ES_IsrChannelGetDropped
+ Parameters
+   uint8_t WhichChannel : the channel to query
+ Returns
+   uint16_t : number of posts refused because the channel was full
+****************************************************************************/
+uint16_t ES_IsrChannelGetDropped( uint8_t WhichChannel );
+
+/****************************************************************************
+ Function
+   ES_IsrChannelAllEmpty
+ Parameters
+   None
+ Returns
+   bool : true if no channel has an event waiting to be drained
+ Description
+   lets the port check, with interrupts off, that it is safe to sleep
+****************************************************************************/
+bool ES_IsrChannelAllEmpty( void );
+
+#endif /* ES_IsrChannel_H */
@@ -17,13 +17,71 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/17/26 14:00 as       added the multi-word Ready for up to 64 services and
+                         the ES_SetReady/ES_ClrReady/ES_IsAnyReady macros
+ 10/17/26 10:05 as       added ES_CLZ32, ES_GetMSBitSet32 and the ES_ReadyMask_t
+                         selection for up to 32 services
  10/20/13 21:19 jec      got rid of BitNum2ClrMask and replaced with #define
                          replaced Byte2MSBNum with function ES_GetMSBSet
                          replaced Byte2MSBNum array with Nybble2MSBNum
  08/05/13 15:45 jec      added #include for ES_Types.h since we depend on it
  01/15/12 13:03 jec      started coding
 *****************************************************************************/
+#ifndef ES_LookupTables_H
+#define ES_LookupTables_H
+
 #include "ES_Types.h"
+#include "ES_Configure.h"
+
+/*
+  Count leading zeros in a 32 bit word. The Cortex-M4 has a single cycle CLZ
+  instruction, which turns the search for the highest priority ready service
+  into one instruction. Leave ES_CLZ32 undefined on compilers without one and
+  ES_GetMSBitSet will fall back to the nybble walk. The result is undefined
+  for 0 on some compilers, so never pass it 0.
+*/
+#if defined(__CC_ARM)
+#define ES_CLZ32(x) ((uint8_t)__clz(x))
+#elif defined(__GNUC__) || defined(__clang__)
+#define ES_CLZ32(x) ((uint8_t)__builtin_clz(x))
+#endif
+
+/*
+  The Ready variable holds 1 bit per service, so its size follows
+  MAX_NUM_SERVICES. Up to 32 services it is a single word. Beyond that it is
+  an array of 32 bit words plus a summary word with 1 bit per non-empty word,
+  so finding the highest priority is still two CLZs whatever the number of
+  services. Always go through these macros rather than touching Ready.
+*/
+#if MAX_NUM_SERVICES > 32
+#define ES_READY_WORDS ((MAX_NUM_SERVICES + 31) / 32)
+typedef struct {
+  uint32_t Summary;                 // bit n set if Word[n] != 0
+  uint32_t Word[ES_READY_WORDS];
+} ES_ReadyMask_t;
+#define ES_IsAnyReady(r) ((r).Summary != 0)
+#define ES_SetReady(r, n) \
+  do{ (r).Word[(n) >> 5] |= BitNum2SetMask[(n) & 31]; \
+      (r).Summary |= BitNum2SetMask[(n) >> 5]; }while(0)
+#define ES_ClrReady(r, n) \
+  do{ if( ((r).Word[(n) >> 5] &= BitNum2ClrMask[(n) & 31]) == 0 ) \
+        (r).Summary &= BitNum2ClrMask[(n) >> 5]; }while(0)
+#define ES_GetReadyPrior(r) \
+  ((uint8_t)((ES_GetMSBitSet32((r).Summary) << 5) + \
+             ES_GetMSBitSet32((r).Word[ES_GetMSBitSet32((r).Summary)])))
+#else
+#if MAX_NUM_SERVICES > 16
+typedef uint32_t ES_ReadyMask_t;
+#define ES_GetReadyPrior(r) ES_GetMSBitSet32(r)
+#else
+typedef uint16_t ES_ReadyMask_t;
+#define ES_GetReadyPrior(r) ES_GetMSBitSet(r)
+#endif
+#define ES_IsAnyReady(r) ((r) != 0)
+#define ES_SetReady(r, n) ((r) |= BitNum2SetMask[n])
+#define ES_ClrReady(r, n) ((r) &= BitNum2ClrMask[n])
+#endif
+
 /*
   Since we moved up to 16 timers & services, this table got too big to justify
   having a separate table for the clear and set masks, so just #define the
@@ -32,10 +90,10 @@
 #define BitNum2ClrMask ~BitNum2SetMask
 
 /*
-  this table is used to go from a bit number (0-7) to the mask used to set
+  this table is used to go from a bit number (0-31) to the mask used to set
   that bit in a byte.
 */
-extern uint16_t const BitNum2SetMask[];
+extern uint32_t const BitNum2SetMask[];
 
 /*
   this table is used to go from an unsigned 4bit value to the most significant
@@ -56,8 +114,26 @@ extern uint8_t const Nybble2MSBitNum[15];
  Description
    find the MSB that is set in Val2Check and returns that bit number
  Notes
-   
+   uses ES_CLZ32 when available, so it takes the same time for any value
  Author
    J. Edward Carryer, 10/20/13, 17:03
 ****************************************************************************/
 uint8_t ES_GetMSBitSet( uint16_t Val2Check);
+
+/****************************************************************************
+ Function
+   ES_GetMSBitSet32
+ Parameters
+   uint32_t  Val2Check The number to find the MSB in
+ Returns
+   bit number of the MSB that is set in Val2Check, 128 if Val2Check = 0
+ Description
+   32 bit version of ES_GetMSBitSet, for a 32 service Ready variable
+ Notes
+   
+ Author
+   as, 10/17/26, 10:05
+****************************************************************************/
+uint8_t ES_GetMSBitSet32( uint32_t Val2Check);
+
+#endif /* ES_LookupTables_H */
@@ -0,0 +1,114 @@
+/****************************************************************************
+ Module
+     ES_Payload.h
+ Description
+     header file for the event payload pool of the Events & Services
+     Framework
+ Notes
+     An event whose type is at or above ES_FIRST_PAYLOAD_EVENT (see
+     ES_Configure.h) carries a payload handle in its EventParam. The framework
+     counts a reference for every queue that holds the event and drops it
+     once the service's run function has returned, so a receiving service
+     only needs to call ES_PayloadRetain if it wants to keep the payload past
+     the end of its run function.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/17/26 13:00 as      started coding
+*****************************************************************************/
+#ifndef ES_Payload_H
+#define ES_Payload_H
+
+#include "ES_Configure.h"
+#include "ES_Types.h"
+#include "ES_Events.h"
+
+#if ES_PAYLOAD_POOL_SIZE > 0
+
+typedef uint8_t ES_PayloadHandle_t;
+
+// returned by ES_PayloadAlloc when the pool is empty
+#define ES_PAYLOAD_NONE ((ES_PayloadHandle_t)0xFF)
+
+typedef struct {
+  uint32_t Tag;                          // e.g. the CAN identifier
+  uint8_t Length;                        // number of valid bytes in Data
+  uint8_t Data[ES_PAYLOAD_DATA_SIZE];
+} ES_Payload_t;
+
+// true if the event carries a payload handle in EventParam
+#define ES_IsPayloadEvent(ThisEvent) \
+          ((ThisEvent).EventType >= ES_FIRST_PAYLOAD_EVENT)
+
+/****************************************************************************
+ Function
+   ES_PayloadInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   puts every slot back in the free list, called from ES_Initialize
+****************************************************************************/
+void ES_PayloadInit( void );
+
+/****************************************************************************
+ Function
+   ES_PayloadAlloc
+ Parameters
+   None
+ Returns
+   ES_PayloadHandle_t : handle of a free slot, ES_PAYLOAD_NONE if none left
+ Description
+   takes a slot from the pool with one reference, owned by the caller.
+   Fill it in, post it, then ES_PayloadRelease the caller's reference.
+****************************************************************************/
+ES_PayloadHandle_t ES_PayloadAlloc( void );
+
+/****************************************************************************
+ Function
+   ES_PayloadGet
+ Parameters
+   ES_PayloadHandle_t Handle : handle returned by ES_PayloadAlloc
+ Returns
+   ES_Payload_t * : the slot, NULL for a bad handle
+****************************************************************************/
+ES_Payload_t * ES_PayloadGet( ES_PayloadHandle_t Handle );
+
+/****************************************************************************
+ Function
+   ES_PayloadRetain
+ Parameters
+   ES_PayloadHandle_t Handle : handle of an allocated slot
+ Returns
+   None
+ Description
+   adds a reference to the slot
+****************************************************************************/
+void ES_PayloadRetain( ES_PayloadHandle_t Handle );
+
+/****************************************************************************
+ Function
+   ES_PayloadRelease
+ Parameters
+   ES_PayloadHandle_t Handle : handle of an allocated slot
+ Returns
+   None
+ Description
+   drops a reference, returning the slot to the pool when none are left
+****************************************************************************/
+void ES_PayloadRelease( ES_PayloadHandle_t Handle );
+
+/****************************************************************************
+ Function
+   ES_PayloadGetFreeCount
+ Parameters
+   None
+ Returns
+   uint8_t : number of slots currently in the free list
+****************************************************************************/
+uint8_t ES_PayloadGetFreeCount( void );
+
+#endif /* ES_PAYLOAD_POOL_SIZE > 0 */
+
+#endif /* ES_Payload_H */
@@ -9,6 +9,15 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/17/26 21:00 as      _HW_GetTickCount is 32 bits, added _HW_GetTickCount64.
+                        ES_Timer_GetTime is only declared in ES_Timers.h now,
+                        its width follows ES_TIMER_BITS
+ 10/17/26 20:00 as      added _HW_Idle for the tickless idle mode
+ 10/17/26 18:00 as      added the host simulated interrupt & its latency
+ 10/17/26 12:00 as      added ES_MemoryBarrier for the lock free ISR channels
+ 10/17/26 11:00 as      added ES_InitCycleCounter & ES_ReadCycleCounter
+ 10/17/26 09:10 as      added ES_HOST_PORT branch for the PC (x86 Linux) port
+                        in ES_Port_Host.c
  10/14/15 21:50 jec     added prototype for ES_Timer_GetTime
  01/18/15 13:24 jec     clean up and adapt to use TI driver lib functions
                         for implementing EnterCritical & ExitCritical
@@ -53,6 +62,26 @@
 // allocation of temp var for saving interrupt enable status should be defined
 // in ES_Port.c
 
+#ifdef ES_HOST_PORT
+// Host (PC) port, selected by defining ES_HOST_PORT on the compiler command
+// line and building ES_Port_Host.c in place of ES_Port.c. There is no PRIMASK
+// on the host, so the wrappers mask the simulated tick interrupt instead.
+// Ticks raised while masked are held pending, just like the NVIC would.
+extern uint32_t _PRIMASK_temp;
+uint32_t _HW_Host_MaskInts(void);
+void _HW_Host_RestoreInts(uint32_t OldMask);
+
+#define EnterCritical()	{ _PRIMASK_temp = _HW_Host_MaskInts(); }
+#define ExitCritical() { _HW_Host_RestoreInts(_PRIMASK_temp); }
+
+// free running cycle counter for timing measurements, the host uses the TSC
+uint32_t _HW_Host_ReadCycles(void);
+#define ES_InitCycleCounter()
+#define ES_ReadCycleCounter()  _HW_Host_ReadCycles()
+
+// full memory barrier, orders the lock free channel accesses between threads
+#define ES_MemoryBarrier()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
 // Cortex M-series processors 
 // The Interrupt Program Status Register (IPSR) contains the exception type number
 // of the current interrupt service routine (ISR)
@@ -65,6 +94,25 @@ void CPUsetPRIMASK(uint32_t newPRIMASK);
 #define EnterCritical()	{ _PRIMASK_temp = CPUgetPRIMASK_cpsid(); }
 #define ExitCritical() { CPUsetPRIMASK(_PRIMASK_temp); }
 
+// free running cycle counter for timing measurements. This is the DWT cycle
+// counter, which runs at the core clock (40MHz) and wraps every 107 seconds.
+// ES_InitCycleCounter must be called once before ES_ReadCycleCounter is used.
+#define ES_DEMCR         (*(volatile uint32_t *)0xE000EDFC)
+#define ES_DWT_CTRL      (*(volatile uint32_t *)0xE0001000)
+#define ES_DWT_CYCCNT    (*(volatile uint32_t *)0xE0001004)
+#define ES_InitCycleCounter() { ES_DEMCR |= BIT24HI; ES_DWT_CYCCNT = 0; \
+                                ES_DWT_CTRL |= BIT0HI; }
+#define ES_ReadCycleCounter()  (ES_DWT_CYCCNT)
+
+// data memory barrier, keeps the compiler and the core from re-ordering the
+// lock free channel accesses across it. On the M4 it is a single DMB.
+#if defined(__CC_ARM)
+#define ES_MemoryBarrier()     __dmb(0xF)
+#else
+#define ES_MemoryBarrier()     __asm volatile ("dmb" ::: "memory")
+#endif
+#endif /* ES_HOST_PORT */
+
 
 /* Rate constants for programming the SysTick Period to generate tick interrupts.
    These assume an 40MHz configuration, they are the values to be used to program
@@ -97,9 +145,40 @@ typedef enum {	ES_Timer_RATE_OFF  	=   (0),
 // prototypes for the hardware specific routines
 void _HW_Timer_Init(TimerRate_t Rate);
 bool _HW_Process_Pending_Ints( void );
-uint16_t _HW_GetTickCount(void);
+uint32_t _HW_GetTickCount(void);
+uint64_t _HW_GetTickCount64(void);
+void _HW_Idle(void);
 void ConsoleInit(void);
-// and the one Framework function that we define here
-uint16_t ES_Timer_GetTime(void);
+
+#ifdef ES_HOST_PORT
+// host port only: virtual time control and dispatch measurement
+typedef struct {
+  uint32_t NumDispatches;   // number of RunFunc calls for this service
+  uint64_t TotalNs;         // total dispatch time, host nanoseconds
+  uint32_t MaxNs;           // longest single dispatch, host nanoseconds
+} ES_HostDispatchStats_t;
+
+typedef void ES_HostTickHook_t(void);
+
+// a simulated peripheral interrupt, returns the service it posted to
+typedef uint8_t ES_HostIntHook_t(void);
+
+// time from a simulated interrupt's post to the dispatch of its service
+typedef struct {
+  uint32_t NumInts;         // number of interrupts that posted an event
+  uint64_t TotalNs;         // total latency, host nanoseconds
+  uint32_t MaxNs;           // worst latency, host nanoseconds
+} ES_HostLatencyStats_t;
+
+void _HW_Host_Tick(void);
+uint32_t ES_Host_GetVirtualTime(void);
+void ES_Host_SetTickHook(ES_HostTickHook_t *pNewHook);
+int ES_Host_RunFor(uint32_t NumTicks);
+bool ES_Host_GetDispatchStats(uint8_t WhichService,
+                              ES_HostDispatchStats_t *pStats);
+void ES_Host_SetIntHook(ES_HostIntHook_t *pNewHook, uint32_t PeriodNs);
+void ES_Host_GetIntLatency(ES_HostLatencyStats_t *pStats);
+uint32_t ES_Host_GetWakeups(void);
+#endif /* ES_HOST_PORT */
 
 #endif
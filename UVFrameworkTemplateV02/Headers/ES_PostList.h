@@ -5,10 +5,13 @@
      header file for use with the module to post events to lists of state
      machines
  Notes
-
+     The lists are fixed when the code is compiled, and a failed post part
+     way down a list leaves the rest of it unposted. ES_Subscribe and
+     ES_Publish in ES_Framework.c replace them for new code.
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 11:00 as       pointed new code at ES_Publish
  08/05/13 15:19 jec      modifications to suit new portable type definitions
  01/15/12 11:57 jec      modified includes to match Events & Services
  10/16/11 12:28 jec      started coding
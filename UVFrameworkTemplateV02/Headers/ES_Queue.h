@@ -9,6 +9,13 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 12:00 as       added ES_PeekQueue & ES_SpliceToFront
+ 10/18/26 11:00 as       added ES_GetQueueNumFree
+ 10/18/26 09:00 as       added ES_GetQueueOldestSlot
+ 10/17/26 17:00 as       added ES_GetQueueNewestSlot & ES_MergeWithPending
+ 10/17/26 16:00 as       added the optional queue telemetry, ES_QUEUE_BLOCK_SIZE
+ 10/17/26 15:00 as       added ES_GetQueueNumEntries
+ 10/17/26 11:00 as       added ES_QUEUE_DEPTH for sizing ring engine queues
  08/05/13 15:19 jec      modifications to suit new portable type definitions
  01/15/12 09:36 jec      converted to use new types from ES_Types.h
  10/17/11 07:49 jec      new header to match the rest of the framework
@@ -17,9 +24,47 @@
 #ifndef ES_Queue_H
 #define ES_Queue_H
 
+#include "ES_Configure.h"
 #include "ES_Types.h"
 #include "ES_Events.h"
 
+#if ES_QUEUE_TELEMETRY
+/*
+  statistics kept in the header of every queue when ES_QUEUE_TELEMETRY is 1
+*/
+typedef struct {
+  uint32_t NumEnqueued;     // successful posts, FIFO or LIFO
+  uint16_t NumDropped;      // posts refused because the queue was full
+  uint8_t  HighWater;       // most entries that the queue has ever held
+} ES_QueueStats_t;
+
+/*
+  called, if set, each time a post is refused because the queue is full.
+  It may be called from an interrupt response routine, so keep it short.
+*/
+typedef void ES_QueueOverflowHook_t( ES_Event * pBlock, ES_Event Dropped );
+
+// the queue header fills this many ES_Event entries at the start of a block
+#define ES_QUEUE_HEADER_EVENTS \
+  ((4 + sizeof(ES_QueueStats_t) + sizeof(ES_Event) - 1) / sizeof(ES_Event))
+#else
+#define ES_QUEUE_HEADER_EVENTS 1
+#endif
+
+/* 
+  compile time sizing for queues. Rounds a queue size up to the next power
+  of two (up to 128) so that ES_InitQueue will select the ring engine for it.
+  Use ES_QUEUE_BLOCK_SIZE( Size, UseRing) as the size of the ES_Event array,
+  it adds the room for the queue header.
+*/
+#define ES_ROUND_UP_POW2(n) ((n) <= 2 ? 2 : (n) <= 4 ? 4 : (n) <= 8 ? 8 : \
+                             (n) <= 16 ? 16 : (n) <= 32 ? 32 : \
+                             (n) <= 64 ? 64 : 128)
+#define ES_QUEUE_DEPTH(Size, UseRing) \
+                             ((UseRing) ? ES_ROUND_UP_POW2(Size) : (Size))
+#define ES_QUEUE_BLOCK_SIZE(Size, UseRing) \
+                             (ES_QUEUE_DEPTH(Size, UseRing) + ES_QUEUE_HEADER_EVENTS)
+
 /* prototypes for public functions */
 
 uint8_t ES_InitQueue( ES_Event * pBlock, uint8_t BlockSize );
@@ -28,6 +73,23 @@ bool ES_EnQueueLIFO( ES_Event * pBlock, ES_Event Event2Add );
 uint8_t ES_DeQueue( ES_Event * pBlock, ES_Event * pReturnEvent );
 //void EF_FlushQueue( unsigned char * pBlock );
 bool ES_IsQueueEmpty( ES_Event * pBlock );
+uint8_t ES_GetQueueNumEntries( ES_Event * pBlock );
+uint8_t ES_GetQueueNumFree( ES_Event * pBlock );
+uint8_t ES_GetQueueNewestSlot( ES_Event * pBlock );
+uint8_t ES_GetQueueOldestSlot( ES_Event * pBlock );
+uint8_t ES_PeekQueue( ES_Event * pBlock, uint8_t Position,
+                      ES_Event * pReturnEvent );
+uint8_t ES_SpliceToFront( ES_Event * pDest, ES_Event * pSource );
+bool ES_MergeWithPending( ES_Event * pBlock, uint8_t Slot, ES_Event Event2Add,
+                          bool Replace );
+
+// returned by ES_GetQueueNewestSlot & ES_GetQueueOldestSlot when empty
+#define ES_QUEUE_NO_SLOT 0xFF
+#if ES_QUEUE_TELEMETRY
+void ES_GetQueueStats( ES_Event * pBlock, ES_QueueStats_t * pStats );
+void ES_ResetQueueStats( ES_Event * pBlock );
+void ES_SetQueueOverflowHook( ES_QueueOverflowHook_t * pHook );
+#endif
 
 #endif /*ES_Queue_H */
 
@@ -4,72 +4,31 @@
  Description
      This file serves to keep the clutter down in ES_Framework.h
  Notes
+     The prototypes for the Init, Run and Post functions of every service
+     are generated from SERVICE_TABLE in ES_Configure.h, so adding a service
+     only takes a new table entry. Include the service's own header where
+     you need anything else that it declares.
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 09:00 as       added the latency budget to the ES_SERVICE fields
+ 10/17/26 14:00 as       generate the prototypes from SERVICE_TABLE in place
+                         of including SERV_n_HEADER for each service
  01/15/12 10:35 jec      started coding
 *****************************************************************************/
+#ifndef ES_ServiceHeaders_H
+#define ES_ServiceHeaders_H
 
 #include "ES_Configure.h"
-
-#include SERV_0_HEADER
-
-#if NUM_SERVICES > 1
-#include SERV_1_HEADER
-#endif
-
-#if NUM_SERVICES > 2
-#include SERV_2_HEADER
-#endif
-
-#if NUM_SERVICES > 3
-#include SERV_3_HEADER
-#endif
-
-#if NUM_SERVICES > 4
-#include SERV_4_HEADER
-#endif
-
-#if NUM_SERVICES > 5
-#include SERV_5_HEADER
-#endif
-
-#if NUM_SERVICES > 6
-#include SERV_6_HEADER
-#endif
-
-#if NUM_SERVICES > 7
-#include SERV_7_HEADER
-#endif
-
-#if NUM_SERVICES > 8
-#include SERV_8_HEADER
-#endif
-
-#if NUM_SERVICES > 9
-#include SERV_9_HEADER
-#endif
-
-#if NUM_SERVICES > 10
-#include SERV_10_HEADER
-#endif
-
-#if NUM_SERVICES > 11
-#include SERV_11_HEADER
-#endif
-
-#if NUM_SERVICES > 12
-#include SERV_12_HEADER
-#endif
-
-#if NUM_SERVICES > 13
-#include SERV_13_HEADER
-#endif
-
-#if NUM_SERVICES > 14
-#include SERV_14_HEADER
-#endif
-
-#if NUM_SERVICES > 15
-#include SERV_15_HEADER
-#endif
+#include "ES_Types.h"
+#include "ES_Events.h"
+
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  bool InitFunc( uint8_t Priority ); \
+  ES_Event RunFunc( ES_Event ThisEvent ); \
+  bool PostFunc( ES_Event ThisEvent );
+SERVICE_TABLE
+#undef ES_SERVICE
+
+#endif /* ES_ServiceHeaders_H */
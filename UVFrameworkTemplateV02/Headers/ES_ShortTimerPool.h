@@ -0,0 +1,78 @@
+/****************************************************************************
+ Module
+     ES_ShortTimerPool.h
+ Description
+     header file for the pool of microsecond one shot timers that share
+     one hardware timer
+ Notes
+     The pool has NUM_SHORT_TIMER_CHANNELS channels (see ES_Configure.h).
+     A channel posts ES_SHORT_TIMEOUT, with the channel number in
+     EventParam, to the service that started it. Channel numbers are kept
+     below 0xFF so that they can not be taken for the TIMER_A/TIMER_B
+     parameters of the ES_ShortTimer timeouts.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/17/26 23:00 as      started coding
+*****************************************************************************/
+#ifndef ES_ShortTimerPool_H
+#define ES_ShortTimerPool_H
+
+#include "ES_Configure.h"
+#include "ES_Types.h"
+
+// the longest time that one channel can be started for, in microseconds
+#define ES_SHORT_TIMER_POOL_MAX_US 50000000UL
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   sets up the hardware timer and stops every channel. Call it from the
+   init function of any service that uses the pool, only the first call
+   does anything.
+****************************************************************************/
+void ES_ShortTimerPoolInit( void );
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolStart
+ Parameters
+   uint8_t Channel : the channel to start
+   uint8_t WhichService : number of the service to post the timeout to
+   uint32_t Microseconds : time until the timeout
+ Returns
+   bool : false for a bad channel, service or time
+ Description
+   starts (or restarts) a channel, it posts ES_SHORT_TIMEOUT once
+****************************************************************************/
+bool ES_ShortTimerPoolStart( uint8_t Channel, uint8_t WhichService,
+                             uint32_t Microseconds );
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolStop
+ Parameters
+   uint8_t Channel : the channel to stop
+ Returns
+   bool : false for a bad channel
+ Description
+   stops a channel without posting its timeout
+****************************************************************************/
+bool ES_ShortTimerPoolStop( uint8_t Channel );
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolIsRunning
+ Parameters
+   uint8_t Channel : the channel to query
+ Returns
+   bool : true if the channel has been started and not yet timed out
+****************************************************************************/
+bool ES_ShortTimerPoolIsRunning( uint8_t Channel );
+
+#endif /* ES_ShortTimerPool_H */
@@ -14,6 +14,13 @@
  History
  When           Who	What/Why
  -------------- ---	--------
+ 10/17/26 22:00 as  added ES_Timer_SetPeriod & ES_Timer_InitPeriodicTimer
+ 10/17/26 21:00 as  times are ES_TimerTime_t, 16 or 32 bits by ES_TIMER_BITS,
+                    added ES_Timer_GetTime64 and the wrap safe elapsed
+                    time macros
+ 10/17/26 20:00 as  added ES_Timer_GetTicksToNextExpiry and
+                    ES_Timer_MultiTick_Resp for the tickless idle mode
+ 10/17/26 14:00 as  added ES_TimerNum_t, generated from TIMER_TABLE
  10/13/15 20:48 jec  removed prototype for IsTimerActive, I had removed the code
                      a couple of years ago
  08/13/13 12:03 jec  added prototype for ES_Timer_Tick_Resp as part of 
@@ -31,9 +38,32 @@
 #ifndef ES_Timers_H
 #define ES_Timers_H
 
+#include "ES_Configure.h"
 #include "ES_Port.h"
 #include "ES_Types.h"
 
+// the timer numbers, named and counted from TIMER_TABLE in ES_Configure.h
+typedef enum {
+#define ES_TIMER( Name, PostFunc ) Name,
+#define ES_TIMER_UNUSED( Name ) Name,
+  TIMER_TABLE
+#undef ES_TIMER
+#undef ES_TIMER_UNUSED
+  NUM_TIMERS
+} ES_TimerNum_t;
+
+
+// the type of the times given to the timers and returned by ES_Timer_GetTime,
+// and a signed type of the same width for differences between them
+#if ES_TIMER_BITS == 32
+typedef uint32_t ES_TimerTime_t;
+typedef int32_t ES_TimerDiff_t;
+#elif ES_TIMER_BITS == 16
+typedef uint16_t ES_TimerTime_t;
+typedef int16_t ES_TimerDiff_t;
+#else
+#error ES_TIMER_BITS must be 16 or 32
+#endif
 
 typedef enum { ES_Timer_ERR           = -1,
                ES_Timer_ACTIVE        =  1,
@@ -41,13 +71,33 @@ typedef enum { ES_Timer_ERR           = -1,
                ES_Timer_NOT_ACTIVE    =  0
 } ES_TimerReturn_t;
 
+// returned by ES_Timer_GetTicksToNextExpiry when no timer is running
+#define ES_TIMER_NO_EXPIRY 0xFFFFFFFFUL
+
+// wrap safe arithmetic on ES_Timer_GetTime values
+// ticks since Since, right for anything short of a full wrap
+#define ES_Timer_GetElapsed(Since) \
+          ((ES_TimerTime_t)(ES_Timer_GetTime() - (ES_TimerTime_t)(Since)))
+// true once Interval ticks have passed since Since
+#define ES_Timer_HasElapsed(Since, Interval) \
+          (ES_Timer_GetElapsed(Since) >= (ES_TimerTime_t)(Interval))
+// true if time A comes after time B, right while they are less than half
+// the range of ES_TimerTime_t apart
+#define ES_Timer_IsAfter(A, B) \
+          ((ES_TimerDiff_t)((ES_TimerTime_t)(A) - (ES_TimerTime_t)(B)) > 0)
+
 void             ES_Timer_Init(TimerRate_t Rate);
 void             ES_Timer_Tick_Resp(void);
-ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, uint16_t NewTime);
-ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, uint16_t NewTime);
+void             ES_Timer_MultiTick_Resp(uint32_t NumTicks);
+uint32_t         ES_Timer_GetTicksToNextExpiry(void);
+ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, ES_TimerTime_t NewTime);
+ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, ES_TimerTime_t NewTime);
+ES_TimerReturn_t ES_Timer_SetPeriod(uint8_t Num, ES_TimerTime_t Period);
+ES_TimerReturn_t ES_Timer_InitPeriodicTimer(uint8_t Num, ES_TimerTime_t Period);
 ES_TimerReturn_t ES_Timer_StartTimer(uint8_t Num);
 ES_TimerReturn_t ES_Timer_StopTimer(uint8_t Num);
-uint16_t         ES_Timer_GetTime(void);
+ES_TimerTime_t   ES_Timer_GetTime(void);
+uint64_t         ES_Timer_GetTime64(void);
 
 #endif   /* ES_Timers_H */
 /*------------------------------ End of file ------------------------------*/
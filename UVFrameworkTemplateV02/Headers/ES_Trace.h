@@ -0,0 +1,142 @@
+/****************************************************************************
+ Module
+     ES_Trace.h
+ Description
+     header file for the event trace buffer of the Events & Services
+     Framework
+ Notes
+     The framework logs every post and every dispatch into a fixed size
+     ring of records, overwriting the oldest when it is full. The records
+     are read out in a compact binary form (ES_TRACE_RECORD_BYTES each,
+     little endian) for ES_TraceDecode.c to turn back into a timeline.
+     Set ES_TRACE_SIZE in ES_Configure.h to 0 to leave the trace out, the
+     ES_TRACE macro then costs nothing.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/18/26 10:00 as      started coding
+*****************************************************************************/
+#ifndef ES_Trace_H
+#define ES_Trace_H
+
+#include "ES_Configure.h"
+#include "ES_Types.h"
+#include "ES_Events.h"
+
+// what a record describes, the Kind field
+#define ES_TRACE_POST       0   // ES_PostToService queued the event
+#define ES_TRACE_POST_LIFO  1   // ES_PostToServiceLIFO queued the event
+#define ES_TRACE_POST_ALL   2   // ES_PostAll queued the event
+#define ES_TRACE_MERGE      3   // the event was coalesced with a waiting one
+#define ES_TRACE_DROP       4   // the post failed, the queue was full
+#define ES_TRACE_DEFER      5   // the event went to a deferral queue
+#define ES_TRACE_RECALL     6   // ES_RecallEvents moved the event to the front,
+                                // one record per event in queue order
+#define ES_TRACE_DISPATCH   7   // ES_Run passed the event to the run function
+#define ES_TRACE_LOST       8   // EventParam records were overwritten unread
+
+// the Source field, the service whose run function made the post or one of
+#define ES_TRACE_SOURCE_NONE    0xFF   // outside any run function
+#define ES_TRACE_SOURCE_ISR(n)  (0x80 | (n))  // drained from ISR channel n
+
+// a record in the binary form:
+//   bytes 0-3   ES_ReadCycleCounter when it was made
+//   bytes 4-5   EventParam
+//   bytes 6-7   low 16 bits of the record number, gaps show lost records
+//   byte  8     EventType
+//   byte  9     Kind
+//   byte  10    Source
+//   byte  11    Target, the service posted to or dispatched
+#define ES_TRACE_RECORD_BYTES 12
+
+// ES_TraceDump sends ES_TRACE_MAGIC, ES_TRACE_VERSION, ES_TRACE_RECORD_BYTES
+// and a 2 byte record count ahead of the records
+#define ES_TRACE_MAGIC "ESTR"
+#define ES_TRACE_VERSION 1
+#define ES_TRACE_HEADER_BYTES 8
+
+#if ES_TRACE_SIZE > 0
+
+// the service whose run function is being called, set by ES_Run
+extern uint8_t ES_TraceSource;
+
+#define ES_TRACE( Kind, Target, ThisEvent ) \
+                           ES_TraceRecord( (Kind), (Target), (ThisEvent) )
+#define ES_TRACE_SET_SOURCE( Source ) (ES_TraceSource = (Source))
+
+/****************************************************************************
+ Function
+   ES_TraceInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   empties the trace and starts the cycle counter, called by ES_Initialize
+****************************************************************************/
+void ES_TraceInit( void );
+
+/****************************************************************************
+ Function
+   ES_TraceRecord
+ Parameters
+   uint8_t Kind : one of the ES_TRACE_ kinds above
+   uint8_t Target : the service that the event is for
+   ES_Event ThisEvent : the event
+ Returns
+   None
+ Description
+   adds a record to the trace, use the ES_TRACE macro rather than calling
+   this directly
+****************************************************************************/
+void ES_TraceRecord( uint8_t Kind, uint8_t Target, ES_Event ThisEvent );
+
+/****************************************************************************
+ Function
+   ES_TraceEnable
+ Parameters
+   bool Enable : false to freeze the trace, true to carry on
+ Returns
+   None
+ Description
+   a frozen trace ignores new records, so a fault handler can keep the
+   lead up to the fault for reading out later
+****************************************************************************/
+void ES_TraceEnable( bool Enable );
+
+/****************************************************************************
+ Function
+   ES_TraceRead
+ Parameters
+   uint8_t * pDest : where to put the records
+   uint16_t MaxBytes : the room at pDest
+ Returns
+   uint16_t : the number of bytes written, a whole number of records
+ Description
+   moves the oldest unread records out in the binary form, for sending over
+   CAN or any other link. An ES_TRACE_LOST record comes first if records
+   were overwritten since the last read.
+****************************************************************************/
+uint16_t ES_TraceRead( uint8_t * pDest, uint16_t MaxBytes );
+
+/****************************************************************************
+ Function
+   ES_TraceDump
+ Parameters
+   None
+ Returns
+   None
+ Description
+   sends every unread record out of the console UART as one frame, a header
+   followed by the records
+****************************************************************************/
+void ES_TraceDump( void );
+
+#else
+
+#define ES_TRACE( Kind, Target, ThisEvent )
+#define ES_TRACE_SET_SOURCE( Source )
+
+#endif /* ES_TRACE_SIZE */
+
+#endif /* ES_Trace_H */
@@ -1,15 +1,80 @@
 #ifndef MS_CAN_top_layer_H
 #define MS_CAN_top_layer_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ES_Configure.h" /* gets us event definitions */
+#include "ES_Events.h"    /* gets ES_Event for the poll timer's post function */
+
 // typedefs for the states in the state machine
 // State definitions for use with the query function
 
+// Node ID's, one bit of the 29-bit identifier each so that a set of slaves can be named by OR'ing their ids. Bits 1 to 25
+// are free for slaves, the top three bits are the frame kind.
+#define MASTER_NODE_ID             ((uint32_t) 1<<0)
+#define SLAVE_NODE_01_ID           ((uint32_t) 1<<1)
+#define SLAVE_NODE_02_ID           ((uint32_t) 1<<2)
+
+// Slave groups for CAN_Master_Command_Slave, add a group here for any set of lamps that is updated together
+#define ALL_SLAVES_GROUP           (SLAVE_NODE_01_ID | SLAVE_NODE_02_ID)
+
+// Frame kinds, in the top three bits of the identifier. The lowest kind wins arbitration, so commands go ahead of lamp
+// frames, and both go ahead of a transfer.
+#define CAN_KIND_SHIFT             26
+#define CAN_KIND_MASK              ((uint32_t) 7<<CAN_KIND_SHIFT)
+#define CAN_KIND_COMMAND           ((uint32_t) 0<<CAN_KIND_SHIFT)      // CAN_Master_Command_Slave, requests, polls and replies
+#define CAN_KIND_LAMPS             ((uint32_t) 1<<CAN_KIND_SHIFT)      // CAN_Master_Command_Lamps
+#define CAN_KIND_TRANSPORT         ((uint32_t) 2<<CAN_KIND_SHIFT)      // CAN_Transport_Send
+#define CAN_FRAME_KIND(id)         ((id) & CAN_KIND_MASK)
+
+// Lamp commands, packed CAN_LAMP_COMMANDS_PER_FRAME to a frame by CAN_Master_Command_Lamps
+#define CAN_LAMP_COMMAND_BYTES     4
+#define CAN_LAMP_COMMANDS_PER_FRAME (8 / CAN_LAMP_COMMAND_BYTES)
+#define CAN_LAMP_MAX               15                    // Lamps on a slave are 0 to CAN_LAMP_MAX
+#define CAN_LAMP_FADE_MAX          4095                  // Longest fade, in 10 ms steps
+
+typedef struct
+{
+     uint8_t lamp;           // 0 to CAN_LAMP_MAX
+     uint8_t intensity;
+     uint8_t color;
+     uint16_t fade_time;     // Time to get there in 10 ms steps, 0 to CAN_LAMP_FADE_MAX
+} CAN_Lamp_Command_t;
+
+// Transport, the longest transfer CAN_Transport_Send takes and the EventParam of ES_CAN_TRANSPORT_DONE
+#define CAN_TRANSPORT_MAX_LENGTH   4095
+#define CAN_TRANSPORT_SENT         0                     // The last frame is queued
+#define CAN_TRANSPORT_TIMED_OUT    1                     // The receiver stopped sending flow controls
+#define CAN_TRANSPORT_REFUSED      2                     // The receiver had no room for it
+
+// A received frame, as taken out of the receive ring by CAN_Internal_Bus_Get_Frame
+typedef struct
+{
+     uint32_t id;            // The 11 or 29 bit identifier
+     uint8_t object;         // The message object (1-32) that received it
+     uint8_t length;         // Number of valid bytes in data
+     uint8_t data[8];
+} CAN_Frame_t;
+
 //Public function prototypes
 
-void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data);
-void CAN_Master_Command_Slave(uint32_t slave_id, uint8_t * p_cmd_data);
+void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data, uint8_t owner_service);
+bool CAN_Master_Command_Slave(uint32_t slave_ids, uint8_t * p_cmd_data);
 void CAN_Master_Request_Slave(uint32_t slave_id);
-void CAN_Slave_Send_Master(uint8_t * p_slave_data);
+bool CAN_Slave_Send_Master(uint8_t * p_slave_data);
+bool CAN_Internal_Bus_Get_Frame(CAN_Frame_t * p_frame);
+uint32_t CAN_Internal_Bus_Get_Rx_Dropped(void);
+uint8_t CAN_Internal_Bus_Get_Tx_Room(void);
+bool CAN_Master_Poll_Slaves(uint32_t slave_ids, uint16_t timeout);
+bool CAN_Master_Get_Poll_Reply(uint32_t slave_id, CAN_Frame_t * p_frame);
+uint32_t CAN_Master_Get_Poll_Replied(void);
+bool CAN_Internal_Bus_Post_Poll_Timeout(ES_Event ThisEvent);
+bool CAN_Master_Command_Lamps(uint32_t slave_ids, CAN_Lamp_Command_t const * p_commands, uint8_t count);
+uint8_t CAN_Unpack_Lamp_Commands(CAN_Frame_t const * p_frame, CAN_Lamp_Command_t * p_commands);
+bool CAN_Transport_Send(uint32_t node_id, uint8_t const * p_data, uint16_t length);
+uint16_t CAN_Transport_Get_Rx(uint8_t * p_dest, uint16_t max_length, uint32_t * p_from);
+bool CAN_Internal_Bus_Post_Transport_Timeout(ES_Event ThisEvent);
 void CAN_Internal_Bus_ISR(void);
 
 #endif // MS_CAN_top_layer_H
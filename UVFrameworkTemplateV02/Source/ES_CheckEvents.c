@@ -5,9 +5,17 @@
      source file for the module to call the User event checking routines
  Notes
      Users should not modify the contents of this file.
+     The checkers are listed in EVENT_CHECK_TABLE. Rather than call every
+     one of them on every idle pass of ES_Run, a polled checker is only
+     called once its interval has gone by (the list is looked at once per
+     tick) and a signalled checker only after an ISR has flagged it. A
+     polled checker with an interval of 0 is still called on every pass.
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 13:00 as       polled checkers with a minimum interval and
+                         signalled checkers woken by ISRs, from
+                         EVENT_CHECK_TABLE
                 jec     out all user modifications into ES_Configure
  10/16/11 12:32 jec      started coding
 *****************************************************************************/
@@ -15,6 +23,8 @@
 #include "ES_Configure.h"
 #include "ES_Events.h"
 #include "ES_General.h"
+#include "ES_Port.h"
+#include "ES_Timers.h"
 #include "ES_CheckEvents.h"
 
 // Include the header files for the module(s) with your event checkers. 
@@ -22,10 +32,58 @@
 
 #include EVENT_CHECK_HEADER
 
-// Fill in this array with the names of your event checking functions
+typedef struct {
+  CheckFunc *pCheck;
+  ES_TimerTime_t Interval;  // ticks between calls, 0 for every pass
+} PolledChecker_t;
 
-static CheckFunc * const ES_EventList[]={EVENT_CHECK_LIST };
+// count the polled checkers, and the ones among them called on every pass
+enum {
+#define ES_CHECKER_POLLED( Func, Interval ) + 1
+#define ES_CHECKER_SIGNALLED( Func, Name )
+  NUM_POLLED_CHECKERS = 0 EVENT_CHECK_TABLE
+#undef ES_CHECKER_POLLED
+#define ES_CHECKER_POLLED( Func, Interval ) + ((Interval) == 0)
+  , NUM_EVERY_PASS_CHECKERS = 0 EVENT_CHECK_TABLE
+#undef ES_CHECKER_POLLED
+#undef ES_CHECKER_SIGNALLED
+};
 
+// make sure that NUM_CHECKER_SIGNALS agrees with the table, and that the
+// pending signals fit the bits of a uint32_t
+typedef char CheckerSignalCountCheck[
+          ((NUM_CHECKER_SIGNALS_IN_TABLE == NUM_CHECKER_SIGNALS) &&
+           (NUM_CHECKER_SIGNALS <= 32)) ? 1 : -1];
+
+// the tables are built from EVENT_CHECK_TABLE, each with a spare entry at
+// the end so that an empty one is still legal C
+#define ES_CHECKER_POLLED( Func, Interval ) { Func, (Interval) },
+#define ES_CHECKER_SIGNALLED( Func, Name )
+static PolledChecker_t const PolledList[NUM_POLLED_CHECKERS + 1] = {
+  EVENT_CHECK_TABLE
+  { (CheckFunc *)0, 0 }
+};
+#undef ES_CHECKER_POLLED
+#undef ES_CHECKER_SIGNALLED
+
+#if NUM_CHECKER_SIGNALS > 0
+#define ES_CHECKER_POLLED( Func, Interval )
+#define ES_CHECKER_SIGNALLED( Func, Name ) Func,
+static CheckFunc * const SignalledList[NUM_CHECKER_SIGNALS + 1] = {
+  EVENT_CHECK_TABLE
+  (CheckFunc *)0
+};
+#undef ES_CHECKER_POLLED
+#undef ES_CHECKER_SIGNALLED
+#endif
+
+// one bit per signalled checker, set by ISRs
+static volatile uint32_t PendingSignals;
+// when each polled checker was last called
+static ES_TimerTime_t LastPoll[NUM_POLLED_CHECKERS + 1];
+// the tick on which the polled list was last looked at
+static ES_TimerTime_t LastScan;
+static bool Scanned;
 
 // Implementation for public functions
 
@@ -37,24 +95,136 @@ static CheckFunc * const ES_EventList[]={EVENT_CHECK_LIST };
  Returns
    bool: true if any of the user event checkers returned true, false otherwise
  Description
-   loop through the EF_EventList array executing the event checking functions
+   calls the signalled checkers that have been flagged, then the polled
+   checkers that are due, stopping at the first one to find an event
  Notes
-   
+   A checker that is passed over because an earlier one found an event
+   stays flagged, or due, for the next pass.
  Author
    J. Edward Carryer, 10/25/11, 08:55
 ****************************************************************************/
 bool ES_CheckUserEvents( void ) 
 {
   uint8_t i;
-  // loop through the array executing the event checking functions
-  for ( i=0; i< ARRAY_SIZE(ES_EventList); i++) {
-    if ( ES_EventList[i]() == true )
-      break; // found a new event, so process it first
+#if NUM_CHECKER_SIGNALS > 0
+  uint32_t Mask;
+#endif
+  ES_TimerTime_t Now;
+
+#if NUM_CHECKER_SIGNALS > 0
+  if ( PendingSignals != 0 ){
+    for ( i = 0; i < NUM_CHECKER_SIGNALS; i++ ){
+      Mask = 1UL << i;
+      if ( (PendingSignals & Mask) != 0 ){
+        // clear it first, so that a signal during the call is not missed
+        EnterCritical();
+        PendingSignals &= ~Mask;
+        ExitCritical();
+        if ( SignalledList[i]() == true )
+          return true; // found a new event, so process it first
+      }
+    }
+  }
+#endif
+  Now = ES_Timer_GetTime();
+  // an interval can only run out when the tick changes
+  if ( (NUM_EVERY_PASS_CHECKERS == 0) && (Scanned == true) && 
+       (Now == LastScan) )
+    return false;
+  LastScan = Now;
+  Scanned = true;
+  for ( i = 0; i < NUM_POLLED_CHECKERS; i++ ){
+    if ( (PolledList[i].Interval == 0) ||
+         ES_Timer_HasElapsed( LastPoll[i], PolledList[i].Interval ) ){
+      LastPoll[i] = Now;
+      if ( PolledList[i].pCheck() == true ){
+        // let the rest have their turn on the next pass
+        Scanned = false;
+        return true; // found a new event, so process it first
+      }
+    }
+  }
+  return false;
+}
+
+/****************************************************************************
+ Function
+   ES_SignalChecker
+ Parameters
+   ES_CheckerSignal_t : the name of the checker from EVENT_CHECK_TABLE
+ Returns
+   None
+ Description
+   flags a signalled checker to be called on the next idle pass of ES_Run
+ Notes
+   made to be called from an ISR
+ Author
+   as, 10/18/26, 13:00
+****************************************************************************/
+void ES_SignalChecker( ES_CheckerSignal_t WhichChecker )
+{
+#if NUM_CHECKER_SIGNALS > 0
+  if ( WhichChecker < NUM_CHECKER_SIGNALS ){
+    EnterCritical();
+    PendingSignals |= 1UL << WhichChecker;
+    ExitCritical();
+  }
+#else
+  (void)WhichChecker;   // there are none to signal
+#endif
+}
+
+/****************************************************************************
+ Function
+   ES_IsAnyCheckerSignalled
+ Parameters
+   None
+ Returns
+   bool : true if a signalled checker is waiting to be called
+ Description
+   see ES_CheckEvents.h
+ Notes
+
+ Author
+   as, 10/18/26, 13:00
+****************************************************************************/
+bool ES_IsAnyCheckerSignalled( void )
+{
+  return ( PendingSignals != 0 );
+}
+
+/****************************************************************************
+ Function
+   ES_GetTicksToNextPoll
+ Parameters
+   None
+ Returns
+   uint32_t : the number of ticks until the next polled checker is due,
+              ES_TIMER_NO_EXPIRY if none has an interval
+ Description
+   see ES_CheckEvents.h
+ Notes
+   The checkers with an interval of 0 do not count, under ES_TICKLESS_IDLE
+   they are called after each wakeup rather than keeping the core awake.
+ Author
+   as, 10/18/26, 13:00
+****************************************************************************/
+uint32_t ES_GetTicksToNextPoll( void )
+{
+  uint32_t Soonest = ES_TIMER_NO_EXPIRY;
+  ES_TimerTime_t Elapsed;
+  uint8_t i;
+
+  for ( i = 0; i < NUM_POLLED_CHECKERS; i++ ){
+    if ( PolledList[i].Interval == 0 )
+      continue;
+    Elapsed = ES_Timer_GetElapsed( LastPoll[i] );
+    if ( Elapsed >= PolledList[i].Interval )
+      return 0;
+    if ( (uint32_t)(PolledList[i].Interval - Elapsed) < Soonest )
+      Soonest = PolledList[i].Interval - Elapsed;
   }
-  if ( i == ARRAY_SIZE(ES_EventList) ) // if no new events
-    return (false);
-  else
-    return(true);
+  return Soonest;
 }
 /*------------------------------- Footnotes -------------------------------*/
 /*------------------------------ End of file ------------------------------*/
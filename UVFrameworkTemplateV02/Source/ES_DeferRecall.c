@@ -6,12 +6,24 @@
      This is a module implementing  the management of event deferal and recall
       queues
  Notes
-     
+     A deferral queue is FIFO, and ES_RecallEvents moves the whole of it to
+     the front of the service's queue in one go, so the service sees the
+     recalled events in the order that it deferred them and ahead of
+     anything that arrived while they were deferred.
+     With ES_DEFER_TELEMETRY set the time of each deferral is kept in the
+     tail of the block, after the entries, for ES_GetDeferralStats.
 
  History
  When           Who     What/Why
  -------------- ---     --------
  
+ 10/18/26 12:00 as      the deferral queue is FIFO and ES_RecallEvents
+                        splices it to the front of the service's queue in
+                        one critical region, added ES_InitDeferralQueue &
+                        the optional deferral telemetry
+ 10/18/26 10:00 as      deferred and recalled events go to the event trace
+ 10/17/26 13:00 as      ES_DeferEvent is now a function so that deferred
+                        events keep their payload references
  10/11/14 14:58 jec     converted RecallEvent to RecallEvents to pull all
                         deferred events off the deferral queue
  11/02/13 16:38 jec      Began Coding
@@ -23,6 +35,9 @@
 #include "ES_General.h"
 #include "ES_Events.h"
 #include "ES_DeferRecall.h"
+#include "ES_Payload.h"
+#include "ES_Trace.h"
+#include "ES_Timers.h"
 
 /*--------------------------- External Variables --------------------------*/
 
@@ -31,10 +46,76 @@
 /*------------------------------ Module Types -----------------------------*/
 
 /*---------------------------- Module Functions ---------------------------*/
+#if ES_DEFER_TELEMETRY
+static uint16_t * GetStamps( ES_Event * pBlock );
+#endif
 
 /*---------------------------- Module Variables ---------------------------*/
 
 /*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+     ES_InitDeferralQueue
+ Parameters
+     ES_Event * pBlock : pointer to the block of memory to use for the Queue
+     uint8_t BlockSize : size of the block pointed to by pBlock
+ Returns
+     uint8_t : max number of entries in the created queue
+ Description
+     Initializes a deferral queue at the beginning of the block of memory
+ Notes
+     With ES_DEFER_TELEMETRY set, room for a time stamp per entry is held
+     back at the end of the block, so a block from ES_DEFERRAL_BLOCK_SIZE
+     still holds the number of entries asked for.
+ Author
+     as, 10/18/26 12:00
+****************************************************************************/
+uint8_t ES_InitDeferralQueue( ES_Event * pBlock, uint8_t BlockSize ){
+#if ES_DEFER_TELEMETRY
+  uint8_t NumEntries = BlockSize - ES_QUEUE_HEADER_EVENTS;
+
+  // 2 stamps fit in the room of 1 event
+  while ( (uint16_t)(NumEntries + ((NumEntries + 1) / 2)) > 
+                          (uint16_t)(BlockSize - ES_QUEUE_HEADER_EVENTS) )
+    NumEntries--;
+  return ES_InitQueue( pBlock, NumEntries + ES_QUEUE_HEADER_EVENTS );
+#else
+  return ES_InitQueue( pBlock, BlockSize );
+#endif
+}
+
+/****************************************************************************
+ Function
+     ES_DeferEvent
+ Parameters
+     ES_Event * pBlock : pointer to the block of memory in use as the Queue
+     ES_Event Event2Add : event to be added to the Queue
+ Returns
+     bool : true if the add was successful, false if not
+ Description
+     if it will fit, adds Event2Add to the Queue (FIFO)
+ Notes
+     ES_Run drops the service queue's payload reference as soon as the run
+     function returns, so the deferral queue takes one of its own.
+ Author
+     as, 10/17/26 13:00
+****************************************************************************/
+bool ES_DeferEvent( ES_Event * pBlock, ES_Event Event2Add ){
+  if ( ES_EnQueueFIFO( pBlock, Event2Add ) != true )
+    return false;
+#if ES_DEFER_TELEMETRY
+  GetStamps( pBlock )[ES_GetQueueNewestSlot( pBlock )] = 
+                                              (uint16_t)ES_Timer_GetTime();
+#endif
+  // the Source of the record shows which service deferred it
+  ES_TRACE( ES_TRACE_DEFER, ES_TRACE_SOURCE_NONE, Event2Add );
+#if ES_PAYLOAD_POOL_SIZE > 0
+  if ( ES_IsPayloadEvent(Event2Add) )
+    ES_PayloadRetain( (ES_PayloadHandle_t)Event2Add.EventParam );
+#endif
+  return true;
+}
+
 /****************************************************************************
  Function
      ES_RecallEvents
@@ -45,29 +126,64 @@
  Returns
      bool true if an event was recalled, false if no event was left in queue
  Description
-     pulls all events off the deferral queue if any are available. If there was
-     something in the queue, then it posts it LIFO fashion to the queue 
-     indicated by WhichService
+     moves all events off the deferral queue to the front of the queue
+     indicated by WhichService, in the order that they were deferred
  Notes
-     None.
+     The move is one critical region however many events there are. The
+     deferral queue's payload references go with the events. If the
+     service's queue can not take them all, the newest stay deferred for
+     the next recall rather than being lost.
  Author
      J. Edward Carryer, 11/20/13 16:49
 ****************************************************************************/
 bool ES_RecallEvents( uint8_t WhichService, ES_Event * pBlock ){
-  ES_Event RecalledEvent;
-	bool WereEventsPulled = false;
-  // recall any events from the queue
-  do
-	{	
-		ES_DeQueue( pBlock, &RecalledEvent );
-		if (RecalledEvent.EventType != ES_NO_EVENT){
-			ES_PostToServiceLIFO( WhichService, RecalledEvent);
-			WereEventsPulled = true;
-		}
-  }while(RecalledEvent.EventType != ES_NO_EVENT);
-  return WereEventsPulled;
-  
+  return ( ES_SpliceToService( WhichService, pBlock ) != 0 );
+}
+
+#if ES_DEFER_TELEMETRY
+/****************************************************************************
+ Function
+     ES_GetDeferralStats
+ Parameters
+     ES_Event * pBlock : the deferral queue
+     ES_DeferralStats_t * pStats : where to put the statistics
+ Returns
+     bool : false if the queue is empty, the age is then 0
+ Description
+     reports how many events are deferred and how long, in ES_Timer ticks,
+     the oldest of them has been waiting
+ Notes
+     The stamps are 16 bits to keep two in the room of an event, so the
+     age wraps after 65535 ticks (65 s at the 1 mS rate) even when
+     ES_TIMER_BITS is 32.
+ Author
+     as, 10/18/26 12:00
+****************************************************************************/
+bool ES_GetDeferralStats( ES_Event * pBlock, ES_DeferralStats_t * pStats ){
+  uint8_t OldestSlot;
+
+  pStats->Depth = ES_GetQueueNumEntries( pBlock );
+  OldestSlot = ES_GetQueueOldestSlot( pBlock );
+  if ( OldestSlot == ES_QUEUE_NO_SLOT ){
+    pStats->OldestAge = 0;
+    return false;
+  }
+  pStats->OldestAge = (uint16_t)((uint16_t)ES_Timer_GetTime() - 
+                                  GetStamps( pBlock )[OldestSlot]);
+  return true;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// the time stamps start right after the last entry of the queue
+static uint16_t * GetStamps( ES_Event * pBlock ){
+  uint8_t QueueSize = ES_GetQueueNumEntries( pBlock ) + 
+                                              ES_GetQueueNumFree( pBlock );
+
+  return (uint16_t *)&pBlock[ES_QUEUE_HEADER_EVENTS + QueueSize];
 }
+#endif /* ES_DEFER_TELEMETRY */
   
 /*------------------------------- Footnotes -------------------------------*/
 
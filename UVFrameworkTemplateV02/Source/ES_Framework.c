@@ -8,6 +8,26 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 12:00 as       added ES_SpliceToService for the bulk recall
+ 10/18/26 11:00 as       added the publish/subscribe router
+ 10/18/26 10:00 as       posts and dispatches are logged to the event trace
+ 10/18/26 09:00 as       added the optional per service latency monitor
+ 10/17/26 20:00 as       ES_Run sleeps through idle time in the tickless mode
+ 10/17/26 18:00 as       optional batch dispatch in ES_Run
+ 10/17/26 17:00 as       ES_PostToService coalesces events for services
+                         with a coalescing policy
+ 10/17/26 16:00 as       ES_PostAll carries on past a full queue, added
+                         ES_GetServiceQueueStats
+ 10/17/26 15:00 as       added the optional per service run time profiling
+ 10/17/26 14:00 as       service tables and queues are generated from
+                         SERVICE_TABLE, Ready is handled through the
+                         ES_SetReady/ES_ClrReady macros
+ 10/17/26 13:00 as       payload references follow the event through the
+                         queues and are dropped after the run function
+ 10/17/26 12:00 as       ES_Run drains the ISR channels before testing Ready
+ 10/17/26 11:00 as       queues are sized by ES_QUEUE_DEPTH for the ring engine
+ 10/17/26 10:05 as       Ready is now an ES_ReadyMask_t, resolved with the CLZ
+                         based ES_GetReadyPrior
  11/02/13 17:05 jec      added PostToServiceLIFO function
  10/21/13 17:50 jec      added entries to expand number of possible services to 
                          16
@@ -27,10 +47,13 @@
 #include "ES_Framework.h"
 #include "ES_Queue.h"
 #include "ES_LookupTables.h"
+#include "ES_IsrChannel.h"
+#include "ES_Payload.h"
+#include "ES_Trace.h"
 #include <stdio.h>
 
-// Include the header files for the Service modules.
-// This gets you the prototypes for the public service functions.
+// Include the prototypes for the public service functions, generated
+// from SERVICE_TABLE
 
 #include "ES_ServiceHeaders.h"
 
@@ -47,6 +70,9 @@ typedef RunFunc_t * pRunFunc;
 typedef struct {
     InitFunc_t *InitFunc;    // Service Initialization function
     RunFunc_t *RunFunc;      // Service Run function
+#if ES_BATCH_DISPATCH
+    uint8_t BatchLimit;      // most events to dispatch in one go
+#endif
 }ES_ServDesc_t;
 
 typedef struct {
@@ -54,8 +80,30 @@ typedef struct {
     uint8_t Size;      // how big is it
 }ES_QueueDesc_t;
 
+typedef struct {
+    uint8_t Policy;          // ES_COALESCE_NONE, _REPLACE or _DROP
+    uint8_t *pPendingSlot;   // queue slot last used by each EventType
+}ES_CoalesceDesc_t;
+
+typedef struct {
+    uint32_t *pPostTimes;    // when the event in each queue slot was posted
+    uint32_t Budget;         // most counts from post to return, 0 for none
+}ES_LatencyDesc_t;
+
 /*---------------------------- Module Functions ---------------------------*/
 //static bool CheckSystemEvents( void );
+static bool PostToService( uint8_t WhichService, ES_Event TheEvent,
+                           uint32_t PostTime );
+#if ES_PROFILE_SERVICES
+static void NoteRunTime( uint8_t WhichService, uint32_t Cycles );
+static void NoteQueueDepth( uint8_t WhichService );
+#endif
+#if ES_LATENCY_MONITOR
+static void NotePostTime( uint8_t WhichService, uint8_t Slot,
+                          uint32_t PostTime );
+static void NoteLatency( uint8_t WhichService, uint32_t PostTime,
+                         uint32_t StartCycles );
+#endif
 
 /*---------------------------- Module Variables ---------------------------*/
 /****************************************************************************/
@@ -66,162 +114,128 @@ typedef struct {
 // priority with higher indices
 
 static ES_ServDesc_t const ServDescList[] =
-{ {SERV_0_INIT, SERV_0_RUN } /* lowest priority  always present */
-#if NUM_SERVICES > 1
-  ,{SERV_1_INIT, SERV_1_RUN }
-#endif
-#if NUM_SERVICES > 2
-  ,{SERV_2_INIT, SERV_2_RUN }
-#endif
-#if NUM_SERVICES > 3
-  ,{SERV_3_INIT, SERV_3_RUN }
-#endif
-#if NUM_SERVICES > 4
-  ,{SERV_4_INIT, SERV_4_RUN }
-#endif
-#if NUM_SERVICES > 5
-  ,{SERV_5_INIT, SERV_5_RUN }
-#endif
-#if NUM_SERVICES > 6
-  ,{SERV_6_INIT, SERV_6_RUN }
-#endif
-#if NUM_SERVICES > 7
-  ,{SERV_7_INIT, SERV_7_RUN }
-#endif
-#if NUM_SERVICES > 8
-  ,{SERV_8_INIT, SERV_8_RUN }
-#endif
-#if NUM_SERVICES > 9
-  ,{SERV_9_INIT, SERV_9_RUN }
-#endif
-#if NUM_SERVICES > 10
-  ,{SERV_10_INIT, SERV_10_RUN }
-#endif
-#if NUM_SERVICES > 11
-  ,{SERV_11_INIT, SERV_11_RUN }
-#endif
-#if NUM_SERVICES > 12
-  ,{SERV_12_INIT, SERV_12_RUN }
-#endif
-#if NUM_SERVICES > 13
-  ,{SERV_13_INIT, SERV_13_RUN }
-#endif
-#if NUM_SERVICES > 14
-  ,{SERV_14_INIT, SERV_14_RUN }
+{
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  { InitFunc, RunFunc },
+#if ES_BATCH_DISPATCH
+#undef ES_SERVICE
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  { InitFunc, RunFunc, BatchLimit },
 #endif
-#if NUM_SERVICES > 15
-  ,{SERV_15_INIT, SERV_15_RUN }
-#endif
-
+  SERVICE_TABLE
+#undef ES_SERVICE
 };
 
+#if ES_BATCH_DISPATCH
+// every service must be allowed at least one event per dispatch
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  typedef char BatchCheck_##RunFunc[((BatchLimit) >= 1) && \
+                                    ((BatchLimit) <= 255) ? 1 : -1];
+SERVICE_TABLE
+#undef ES_SERVICE
+#endif
+
+// make sure that NUM_SERVICES agrees with the table, and fits in Ready
+typedef char ServiceCountCheck[((ARRAY_SIZE(ServDescList) == NUM_SERVICES) &&
+                                (NUM_SERVICES <= MAX_NUM_SERVICES)) ? 1 : -1];
 
 /****************************************************************************/
-// The queues for the services
+// The queues for the services, sized for the ring engine where selected
 
-static ES_Event Queue0[SERV_0_QUEUE_SIZE+1];
-#if NUM_SERVICES > 1
-static ES_Event Queue1[SERV_1_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 2
-static ES_Event Queue2[SERV_2_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 3
-static ES_Event Queue3[SERV_3_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 4
-static ES_Event Queue4[SERV_4_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 5
-static ES_Event Queue5[SERV_5_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 6
-static ES_Event Queue6[SERV_6_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 7
-static ES_Event Queue7[SERV_7_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 8
-static ES_Event Queue8[SERV_8_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 9
-static ES_Event Queue9[SERV_9_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 10
-static ES_Event Queue10[SERV_10_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 11
-static ES_Event Queue11[SERV_11_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 12
-static ES_Event Queue12[SERV_12_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 13
-static ES_Event Queue13[SERV_13_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 14
-static ES_Event Queue14[SERV_14_QUEUE_SIZE+1];
-#endif
-#if NUM_SERVICES > 15
-static ES_Event Queue15[SERV_15_QUEUE_SIZE+1];
-#endif
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  static ES_Event Queue_##RunFunc[ES_QUEUE_BLOCK_SIZE(QueueSize, UseRing)];
+SERVICE_TABLE
+#undef ES_SERVICE
 
 /****************************************************************************/
 // array of queue descriptors for posting by priority level
 
-static ES_QueueDesc_t const EventQueues[NUM_SERVICES] = { 
-  { Queue0, ARRAY_SIZE(Queue0) } 
-#if NUM_SERVICES > 1
-, { Queue1, ARRAY_SIZE(Queue1) }
-#endif
-#if NUM_SERVICES > 2
-, { Queue2, ARRAY_SIZE(Queue2) }
-#endif
-#if NUM_SERVICES > 3
-, { Queue3, ARRAY_SIZE(Queue3) }
-#endif
-#if NUM_SERVICES > 4
-, { Queue4, ARRAY_SIZE(Queue4) }
-#endif
-#if NUM_SERVICES > 5
-, { Queue5, ARRAY_SIZE(Queue5) }
-#endif
-#if NUM_SERVICES > 6
-, { Queue6, ARRAY_SIZE(Queue6) }
-#endif
-#if NUM_SERVICES > 7
-, { Queue7, ARRAY_SIZE(Queue7) }
-#endif
-#if NUM_SERVICES > 8
-, { Queue8, ARRAY_SIZE(Queue8) }
-#endif
-#if NUM_SERVICES > 9
-, { Queue9, ARRAY_SIZE(Queue9) }
-#endif
-#if NUM_SERVICES > 10
-, { Queue10, ARRAY_SIZE(Queue10) }
-#endif
-#if NUM_SERVICES > 11
-, { Queue11, ARRAY_SIZE(Queue11) }
-#endif
-#if NUM_SERVICES > 12
-, { Queue12, ARRAY_SIZE(Queue12) }
-#endif
-#if NUM_SERVICES > 13
-, { Queue13, ARRAY_SIZE(Queue13) }
-#endif
-#if NUM_SERVICES > 14
-, { Queue14, ARRAY_SIZE(Queue14) }
-#endif
-#if NUM_SERVICES > 15
-, { Queue15, ARRAY_SIZE(Queue15) }
+static ES_QueueDesc_t const EventQueues[NUM_SERVICES] = {
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  { Queue_##RunFunc, ARRAY_SIZE(Queue_##RunFunc) },
+  SERVICE_TABLE
+#undef ES_SERVICE
+};
+
+/****************************************************************************/
+// The coalescing lookup for each service: the queue slot of the latest event
+// of each type, indexed by EventType. The slots are only hints, checked by
+// ES_MergeWithPending before use, so they need no initialization.
+
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  static uint8_t Pending_##RunFunc[((Coalesce) != ES_COALESCE_NONE) ? \
+                                   ES_NUM_COALESCE_TYPES : 1];
+SERVICE_TABLE
+#undef ES_SERVICE
+
+static ES_CoalesceDesc_t const CoalesceList[NUM_SERVICES] = {
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  { Coalesce, Pending_##RunFunc },
+  SERVICE_TABLE
+#undef ES_SERVICE
+};
+
+#if ES_PAYLOAD_POOL_SIZE > 0
+// payload events must never be coalesced, their references would leak
+typedef char CoalesceTypesCheck[(ES_NUM_COALESCE_TYPES <= 
+                                 ES_FIRST_PAYLOAD_EVENT) ? 1 : -1];
 #endif
+
+#if ES_LATENCY_MONITOR
+/****************************************************************************/
+// The post times of the events in each service's queue, kept by queue slot
+// so that they follow the events through LIFO posts and coalescing, and the
+// budgets from SERVICE_TABLE
+
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  static uint32_t PostTimes_##RunFunc[ES_QUEUE_DEPTH(QueueSize, UseRing)];
+SERVICE_TABLE
+#undef ES_SERVICE
+
+static ES_LatencyDesc_t const LatencyList[NUM_SERVICES] = {
+#define ES_SERVICE( InitFunc, RunFunc, PostFunc, QueueSize, UseRing, \
+                    Coalesce, BatchLimit, Budget ) \
+  { PostTimes_##RunFunc, Budget },
+  SERVICE_TABLE
+#undef ES_SERVICE
 };
 
+// the last bin must start inside the 32 bit range of the cycle counter
+typedef char LatencyBinCheck[((ES_LATENCY_HIST_BINS >= 2) &&
+            (ES_LATENCY_HIST_BINS + ES_LATENCY_HIST_SHIFT <= 32)) ? 1 : -1];
+#endif
+
 /****************************************************************************/
 // Variable used to keep track of which queues have events in them
 
-uint16_t Ready;
+ES_ReadyMask_t Ready;
+
+/****************************************************************************/
+// The subscribers to each event type, with the same bit per service as Ready
+
+static ES_ReadyMask_t Subscribers[ES_NUM_PUBLISH_TYPES];
+
+#if ES_PROFILE_SERVICES
+/****************************************************************************/
+// run time and queue depth statistics for each service
+
+static ES_ServiceProfile_t Profiles[NUM_SERVICES];
+#endif
+
+#if ES_LATENCY_MONITOR
+/****************************************************************************/
+// queue wait, run time & latency histogram for each service
+
+static ES_LatencyStats_t LatencyStats[NUM_SERVICES];
+#endif
 
 /*------------------------------ Module Code ------------------------------*/
 /****************************************************************************
@@ -242,6 +256,20 @@ uint16_t Ready;
 ES_Return_t ES_Initialize( TimerRate_t NewRate ){
   uint8_t i;
   ES_Timer_Init( NewRate); // start up the timer subsystem
+#if ES_PAYLOAD_POOL_SIZE > 0
+  ES_PayloadInit();
+#endif
+#if ES_PROFILE_SERVICES
+  ES_InitCycleCounter();
+  ES_ResetServiceProfiles(); // before the inits, as they post ES_INIT
+#endif
+#if ES_LATENCY_MONITOR
+  ES_InitCycleCounter();
+  ES_ResetLatencyStats();
+#endif
+#if ES_TRACE_SIZE > 0
+  ES_TraceInit();
+#endif
   // loop through the list testing for NULL pointers and
   for ( i=0; i< ARRAY_SIZE(ServDescList); i++) {
     if ( (ServDescList[i].InitFunc == (pInitFunc)0) ||
@@ -271,6 +299,11 @@ ES_Return_t ES_Initialize( TimerRate_t NewRate ){
    user generated events.
  Notes
    this function only returns in case of an error
+   With ES_BATCH_DISPATCH set, the chosen service gets up to its batch limit
+   of events before interrupts are processed and Ready is looked at again.
+   The batch ends early once the service's queue is empty.
+   With ES_LATENCY_MONITOR set, the post time of each event is picked up
+   from its queue slot before the run function can re-use the slot.
  Author
    J. Edward Carryer, 10/23/11,
 ****************************************************************************/
@@ -278,25 +311,85 @@ ES_Return_t ES_Run( void ){
   // make these static to improve speed
   uint8_t HighestPrior;
   static ES_Event ThisEvent;
+  static ES_Event RunResult;
+#if ES_BATCH_DISPATCH
+  static uint8_t BatchLeft;
+#endif
+#if ES_PROFILE_SERVICES || ES_LATENCY_MONITOR
+  static uint32_t StartCycles;
+#endif
+#if ES_LATENCY_MONITOR
+  static uint8_t PostSlot;
+  static uint32_t PostTime;
+#endif
   
   while(1){ // stay here unless we detect an error condition
 
     // loop through the list executing the run functions for services
-    // with a non-empty queue. Process any pending ints before testing
-    // Ready
-    while( (_HW_Process_Pending_Ints()) && (Ready != 0)){
-      HighestPrior =  ES_GetMSBitSet(Ready);
+    // with a non-empty queue. Process any pending ints and move the events
+    // that ISRs left in their channels into the queues before testing Ready
+#if NUM_ISR_CHANNELS > 0
+    while( (_HW_Process_Pending_Ints()) && (ES_IsrChannelDrainAll()) &&
+           (ES_IsAnyReady(Ready))){
+#else
+    while( (_HW_Process_Pending_Ints()) && (ES_IsAnyReady(Ready))){
+#endif
+      HighestPrior =  ES_GetReadyPrior(Ready);
+#if ES_BATCH_DISPATCH
+      BatchLeft = ServDescList[HighestPrior].BatchLimit;
+      do{
+#endif
+#if ES_LATENCY_MONITOR
+      PostSlot = ES_GetQueueOldestSlot( EventQueues[HighestPrior].pMem );
+      if ( PostSlot != ES_QUEUE_NO_SLOT )
+        PostTime = LatencyList[HighestPrior].pPostTimes[PostSlot];
+#endif
       if ( ES_DeQueue( EventQueues[HighestPrior].pMem, &ThisEvent ) == 0 ){
-        Ready &= BitNum2ClrMask[HighestPrior]; // mark queue as now empty
+        // mark queue as now empty, with no ISR post between test & clear
+        EnterCritical();
+        if ( ES_IsQueueEmpty( EventQueues[HighestPrior].pMem ) )
+          ES_ClrReady( Ready, HighestPrior );
+        ExitCritical();
+#if ES_BATCH_DISPATCH
+        BatchLeft = 1;  // nothing more for this batch
+#endif
       }
-      if( ServDescList[HighestPrior].RunFunc(ThisEvent).EventType != 
-                                                              ES_NO_EVENT) {
+      // posts made by the run function are traced as coming from it
+      ES_TRACE_SET_SOURCE( HighestPrior );
+      ES_TRACE( ES_TRACE_DISPATCH, HighestPrior, ThisEvent );
+#if ES_PROFILE_SERVICES || ES_LATENCY_MONITOR
+      StartCycles = ES_ReadCycleCounter();
+#endif
+      RunResult = ServDescList[HighestPrior].RunFunc(ThisEvent);
+      ES_TRACE_SET_SOURCE( ES_TRACE_SOURCE_NONE );
+#if ES_PROFILE_SERVICES
+      NoteRunTime( HighestPrior, ES_ReadCycleCounter() - StartCycles );
+#endif
+#if ES_LATENCY_MONITOR
+      if ( PostSlot != ES_QUEUE_NO_SLOT )
+        NoteLatency( HighestPrior, PostTime, StartCycles );
+#endif
+      if( RunResult.EventType != ES_NO_EVENT) {
               return FailedRun;
       }
+#if ES_PAYLOAD_POOL_SIZE > 0
+      // the queue's reference to the payload goes with the event
+      if ( ES_IsPayloadEvent(ThisEvent) )
+        ES_PayloadRelease( (ES_PayloadHandle_t)ThisEvent.EventParam );
+#endif
+#if ES_BATCH_DISPATCH
+      }while( --BatchLeft > 0 );
+#endif
     }
 
     // all the queues are empty, so look for new user detected events
+#if ES_TICKLESS_IDLE
+    // and if there are none, sleep until the next interrupt
+    if ( ES_CheckUserEvents() != true )
+      _HW_Idle();
+#else
     ES_CheckUserEvents();
+#endif
   }
 }
 
@@ -310,6 +403,8 @@ ES_Return_t ES_Run( void ){
  Description
    posts to all of the services' queues 
  Notes
+   a full queue does not stop the post to the rest of the services, the
+   queue counts the drop when ES_QUEUE_TELEMETRY is set
 
  Author
    J. Edward Carryer, 01/15/12,
@@ -317,19 +412,33 @@ ES_Return_t ES_Run( void ){
 bool ES_PostAll( ES_Event ThisEvent){
 
   uint8_t i;
+  bool AllPosted = true;
+#if ES_LATENCY_MONITOR
+  uint32_t PostTime = ES_ReadCycleCounter();  // the same for every service
+#endif
   // loop through the list executing the post functions
   for ( i=0; i< ARRAY_SIZE(EventQueues); i++) {
     if ( ES_EnQueueFIFO( EventQueues[i].pMem, ThisEvent ) != true ){
-      break; // this is a failed post
+      AllPosted = false; // this is a failed post, but try the rest
+      ES_TRACE( ES_TRACE_DROP, i, ThisEvent );
     }else{
-      Ready |= BitNum2SetMask[i]; // show queue as non-empty
+      ES_TRACE( ES_TRACE_POST_ALL, i, ThisEvent );
+#if ES_PAYLOAD_POOL_SIZE > 0
+      // each queue holds its own reference to the payload
+      if ( ES_IsPayloadEvent(ThisEvent) )
+        ES_PayloadRetain( (ES_PayloadHandle_t)ThisEvent.EventParam );
+#endif
+#if ES_LATENCY_MONITOR
+      NotePostTime( i, ES_GetQueueNewestSlot( EventQueues[i].pMem ),
+                    PostTime );
+#endif
+      ES_SetReady( Ready, i ); // show queue as non-empty
+#if ES_PROFILE_SERVICES
+      NoteQueueDepth( i );
+#endif
     }
   }
-  if ( i == ARRAY_SIZE(EventQueues) ){ // if no failures
-    return (true);
-  }else{
-    return(false);
-  }
+  return AllPosted;
 }
 
 /****************************************************************************
@@ -344,18 +453,44 @@ bool ES_PostAll( ES_Event ThisEvent){
    posts to one of the services' queues
  Notes
    used by the timer library to associate a timer with a state machine
+   For a service with a coalescing policy, an event whose type is already
+   waiting in the queue is merged with it (and the post reports success)
+   rather than taking another slot. The check is one lookup by EventType.
  Author
    J. Edward Carryer, 01/16/12,
 ****************************************************************************/
 bool ES_PostToService( uint8_t WhichService, ES_Event TheEvent){
-  if ((WhichService < ARRAY_SIZE(EventQueues)) &&
-      (ES_EnQueueFIFO( EventQueues[WhichService].pMem, TheEvent) == 
-                                                                true )){
-    Ready |= BitNum2SetMask[WhichService]; // show queue as non-empty
-    return true;
-  } else
-    return false;
+#if ES_LATENCY_MONITOR
+  return PostToService( WhichService, TheEvent, ES_ReadCycleCounter() );
+#else
+  return PostToService( WhichService, TheEvent, 0 );
+#endif
+}
+
+#if ES_LATENCY_MONITOR
+/****************************************************************************
+ Function
+   ES_PostToServiceAt
+ Parameters
+   uint8_t : Which service to post to (index into ServDescList)
+   ES_Event : The Event to be posted
+   uint32_t : the ES_ReadCycleCounter count when the event was raised
+ Returns
+   boolean : False if the post function failed during execution
+ Description
+   posts to one of the services' queues, just like ES_PostToService, but
+   with the time that the latency monitor is to measure from
+ Notes
+   for events that were raised some time before they are posted, such as
+   those that wait in an ISR channel
+ Author
+   as, 10/18/26, 09:00
+****************************************************************************/
+bool ES_PostToServiceAt( uint8_t WhichService, ES_Event TheEvent,
+                         uint32_t PostTime ){
+  return PostToService( WhichService, TheEvent, PostTime );
 }
+#endif
 
 /****************************************************************************
  Function
@@ -376,15 +511,516 @@ bool ES_PostToServiceLIFO( uint8_t WhichService, ES_Event TheEvent){
   if ((WhichService < ARRAY_SIZE(EventQueues)) &&
       (ES_EnQueueLIFO( EventQueues[WhichService].pMem, TheEvent) == 
                                                                 true )){
-    Ready |= BitNum2SetMask[WhichService]; // show queue as non-empty
+#if ES_PAYLOAD_POOL_SIZE > 0
+    // the queue now holds a reference to the payload
+    if ( ES_IsPayloadEvent(TheEvent) )
+      ES_PayloadRetain( (ES_PayloadHandle_t)TheEvent.EventParam );
+#endif
+#if ES_LATENCY_MONITOR
+    // the event just added is now at the head of the queue
+    NotePostTime( WhichService,
+                  ES_GetQueueOldestSlot( EventQueues[WhichService].pMem ),
+                  ES_ReadCycleCounter() );
+#endif
+    ES_SetReady( Ready, WhichService ); // show queue as non-empty
+#if ES_PROFILE_SERVICES
+    NoteQueueDepth( WhichService );
+#endif
+    ES_TRACE( ES_TRACE_POST_LIFO, WhichService, TheEvent );
     return true;
-  } else
+  } else{
+    ES_TRACE( ES_TRACE_DROP, WhichService, TheEvent );
+    return false;
+  }
+}
+
+/****************************************************************************
+ Function
+   ES_SpliceToService
+ Parameters
+   uint8_t : Which service to move the events to (index into ServDescList)
+   ES_Event * : the queue to move them from
+ Returns
+   uint8_t : the number of events moved
+ Description
+   moves the events in the queue at pBlock to the front of the service's
+   queue, in their order, ahead of anything that was already waiting. What
+   does not fit is left in pBlock.
+ Notes
+   used by ES_RecallEvents. The events take their payload references with
+   them. Their latency is timed from the move, since the wait in the
+   deferral queue was the service's own choice.
+ Author
+   as, 10/18/26, 12:00
+****************************************************************************/
+uint8_t ES_SpliceToService( uint8_t WhichService, ES_Event * pBlock ){
+  uint8_t NumMoved;
+#if ES_LATENCY_MONITOR || (ES_TRACE_SIZE > 0)
+  ES_Event MovedEvent;
+  uint8_t i;
+#endif
+
+  if ( WhichService >= ARRAY_SIZE(EventQueues) )
+    return 0;
+  NumMoved = ES_SpliceToFront( EventQueues[WhichService].pMem, pBlock );
+  if ( NumMoved == 0 )
+    return 0;
+#if ES_LATENCY_MONITOR || (ES_TRACE_SIZE > 0)
+  for ( i = 0; i < NumMoved; i++ ){
+#if ES_LATENCY_MONITOR
+    NotePostTime( WhichService,
+                  ES_PeekQueue( EventQueues[WhichService].pMem, i, &MovedEvent ),
+                  ES_ReadCycleCounter() );
+#else
+    ES_PeekQueue( EventQueues[WhichService].pMem, i, &MovedEvent );
+#endif
+    ES_TRACE( ES_TRACE_RECALL, WhichService, MovedEvent );
+  }
+#endif
+  ES_SetReady( Ready, WhichService ); // show queue as non-empty
+#if ES_PROFILE_SERVICES
+  NoteQueueDepth( WhichService );
+#endif
+  return NumMoved;
+}
+
+/****************************************************************************
+ Function
+   ES_Subscribe
+ Parameters
+   uint8_t : Which service is subscribing (index into ServDescList)
+   ES_EventTyp_t : the type of event that it wants
+ Returns
+   boolean : False if there is no such service, or the type can not be
+             published (see ES_NUM_PUBLISH_TYPES)
+ Description
+   adds a service to the subscribers for an event type, so that ES_Publish
+   posts events of the type to it
+ Notes
+   Call it from the service's init function or run function, not an ISR.
+   Subscribing twice is the same as subscribing once.
+ Author
+   as, 10/18/26, 11:00
+****************************************************************************/
+bool ES_Subscribe( uint8_t WhichService, ES_EventTyp_t EventType ){
+  if ( (WhichService >= ARRAY_SIZE(EventQueues)) ||
+       (EventType >= ES_NUM_PUBLISH_TYPES) )
+    return false;
+  ES_SetReady( Subscribers[EventType], WhichService );
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_Unsubscribe
+ Parameters
+   uint8_t : Which service is unsubscribing (index into ServDescList)
+   ES_EventTyp_t : the type of event that it no longer wants
+ Returns
+   boolean : False if there is no such service, or the type can not be
+             published
+ Description
+   removes a service from the subscribers for an event type
+ Notes
+   events of the type that are already in its queue stay there
+ Author
+   as, 10/18/26, 11:00
+****************************************************************************/
+bool ES_Unsubscribe( uint8_t WhichService, ES_EventTyp_t EventType ){
+  if ( (WhichService >= ARRAY_SIZE(EventQueues)) ||
+       (EventType >= ES_NUM_PUBLISH_TYPES) )
+    return false;
+  ES_ClrReady( Subscribers[EventType], WhichService );
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_Publish
+ Parameters
+   ES_Event : The Event to be published
+ Returns
+   boolean : False if the event was not posted, True if it was posted to
+             every subscriber (or there are none)
+ Description
+   posts an event to every service that has subscribed to its EventType,
+   highest priority first. Unlike the distribution lists, either all of the
+   subscribers get the event or none of them do.
+ Notes
+   Every subscriber's queue must have a free slot, even where the event
+   would have been coalesced with one already waiting. The check and the
+   posts are only all or nothing against other posts from ES_Run's side,
+   which is why ISRs should post through their channels.
+ Author
+   as, 10/18/26, 11:00
+****************************************************************************/
+bool ES_Publish( ES_Event ThisEvent ){
+  ES_ReadyMask_t ToCheck;
+  ES_ReadyMask_t ToPost;
+  uint8_t WhichService;
+  bool AllPosted = true;
+#if ES_LATENCY_MONITOR
+  uint32_t PostTime = ES_ReadCycleCounter();  // the same for every service
+#else
+  uint32_t PostTime = 0;
+#endif
+
+  if ( ThisEvent.EventType >= ES_NUM_PUBLISH_TYPES )
+    return false;
+  ToCheck = Subscribers[ThisEvent.EventType];
+  ToPost = ToCheck;
+  // make sure that there is room for it everywhere before posting anywhere
+  while ( ES_IsAnyReady(ToCheck) ){
+    WhichService = ES_GetReadyPrior(ToCheck);
+    if ( ES_GetQueueNumFree( EventQueues[WhichService].pMem ) == 0 ){
+      ES_TRACE( ES_TRACE_DROP, WhichService, ThisEvent );
+      return false;
+    }
+    ES_ClrReady( ToCheck, WhichService );
+  }
+  while ( ES_IsAnyReady(ToPost) ){
+    WhichService = ES_GetReadyPrior(ToPost);
+    if ( PostToService( WhichService, ThisEvent, PostTime ) != true )
+      AllPosted = false;  // only if an ISR filled the queue meanwhile
+    ES_ClrReady( ToPost, WhichService );
+  }
+  return AllPosted;
+}
+
+#if ES_QUEUE_TELEMETRY
+/****************************************************************************
+ Function
+   ES_GetServiceQueueStats
+ Parameters
+   uint8_t : Which service to report on (index into ServDescList)
+   ES_QueueStats_t * : where to copy the statistics
+ Returns
+   boolean : False if there is no such service
+ Description
+   copies the post, drop & high water statistics for a service's queue
+ Notes
+
+ Author
+   as, 10/17/26, 16:00
+****************************************************************************/
+bool ES_GetServiceQueueStats( uint8_t WhichService,
+                              ES_QueueStats_t * pStats ){
+  if ( WhichService >= ARRAY_SIZE(EventQueues) )
+    return false;
+  ES_GetQueueStats( EventQueues[WhichService].pMem, pStats );
+  return true;
+}
+#endif
+
+#if ES_PROFILE_SERVICES
+/****************************************************************************
+ Function
+   ES_GetServiceProfile
+ Parameters
+   uint8_t : Which service to report on (index into ServDescList)
+   ES_ServiceProfile_t * : where to copy the statistics
+ Returns
+   boolean : False if there is no such service
+ Description
+   copies the run time & queue depth statistics for one service
+ Notes
+   times are in ES_ReadCycleCounter counts, CPU cycles on the target
+ Author
+   as, 10/17/26, 15:00
+****************************************************************************/
+bool ES_GetServiceProfile( uint8_t WhichService,
+                           ES_ServiceProfile_t * pProfile ){
+  if ( WhichService >= ARRAY_SIZE(Profiles) )
+    return false;
+  *pProfile = Profiles[WhichService];
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_ResetServiceProfiles
+ Parameters
+   None
+ Returns
+   None
+ Description
+   clears the statistics for all of the services
+ Notes
+
+ Author
+   as, 10/17/26, 15:00
+****************************************************************************/
+void ES_ResetServiceProfiles( void ){
+  uint8_t i;
+
+  for ( i=0; i< ARRAY_SIZE(Profiles); i++) {
+    Profiles[i].NumDispatches = 0;
+    Profiles[i].TotalCycles = 0;
+    Profiles[i].MinCycles = 0xFFFFFFFF;
+    Profiles[i].MaxCycles = 0;
+    Profiles[i].QueueHighWater = 0;
+  }
+}
+
+/****************************************************************************
+ Function
+   ES_PrintServiceProfiles
+ Parameters
+   None
+ Returns
+   None
+ Description
+   prints a table of the statistics for all of the services to the console
+ Notes
+   slow, so call it from a service while nothing time critical is going on
+ Author
+   as, 10/17/26, 15:00
+****************************************************************************/
+void ES_PrintServiceProfiles( void ){
+  uint8_t i;
+  uint32_t MeanCycles;
+
+  printf("\r\nService Dispatches      Min     Mean      Max QueueHWM\r\n");
+  for ( i=0; i< ARRAY_SIZE(Profiles); i++) {
+    if ( Profiles[i].NumDispatches == 0 ){
+      printf("%7u %10u        -        -        - %8u\r\n", i, 0U,
+             Profiles[i].QueueHighWater);
+      continue;
+    }
+    MeanCycles = (uint32_t)(Profiles[i].TotalCycles /
+                            Profiles[i].NumDispatches);
+    printf("%7u %10lu %8lu %8lu %8lu %8u\r\n", i,
+           (unsigned long)Profiles[i].NumDispatches,
+           (unsigned long)Profiles[i].MinCycles, (unsigned long)MeanCycles,
+           (unsigned long)Profiles[i].MaxCycles, Profiles[i].QueueHighWater);
+  }
+}
+#endif /* ES_PROFILE_SERVICES */
+
+#if ES_LATENCY_MONITOR
+/****************************************************************************
+ Function
+   ES_GetLatencyStats
+ Parameters
+   uint8_t : Which service to report on (index into ServDescList)
+   ES_LatencyStats_t * : where to copy the statistics
+ Returns
+   boolean : False if there is no such service
+ Description
+   copies the latency statistics and histogram for one service
+ Notes
+   times are in ES_ReadCycleCounter counts, CPU cycles on the target
+ Author
+   as, 10/18/26, 09:00
+****************************************************************************/
+bool ES_GetLatencyStats( uint8_t WhichService, ES_LatencyStats_t * pStats ){
+  if ( WhichService >= ARRAY_SIZE(LatencyStats) )
     return false;
+  *pStats = LatencyStats[WhichService];
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_ResetLatencyStats
+ Parameters
+   None
+ Returns
+   None
+ Description
+   clears the latency statistics and histograms for all of the services
+ Notes
+
+ Author
+   as, 10/18/26, 09:00
+****************************************************************************/
+void ES_ResetLatencyStats( void ){
+  uint8_t i;
+  uint8_t Bin;
+
+  for ( i=0; i< ARRAY_SIZE(LatencyStats); i++) {
+    LatencyStats[i].NumEvents = 0;
+    LatencyStats[i].NumOverruns = 0;
+    LatencyStats[i].MaxWait = 0;
+    LatencyStats[i].MaxRun = 0;
+    LatencyStats[i].MaxTotal = 0;
+    for ( Bin=0; Bin< ES_LATENCY_HIST_BINS; Bin++)
+      LatencyStats[i].Histogram[Bin] = 0;
+  }
+}
+
+/****************************************************************************
+ Function
+   ES_PrintLatencyStats
+ Parameters
+   None
+ Returns
+   None
+ Description
+   prints a table of the latency statistics for all of the services to the
+   console, followed by the histograms as comma separated lines of
+   service,bin_low,count for offline analysis
+ Notes
+   slow, so call it from a service while nothing time critical is going on.
+   Empty bins are left out of the histograms.
+ Author
+   as, 10/18/26, 09:00
+****************************************************************************/
+void ES_PrintLatencyStats( void ){
+  uint8_t i;
+  uint8_t Bin;
+
+  printf("\r\nService     Events  Overruns   MaxWait    MaxRun  MaxTotal\r\n");
+  for ( i=0; i< ARRAY_SIZE(LatencyStats); i++) {
+    printf("%7u %10lu %9lu %9lu %9lu %9lu\r\n", i,
+           (unsigned long)LatencyStats[i].NumEvents,
+           (unsigned long)LatencyStats[i].NumOverruns,
+           (unsigned long)LatencyStats[i].MaxWait,
+           (unsigned long)LatencyStats[i].MaxRun,
+           (unsigned long)LatencyStats[i].MaxTotal);
+  }
+  printf("\r\nservice,bin_low,count\r\n");
+  for ( i=0; i< ARRAY_SIZE(LatencyStats); i++) {
+    for ( Bin=0; Bin< ES_LATENCY_HIST_BINS; Bin++) {
+      if ( LatencyStats[i].Histogram[Bin] != 0 )
+        printf("%u,%lu,%lu\r\n", i, (unsigned long)ES_LATENCY_BIN_LOW(Bin),
+               (unsigned long)LatencyStats[i].Histogram[Bin]);
+    }
+  }
 }
+#endif /* ES_LATENCY_MONITOR */
 
 //*********************************
 // private functions
 //*********************************
+// the body of ES_PostToService & ES_PostToServiceAt, PostTime is only used
+// by the latency monitor. A merged event keeps the post time of the event
+// that was already waiting.
+static bool PostToService( uint8_t WhichService, ES_Event TheEvent,
+                           uint32_t PostTime ){
+  uint8_t *pPendingSlot = (uint8_t *)0;
+
+  if ((WhichService < ARRAY_SIZE(EventQueues)) &&
+      (CoalesceList[WhichService].Policy != ES_COALESCE_NONE) &&
+      (TheEvent.EventType < ES_NUM_COALESCE_TYPES)){
+    pPendingSlot = 
+          &CoalesceList[WhichService].pPendingSlot[TheEvent.EventType];
+    if ( ES_MergeWithPending( EventQueues[WhichService].pMem, *pPendingSlot,
+              TheEvent, 
+              (CoalesceList[WhichService].Policy == ES_COALESCE_REPLACE) ) ){
+      ES_TRACE( ES_TRACE_MERGE, WhichService, TheEvent );
+      return true;
+    }
+  }
+  if ((WhichService < ARRAY_SIZE(EventQueues)) &&
+      (ES_EnQueueFIFO( EventQueues[WhichService].pMem, TheEvent) == 
+                                                                true )){
+    // remember where this type now waits, for the next post to find
+    if ( pPendingSlot != (uint8_t *)0 )
+      *pPendingSlot = ES_GetQueueNewestSlot( EventQueues[WhichService].pMem );
+#if ES_PAYLOAD_POOL_SIZE > 0
+    // the queue now holds a reference to the payload
+    if ( ES_IsPayloadEvent(TheEvent) )
+      ES_PayloadRetain( (ES_PayloadHandle_t)TheEvent.EventParam );
+#endif
+#if ES_LATENCY_MONITOR
+    NotePostTime( WhichService,
+                  ES_GetQueueNewestSlot( EventQueues[WhichService].pMem ),
+                  PostTime );
+#else
+    (void)PostTime;
+#endif
+    ES_SetReady( Ready, WhichService ); // show queue as non-empty
+#if ES_PROFILE_SERVICES
+    NoteQueueDepth( WhichService );
+#endif
+    ES_TRACE( ES_TRACE_POST, WhichService, TheEvent );
+    return true;
+  } else{
+    ES_TRACE( ES_TRACE_DROP, WhichService, TheEvent );
+    return false;
+  }
+}
+
+#if ES_PROFILE_SERVICES
+// adds one run of a service to its statistics
+static void NoteRunTime( uint8_t WhichService, uint32_t Cycles ){
+  ES_ServiceProfile_t * pProfile = &Profiles[WhichService];
+
+  pProfile->NumDispatches++;
+  pProfile->TotalCycles += Cycles;
+  if ( Cycles < pProfile->MinCycles )
+    pProfile->MinCycles = Cycles;
+  if ( Cycles > pProfile->MaxCycles )
+    pProfile->MaxCycles = Cycles;
+}
+
+// called after each successful post to track the deepest the queue has been
+static void NoteQueueDepth( uint8_t WhichService ){
+  uint8_t Depth = ES_GetQueueNumEntries( EventQueues[WhichService].pMem );
+
+  if ( Depth > Profiles[WhichService].QueueHighWater )
+    Profiles[WhichService].QueueHighWater = Depth;
+}
+#endif
+
+#if ES_LATENCY_MONITOR
+// called after each successful post to remember when the event in Slot was
+// posted. An ISR post between the enqueue and this could move the newest
+// slot on, so ISRs should post through their channels.
+static void NotePostTime( uint8_t WhichService, uint8_t Slot,
+                          uint32_t PostTime ){
+  if ( Slot != ES_QUEUE_NO_SLOT )
+    LatencyList[WhichService].pPostTimes[Slot] = PostTime;
+}
+
+// adds one event to the latency statistics of the service that ran it, and
+// reports it if it went over the service's budget
+static void NoteLatency( uint8_t WhichService, uint32_t PostTime,
+                         uint32_t StartCycles ){
+  ES_LatencyStats_t * pStats = &LatencyStats[WhichService];
+  uint32_t EndCycles = ES_ReadCycleCounter();
+  uint32_t Total = EndCycles - PostTime;
+  uint32_t Scaled = Total >> ES_LATENCY_HIST_SHIFT;
+  uint8_t Bin = 0;
+  ES_Event OverrunEvent;
+
+  pStats->NumEvents++;
+  if ( (StartCycles - PostTime) > pStats->MaxWait )
+    pStats->MaxWait = StartCycles - PostTime;
+  if ( (EndCycles - StartCycles) > pStats->MaxRun )
+    pStats->MaxRun = EndCycles - StartCycles;
+  if ( Total > pStats->MaxTotal )
+    pStats->MaxTotal = Total;
+  // the bin is one more than the position of the highest bit set in Scaled
+  if ( Scaled != 0 ){
+#ifdef ES_CLZ32
+    Bin = 32 - ES_CLZ32( Scaled );
+#else
+    while ( Scaled != 0 ){
+      Bin++;
+      Scaled >>= 1;
+    }
+#endif
+    if ( Bin >= ES_LATENCY_HIST_BINS )
+      Bin = ES_LATENCY_HIST_BINS - 1;
+  }
+  pStats->Histogram[Bin]++;
+
+  if ( (LatencyList[WhichService].Budget != 0) &&
+       (Total > LatencyList[WhichService].Budget) ){
+    pStats->NumOverruns++;
+    // overruns of the service that hears about them are only counted, as
+    // each report could otherwise cause the next
+    if ( WhichService != ES_LATENCY_OVERRUN_SERVICE ){
+      OverrunEvent.EventType = ES_LATENCY_OVERRUN;
+      OverrunEvent.EventParam = WhichService;
+      PostToService( ES_LATENCY_OVERRUN_SERVICE, OverrunEvent, EndCycles );
+    }
+  }
+}
+#endif
+
 #if 0
 /****************************************************************************
  Function
@@ -0,0 +1,289 @@
+//#define TEST
+/****************************************************************************
+ Module
+     ES_IsrChannel.c
+ Description
+     Lock free single producer/single consumer channels that carry events
+     from interrupt response routines to the framework services.
+ Notes
+     Posting through ES_PostToService from an ISR works, but the queue code
+     turns interrupts off to do it, which adds jitter to every other ISR.
+     An ISR that posts through its own channel only does plain loads and
+     stores: it owns the Tail index, ES_Run owns the Head index, and memory
+     barriers order the entry data against the index that publishes it.
+     ES_Run drains the channels into the service queues before it tests
+     Ready, so the events still go through the normal queues and priorities.
+
+     Indices are free running uint8_t counts masked by ISR_CHANNEL_SIZE - 1,
+     which must be a power of two no larger than 128.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/18/26 10:00 as      drained posts are traced with the channel as source
+ 10/18/26 09:00 as      entries carry their post time for the latency monitor
+ 10/17/26 20:00 as      added ES_IsrChannelAllEmpty
+ 10/17/26 13:00 as      drop the ISR's payload reference once it is queued
+ 10/17/26 12:00 as      started coding
+*****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+#include "ES_IsrChannel.h"
+#include "ES_Payload.h"
+#include "ES_Trace.h"
+
+#if NUM_ISR_CHANNELS > 0
+/*----------------------------- Module Defines ----------------------------*/
+#define CHANNEL_INDEX_MASK (ISR_CHANNEL_SIZE - 1)
+
+#if ((ISR_CHANNEL_SIZE & CHANNEL_INDEX_MASK) != 0) || (ISR_CHANNEL_SIZE > 128)
+#error ISR_CHANNEL_SIZE must be a power of two no larger than 128
+#endif
+
+typedef struct {
+  ES_Event Event;
+  uint8_t WhichService;
+#if ES_LATENCY_MONITOR
+  uint32_t PostTime;          // when the ISR posted it, see ES_PostToServiceAt
+#endif
+} ChannelEntry_t;
+
+typedef struct {
+  ChannelEntry_t Entries[ISR_CHANNEL_SIZE];
+  volatile uint8_t Head;      // count of entries taken, written by ES_Run only
+  volatile uint8_t Tail;      // count of entries added, written by the ISR only
+  uint16_t Dropped;           // written by the ISR only
+} IsrChannel_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static ChannelEntry_t * PeekChannel( IsrChannel_t * pChannel );
+static void ReleaseEntry( IsrChannel_t * pChannel );
+
+/*---------------------------- Module Variables ---------------------------*/
+static IsrChannel_t Channels[NUM_ISR_CHANNELS];
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+   ES_IsrChannelPost
+ Parameters
+   uint8_t WhichChannel : the channel owned by the calling ISR
+   uint8_t WhichService : number of the service to post to
+   ES_Event ThisEvent : the event to be posted
+ Returns
+   bool : false if the channel was full or the channel/service do not exist
+ Description
+   posts an event from an interrupt response routine without disabling
+   interrupts. ES_Run moves it on to the service's queue.
+ Notes
+   only one ISR may post to any one channel
+ Author
+   as, 10/17/26, 12:00
+****************************************************************************/
+bool ES_IsrChannelPost( uint8_t WhichChannel, uint8_t WhichService,
+                        ES_Event ThisEvent ){
+  IsrChannel_t * pChannel;
+  uint8_t Tail;
+
+  if ( (WhichChannel >= NUM_ISR_CHANNELS) || (WhichService >= NUM_SERVICES) )
+    return false;
+  pChannel = &Channels[WhichChannel];
+  Tail = pChannel->Tail;   // we are the only writer, so this is current
+  if ( (uint8_t)(Tail - pChannel->Head) >= ISR_CHANNEL_SIZE ){
+    pChannel->Dropped++;
+    return false;
+  }
+  // finish reading Head before re-using the slot that ES_Run gave back
+  ES_MemoryBarrier();
+  pChannel->Entries[Tail & CHANNEL_INDEX_MASK].Event = ThisEvent;
+  pChannel->Entries[Tail & CHANNEL_INDEX_MASK].WhichService = WhichService;
+#if ES_LATENCY_MONITOR
+  pChannel->Entries[Tail & CHANNEL_INDEX_MASK].PostTime =
+                                                      ES_ReadCycleCounter();
+#endif
+  // the entry must be complete before the new Tail makes it visible
+  ES_MemoryBarrier();
+  pChannel->Tail = Tail + 1;
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_IsrChannelDrainAll
+ Parameters
+   None
+ Returns
+   bool : always true, so that it can be used in the loop test in ES_Run
+ Description
+   moves every event waiting in the channels on to its service's queue
+ Notes
+   If a service's queue is full we stop draining that channel and leave the
+   rest of its events in place for the next pass. That keeps the events in
+   order, and ES_Run will have emptied some of the queue by the next pass.
+   The reference that the ISR took on a payload passes to the channel, and
+   is dropped here once the service's queue holds its own.
+   The latency monitor measures from the ISR's post, not from the drain.
+ Author
+   as, 10/17/26, 12:00
+****************************************************************************/
+bool ES_IsrChannelDrainAll( void ){
+  uint8_t i;
+  ChannelEntry_t * pEntry;
+
+  for ( i = 0; i < NUM_ISR_CHANNELS; i++ ){
+    ES_TRACE_SET_SOURCE( ES_TRACE_SOURCE_ISR(i) );
+    while ( (pEntry = PeekChannel( &Channels[i] )) != (ChannelEntry_t *)0 ){
+#if ES_LATENCY_MONITOR
+      if ( ES_PostToServiceAt( pEntry->WhichService, pEntry->Event,
+                               pEntry->PostTime ) != true )
+        break;
+#else
+      if ( ES_PostToService( pEntry->WhichService, pEntry->Event ) != true )
+        break;
+#endif
+#if ES_PAYLOAD_POOL_SIZE > 0
+      if ( ES_IsPayloadEvent(pEntry->Event) )
+        ES_PayloadRelease( (ES_PayloadHandle_t)pEntry->Event.EventParam );
+#endif
+      ReleaseEntry( &Channels[i] );
+    }
+  }
+  ES_TRACE_SET_SOURCE( ES_TRACE_SOURCE_NONE );
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_IsrChannelGetDropped
+ Parameters
+   uint8_t WhichChannel : the channel to query
+ Returns
+   uint16_t : number of posts refused because the channel was full
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/17/26, 12:00
+****************************************************************************/
+uint16_t ES_IsrChannelGetDropped( uint8_t WhichChannel ){
+  if ( WhichChannel >= NUM_ISR_CHANNELS )
+    return 0;
+  return Channels[WhichChannel].Dropped;
+}
+
+/****************************************************************************
+ Function
+   ES_IsrChannelAllEmpty
+ Parameters
+   None
+ Returns
+   bool : true if no channel has an event waiting to be drained
+ Description
+   lets the port check, with interrupts off, that it is safe to sleep
+ Notes
+
+ Author
+   as, 10/17/26, 20:00
+****************************************************************************/
+bool ES_IsrChannelAllEmpty( void ){
+  uint8_t i;
+
+  for ( i = 0; i < NUM_ISR_CHANNELS; i++ ){
+    if ( Channels[i].Head != Channels[i].Tail )
+      return false;
+  }
+  return true;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// returns the oldest entry in the channel without removing it, NULL if empty
+static ChannelEntry_t * PeekChannel( IsrChannel_t * pChannel ){
+  uint8_t Head = pChannel->Head;   // we are the only writer
+
+  if ( Head == pChannel->Tail )
+    return (ChannelEntry_t *)0;
+  // read Tail before the entry data that it published
+  ES_MemoryBarrier();
+  return &pChannel->Entries[Head & CHANNEL_INDEX_MASK];
+}
+
+// gives the slot of the entry returned by PeekChannel back to the ISR
+static void ReleaseEntry( IsrChannel_t * pChannel ){
+  // finish reading the entry before the ISR is allowed to overwrite it
+  ES_MemoryBarrier();
+  pChannel->Head = pChannel->Head + 1;
+}
+
+/***************************************************************************
+ Test Harness: host stress test, a thread stands in for the ISR
+ ***************************************************************************/
+#if defined(TEST) && defined(ES_HOST_PORT)
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define NUM_STRESS_EVENTS 10000000UL
+
+static volatile uint32_t FullRetries;
+
+// the simulated ISR, posting a sequence number in every event as fast as it
+// can, and retrying whenever the channel is full
+static void * SimulatedIsr( void * pUnused ){
+  uint32_t i;
+  ES_Event ThisEvent;
+
+  ThisEvent.EventType = ES_TIMEOUT;
+  for ( i = 0; i < NUM_STRESS_EVENTS; i++ ){
+    ThisEvent.EventParam = (uint16_t)i;
+    while ( ES_IsrChannelPost( 0, 0, ThisEvent ) != true ){
+      FullRetries++;
+      sched_yield();  // let the consumer run if we share a core
+    }
+  }
+  return pUnused;
+}
+
+int main( void ){
+  pthread_t IsrThread;
+  ChannelEntry_t * pEntry;
+  uint32_t Received = 0;
+  uint32_t Errors = 0;
+  struct timespec Start, End;
+  double Seconds;
+
+  puts("ES_IsrChannel SPSC stress test");
+  clock_gettime( CLOCK_MONOTONIC, &Start );
+  pthread_create( &IsrThread, NULL, SimulatedIsr, NULL );
+
+  // we play the part of ES_Run, every event must arrive once and in order
+  while ( Received < NUM_STRESS_EVENTS ){
+    pEntry = PeekChannel( &Channels[0] );
+    if ( pEntry != (ChannelEntry_t *)0 ){
+      if ( (pEntry->Event.EventType != ES_TIMEOUT) ||
+           (pEntry->Event.EventParam != (uint16_t)Received) ||
+           (pEntry->WhichService != 0) )
+        Errors++;
+      ReleaseEntry( &Channels[0] );
+      Received++;
+    }else{
+      sched_yield();
+    }
+  }
+  pthread_join( IsrThread, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &End );
+  Seconds = (End.tv_sec - Start.tv_sec) + (End.tv_nsec - Start.tv_nsec) / 1e9;
+
+  printf("%lu events, %lu errors, %lu full retries, %.0f events/sec\n",
+         (unsigned long)Received, (unsigned long)Errors,
+         (unsigned long)FullRetries, Received / Seconds);
+  return (Errors == 0) ? 0 : 1;
+}
+#endif /* TEST */
+
+#endif /* NUM_ISR_CHANNELS > 0 */
+/*------------------------------ End of file ------------------------------*/
@@ -18,6 +18,10 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/17/26 10:05 as       ES_GetMSBitSet now uses count-leading-zeros where the
+                         compiler provides it, keeping the nybble walk as the
+                         portable fallback. Added ES_GetMSBitSet32 and widened
+                         BitNum2SetMask to 32 entries for a 32 service Ready.
  10/20/13 17:03 jec      converted Byte2MSBitNum array to a Nybble sized array
                          (15 entries) and made function GetMSBitSet() to figure 
                          out the MSB set. This was done to facilitate moving to
@@ -33,12 +37,17 @@
 #include "ES_Types.h"
 #include "ES_General.h"
 #include "ES_Timers.h"
+#include "ES_LookupTables.h"
 #include "bitdefs.h"
 
 /*----------------------------- Module Defines ----------------------------*/
 #define ISOLATE_LS_NYBBLE 0x0F
 
 /*---------------------------- Module Functions ---------------------------*/
+// only needed without CLZ, or by the test harness that checks CLZ against it
+#if !defined(ES_CLZ32) || defined(TEST)
+static uint8_t NybbleWalkMSBitSet( uint16_t Val2Check);
+#endif
 
 /*---------------------------- Module Variables ---------------------------*/
 
@@ -56,12 +65,14 @@ uint16_t const BitNum2ClrMask[] = {
 */
 
 /*
-  this table is used to go from a bit number (0-15) to the mask used to set
+  this table is used to go from a bit number (0-31) to the mask used to set
   that bit in a byte.
 */
-uint16_t const BitNum2SetMask[] = {
+uint32_t const BitNum2SetMask[] = {
   BIT0HI, BIT1HI, BIT2HI, BIT3HI, BIT4HI, BIT5HI, BIT6HI, BIT7HI, BIT8HI, BIT9HI,
-  BIT10HI, BIT11HI, BIT12HI, BIT13HI, BIT14HI, BIT15HI
+  BIT10HI, BIT11HI, BIT12HI, BIT13HI, BIT14HI, BIT15HI, BIT16HI, BIT17HI,
+  BIT18HI, BIT19HI, BIT20HI, BIT21HI, BIT22HI, BIT23HI, BIT24HI, BIT25HI,
+  BIT26HI, BIT27HI, BIT28HI, BIT29HI, BIT30HI, BIT31HI
 };
 
 /*
@@ -77,6 +88,52 @@ uint8_t const Nybble2MSBitNum[15] = {
 
 /*------------------------------ Module Code ------------------------------*/
 uint8_t ES_GetMSBitSet( uint16_t Val2Check) {
+#ifdef ES_CLZ32
+  if ( Val2Check == 0){
+    return 128; // this is the error return value
+  }
+  // the MSB set is 31 less the number of leading zeros in a 32 bit word
+  return (uint8_t)(31 - ES_CLZ32( (uint32_t)Val2Check));
+#else
+  return NybbleWalkMSBitSet( Val2Check);
+#endif
+}
+
+uint8_t ES_GetMSBitSet32( uint32_t Val2Check) {
+#ifdef ES_CLZ32
+  if ( Val2Check == 0){
+    return 128; // this is the error return value
+  }
+  return (uint8_t)(31 - ES_CLZ32( Val2Check));
+#else
+  // without a CLZ, test the upper half first then fall back to the lower half
+  if ( (Val2Check >> 16) != 0){
+    return NybbleWalkMSBitSet( (uint16_t)(Val2Check >> 16)) + 16;
+  }
+  return NybbleWalkMSBitSet( (uint16_t)Val2Check);
+#endif
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+#if !defined(ES_CLZ32) || defined(TEST)
+/****************************************************************************
+ Function
+   NybbleWalkMSBitSet
+ Parameters
+   uint16_t  Val2Check The number to find the MSB in
+ Returns
+   bit number of the MSB that is set in Val2Check, 128 if Val2Check = 0
+ Description
+   the original table driven search, walking Val2Check a nybble at a time
+   from the top. Used when the compiler gives us no CLZ instruction.
+ Notes
+
+ Author
+   J. Edward Carryer, 10/20/13, 17:03
+****************************************************************************/
+static uint8_t NybbleWalkMSBitSet( uint16_t Val2Check) {
 
   int8_t LoopCntr;
   uint8_t Nybble2Test; 
@@ -98,28 +155,60 @@ uint8_t ES_GetMSBitSet( uint16_t Val2Check) {
   }
   return ReturnVal;  
 }
+#endif /* !ES_CLZ32 || TEST */
 
-/***************************************************************************
- private functions
- ***************************************************************************/
 #ifdef TEST
 #include <stdio.h>
 
+// sum of all results, keeps the optimizer from removing the calls under test
+static volatile uint32_t Sink;
+
 void main(void) {
 
-  uint16_t Counter=0;
+  uint32_t Counter;
+  uint32_t Start;
+  uint32_t WalkCycles;
+  uint32_t LookupCycles;
+  uint32_t Sum;
   uint8_t MSBit;
 
   puts("Testing the MSB Look-up function\n\r");
   puts(__TIME__ " " __DATE__);
   puts("\n\r");
-  MSBit = ES_GetMSBitSet( Counter);
-  printf("the MSB set in %u is bit %d\n\r",Counter,MSBit);
+  ES_InitCycleCounter();
+
+  // first prove that the fast search agrees with the nybble walk everywhere
+  for (Counter = 0; Counter <= 0xFFFF; Counter++){
+    MSBit = ES_GetMSBitSet( (uint16_t)Counter);
+    if ( (MSBit != NybbleWalkMSBitSet( (uint16_t)Counter)) ||
+         (MSBit != ES_GetMSBitSet32( Counter)) ){
+      printf("Mismatch for %lu: got bit %d\n\r", (unsigned long)Counter, MSBit);
+    }
+  }
+
+  // then time each across all 65536 Ready values
+  Sum = 0;
+  Start = ES_ReadCycleCounter();
+  for (Counter = 0; Counter <= 0xFFFF; Counter++){
+    Sum += NybbleWalkMSBitSet( (uint16_t)Counter);
+  }
+  WalkCycles = ES_ReadCycleCounter() - Start;
+  Sink = Sum;
 
-  for (Counter = 1; Counter !=0; Counter++){
-    MSBit = ES_GetMSBitSet( Counter);
-    printf("the MSB set in %u is bit %d\n\r",Counter,MSBit);
+  Sum = 0;
+  Start = ES_ReadCycleCounter();
+  for (Counter = 0; Counter <= 0xFFFF; Counter++){
+    Sum += ES_GetMSBitSet( (uint16_t)Counter);
   }
+  LookupCycles = ES_ReadCycleCounter() - Start;
+  Sink = Sum;
+
+  printf("nybble walk    : %lu.%02lu cycles/lookup\n\r",
+         (unsigned long)(WalkCycles >> 16),
+         (unsigned long)(((WalkCycles & 0xFFFF) * 100) >> 16));
+  printf("ES_GetMSBitSet : %lu.%02lu cycles/lookup\n\r",
+         (unsigned long)(LookupCycles >> 16),
+         (unsigned long)(((LookupCycles & 0xFFFF) * 100) >> 16));
 }
 #endif
 /*------------------------------ End of File ------------------------------*/
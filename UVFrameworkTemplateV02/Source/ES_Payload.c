@@ -0,0 +1,239 @@
+//#define TEST
+/****************************************************************************
+ Module
+     ES_Payload.c
+ Description
+     A pool of fixed size, reference counted payload slots so that events
+     can carry more than the 16 bit EventParam (a whole CAN frame, for
+     example) without any copying beyond filling in the slot.
+ Notes
+     The slots are handed out from a free list kept as a stack of slot
+     numbers. Allocation, and every reference count change, is done with
+     interrupts disabled so that ISRs can allocate and post payloads too.
+
+     The framework keeps the counts in step with the queues:
+      - ES_PostToService/ES_PostToServiceLIFO retain for a successful post
+      - ES_Run releases after the service's run function returns
+      - ES_DeferEvent retains, and ES_RecallEvents moves the deferral
+        queue's reference along with the event to the service's queue
+      - ES_IsrChannelDrainAll releases the posting ISR's reference after it
+        has moved the event on to the service's queue
+     So the poster allocates (1 reference), posts to as many services as it
+     likes, then releases its own reference. Posting through ES_PostAll or
+     a distribution list needs nothing extra.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/17/26 13:00 as      started coding
+*****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Port.h"
+#include "ES_Payload.h"
+
+#if ES_PAYLOAD_POOL_SIZE > 0
+/*----------------------------- Module Defines ----------------------------*/
+#if ES_PAYLOAD_POOL_SIZE >= 255
+#error ES_PAYLOAD_POOL_SIZE must be less than 255
+#endif
+
+/*---------------------------- Module Variables ---------------------------*/
+static ES_Payload_t Pool[ES_PAYLOAD_POOL_SIZE];
+static uint8_t RefCount[ES_PAYLOAD_POOL_SIZE];
+static ES_PayloadHandle_t FreeList[ES_PAYLOAD_POOL_SIZE];
+static uint8_t NumFree;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+   ES_PayloadInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   puts every slot back in the free list, called from ES_Initialize
+ Notes
+
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+void ES_PayloadInit( void ){
+  uint8_t i;
+
+  for ( i = 0; i < ES_PAYLOAD_POOL_SIZE; i++ ){
+    RefCount[i] = 0;
+    FreeList[i] = i;
+  }
+  NumFree = ES_PAYLOAD_POOL_SIZE;
+}
+
+/****************************************************************************
+ Function
+   ES_PayloadAlloc
+ Parameters
+   None
+ Returns
+   ES_PayloadHandle_t : handle of a free slot, ES_PAYLOAD_NONE if none left
+ Description
+   takes a slot from the pool with one reference, owned by the caller.
+ Notes
+   safe to call from an ISR
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+ES_PayloadHandle_t ES_PayloadAlloc( void ){
+  ES_PayloadHandle_t Handle = ES_PAYLOAD_NONE;
+
+  EnterCritical();
+  if ( NumFree > 0 ){
+    Handle = FreeList[--NumFree];
+    RefCount[Handle] = 1;
+  }
+  ExitCritical();
+  return Handle;
+}
+
+/****************************************************************************
+ Function
+   ES_PayloadGet
+ Parameters
+   ES_PayloadHandle_t Handle : handle returned by ES_PayloadAlloc
+ Returns
+   ES_Payload_t * : the slot, NULL for a bad handle
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+ES_Payload_t * ES_PayloadGet( ES_PayloadHandle_t Handle ){
+  if ( Handle >= ES_PAYLOAD_POOL_SIZE )
+    return (ES_Payload_t *)0;
+  return &Pool[Handle];
+}
+
+/****************************************************************************
+ Function
+   ES_PayloadRetain
+ Parameters
+   ES_PayloadHandle_t Handle : handle of an allocated slot
+ Returns
+   None
+ Description
+   adds a reference to the slot
+ Notes
+   safe to call from an ISR
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+void ES_PayloadRetain( ES_PayloadHandle_t Handle ){
+  if ( Handle >= ES_PAYLOAD_POOL_SIZE )
+    return;
+  EnterCritical();
+  RefCount[Handle]++;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+   ES_PayloadRelease
+ Parameters
+   ES_PayloadHandle_t Handle : handle of an allocated slot
+ Returns
+   None
+ Description
+   drops a reference, returning the slot to the pool when none are left
+ Notes
+   safe to call from an ISR. Releasing a slot that is already free is
+   ignored rather than corrupting the free list.
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+void ES_PayloadRelease( ES_PayloadHandle_t Handle ){
+  if ( Handle >= ES_PAYLOAD_POOL_SIZE )
+    return;
+  EnterCritical();
+  if ( RefCount[Handle] > 0 ){
+    if ( --RefCount[Handle] == 0 )
+      FreeList[NumFree++] = Handle;
+  }
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+   ES_PayloadGetFreeCount
+ Parameters
+   None
+ Returns
+   uint8_t : number of slots currently in the free list
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/17/26, 13:00
+****************************************************************************/
+uint8_t ES_PayloadGetFreeCount( void ){
+  return NumFree;
+}
+
+/***************************************************************************
+ Test Harness
+ ***************************************************************************/
+#ifdef TEST
+#include <stdio.h>
+
+static uint16_t Failures;
+
+static void Check( bool Condition, const char * pWhat ){
+  if ( Condition != true ){
+    printf("FAILED: %s\r\n", pWhat);
+    Failures++;
+  }
+}
+
+int main( void ){
+  ES_PayloadHandle_t Handles[ES_PAYLOAD_POOL_SIZE];
+  ES_PayloadHandle_t Handle;
+  uint8_t i;
+
+  puts("ES_Payload test harness\r");
+  ES_PayloadInit();
+
+  // drain the pool, every handle must be distinct and valid
+  for ( i = 0; i < ES_PAYLOAD_POOL_SIZE; i++ ){
+    Handles[i] = ES_PayloadAlloc();
+    Check( ES_PayloadGet(Handles[i]) != (ES_Payload_t *)0, "alloc valid" );
+    ES_PayloadGet(Handles[i])->Tag = i;
+  }
+  Check( ES_PayloadAlloc() == ES_PAYLOAD_NONE, "empty pool refused" );
+  for ( i = 0; i < ES_PAYLOAD_POOL_SIZE; i++ )
+    Check( ES_PayloadGet(Handles[i])->Tag == i, "slots distinct" );
+
+  // three holders of one slot: it only comes back with the last release
+  ES_PayloadRetain(Handles[0]);
+  ES_PayloadRetain(Handles[0]);
+  ES_PayloadRelease(Handles[0]);
+  ES_PayloadRelease(Handles[0]);
+  Check( ES_PayloadGetFreeCount() == 0, "slot held while referenced" );
+  ES_PayloadRelease(Handles[0]);
+  Check( ES_PayloadGetFreeCount() == 1, "slot freed by last release" );
+  ES_PayloadRelease(Handles[0]);
+  Check( ES_PayloadGetFreeCount() == 1, "double release ignored" );
+  Handle = ES_PayloadAlloc();
+  Check( Handle == Handles[0], "freed slot re-used" );
+
+  for ( i = 0; i < ES_PAYLOAD_POOL_SIZE; i++ )
+    ES_PayloadRelease(Handles[i]);
+  Check( ES_PayloadGetFreeCount() == ES_PAYLOAD_POOL_SIZE, "all returned" );
+
+  printf("%u failures\r\n", Failures);
+  return (Failures == 0) ? 0 : 1;
+}
+#endif /* TEST */
+
+#endif /* ES_PAYLOAD_POOL_SIZE > 0 */
+/*------------------------------ End of file ------------------------------*/
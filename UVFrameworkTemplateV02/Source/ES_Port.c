@@ -20,7 +20,18 @@
  03/05/14 13:20	joa		Began port for TM4C123G
  03/13/14 10:30	joa		Updated files to use with Cortex M4 processor core.
  	 	 	 	 	 	Specifically, this was tested on a TI TM4C123G mcu.
+ 10/17/26 09:10 as      excluded from host builds, see ES_Port_Host.c
+ 10/17/26 20:00 as      added _HW_Idle, which stretches the SysTick period to
+                        sleep until the next timer expiry when
+                        ES_TICKLESS_IDLE is set
+ 10/17/26 21:00 as      SysTickCounter is 32 bits, with a count of its wraps
+                        for _HW_GetTickCount64
+ 10/18/26 13:00 as      _HW_Idle wakes for the next polled event checker and
+                        stays awake for a signalled one
 ****************************************************************************/
+// the host (PC) build supplies these routines from ES_Port_Host.c instead
+#ifndef ES_HOST_PORT
+
 #include <stdint.h>
 #include <stdbool.h>
 #include "inc/hw_memmap.h"
@@ -30,10 +41,17 @@
 #include "driverlib/pin_map.h"	// Define PART_TM4C123GH6PM in project
 #include "driverlib/systick.h"
 #include "driverlib/gpio.h"
+#include "driverlib/cpu.h"
+#include "inc/hw_types.h"
+#include "inc/hw_nvic.h"
 #include "utils/uartstdio.h"
+#include "ES_Configure.h"
 #include "ES_Port.h"
 #include "ES_Types.h"
 #include "ES_Timers.h"
+#include "ES_LookupTables.h"
+#include "ES_IsrChannel.h"
+#include "ES_CheckEvents.h"
 
 #define UART_PORT 		0
 #define UART_BAUD		115200UL
@@ -47,12 +65,26 @@
 // need to post events from the interrupt response routine. This is necessary
 // for compilers like HTC for the midrange PICs which do not produce re-entrant
 // code so cannot post directly to the queues from within the interrupt resp.
-static volatile uint8_t TickCount;
+// After a tickless sleep it holds all of the ticks slept through, so it is
+// 16 bits wide.
+static volatile uint16_t TickCount;
 
 // Global tick count to monitor number of SysTick Interrupts
-// make uint16_t to maintain backwards compatibility and not overly burden
-// 8 and 16 bit processors
-static volatile uint16_t SysTickCounter = 0;
+// 32 bits is no burden on the M4, and ES_Timer_GetTime takes as many of them
+// as ES_TIMER_BITS asks for. SysTickWraps extends it to 64 bits.
+static volatile uint32_t SysTickCounter = 0;
+static volatile uint32_t SysTickWraps = 0;
+
+#if ES_TICKLESS_IDLE
+// the framework's record of which queues have events in them
+extern ES_ReadyMask_t Ready;
+
+// STRELOAD is 24 bits, which limits how many ticks one sleep can cover
+#define MAX_RELOAD 0x00FFFFFFUL
+
+// SysTick counts in one tick, set by _HW_Timer_Init
+static uint32_t CountsPerTick;
+#endif
 
 /****************************************************************************
  Function
@@ -73,6 +105,9 @@ static volatile uint16_t SysTickCounter = 0;
 ****************************************************************************/
 void _HW_Timer_Init(TimerRate_t Rate)
 {
+#if ES_TICKLESS_IDLE
+	CountsPerTick = (uint32_t)Rate + 1;
+#endif
 	SysTickPeriodSet(Rate);			/* Set the SysTick Interrupt Rate */
 	SysTickIntEnable();				/* Enable the SysTick Interrupt */
 	SysTickEnable();				/* Enable SysTick */
@@ -101,7 +136,8 @@ void SysTickIntHandler(void)
 {
 	/* Interrupt automatically cleared by hardware */
   ++TickCount;          /* flag that it occurred and needs a response */
-	++SysTickCounter;     // keep the free running time going
+	if (++SysTickCounter == 0)     // keep the free running time going
+		++SysTickWraps;
 #ifdef LED_DEBUG
 	BlinkLED();
 #endif
@@ -113,7 +149,7 @@ void SysTickIntHandler(void)
  Parameters
     none
  Returns
-    uint16_t   count of number of system ticks that have occurred.
+    uint32_t   count of number of system ticks that have occurred.
  Description
     wrapper for access to SysTickCounter, needed to move increment of tick
     counter to this module to keep the timer ticking during blocking code
@@ -122,11 +158,38 @@ void SysTickIntHandler(void)
  Author
     Ed Carryer, 10/27/14 13:55
 ****************************************************************************/
-uint16_t _HW_GetTickCount(void)
+uint32_t _HW_GetTickCount(void)
 {
    return (SysTickCounter);
 }
 
+/****************************************************************************
+ Function
+    _HW_GetTickCount64()
+ Parameters
+    none
+ Returns
+    uint64_t   count of number of system ticks that have occurred.
+ Description
+    SysTickCounter extended by the count of its wraps
+ Notes
+    Reads the wrap count either side of the counter and tries again if a
+    tick wrapped it in between, so interrupts can stay on.
+ Author
+    as, 10/17/26 21:00
+****************************************************************************/
+uint64_t _HW_GetTickCount64(void)
+{
+   uint32_t Wraps;
+   uint32_t Ticks;
+
+   do {
+      Wraps = SysTickWraps;
+      Ticks = SysTickCounter;
+   } while (Wraps != SysTickWraps);
+   return (((uint64_t)Wraps << 32) | Ticks);
+}
+
 /****************************************************************************
  Function
      _HW_Process_Pending_Ints
@@ -150,15 +213,127 @@ uint16_t _HW_GetTickCount(void)
 ****************************************************************************/
 bool _HW_Process_Pending_Ints( void )
 {
+#if ES_TICKLESS_IDLE
+   uint16_t NumTicks;
+
+   if (TickCount > 0)
+   {
+      EnterCritical();
+      NumTicks = TickCount;
+      TickCount = 0;
+      ExitCritical();
+      /* the framework tick response, for every tick we slept through */
+      ES_Timer_MultiTick_Resp(NumTicks);
+   }
+#else
    while (TickCount > 0)
    {
       /* call the framework tick response to actually run the timers */
       ES_Timer_Tick_Resp();  
       TickCount--;
    }
+#endif
    return true; // always return true to allow loop test in ES_Run to proceed
 }
 
+#if ES_TICKLESS_IDLE
+/****************************************************************************
+ Function
+     _HW_Idle
+ Parameters
+     none
+ Returns
+     none.
+ Description
+     called by ES_Run when there is nothing to do. Sleeps the core until
+     the next interrupt, stretching the SysTick period so that the next
+     tick interrupt comes when the next timer expires or the next polled
+     event checker is due.
+ Notes
+     Interrupts are disabled from the last check for work through to the
+     WFI, a pending interrupt still ends the WFI. If another interrupt ends
+     the sleep early, the SysTick count tells us how many ticks went by.
+     Either way SysTickCounter and TickCount are brought up to date so that
+     ES_Timer_GetTime and the timers carry on as if every tick had come.
+     This follows the tickless idle scheme in the FreeRTOS Cortex-M ports.
+ Author
+     as, 10/17/26 20:00
+****************************************************************************/
+void _HW_Idle(void)
+{
+	uint32_t SleepTicks;
+	uint32_t Reload;
+	uint32_t Counted;
+	uint32_t CompleteTicks;
+	uint32_t Ctrl;
+	uint32_t PollTicks;
+
+	SleepTicks = ES_Timer_GetTicksToNextExpiry();
+	PollTicks = ES_GetTicksToNextPoll();
+	if (PollTicks < SleepTicks)
+		SleepTicks = PollTicks;
+	if (SleepTicks > (MAX_RELOAD / CountsPerTick))
+		SleepTicks = MAX_RELOAD / CountsPerTick;
+
+	IntMasterDisable();
+	// anything that came in since ES_Run last looked means no sleep
+	if ((TickCount != 0) || ES_IsAnyReady(Ready) || ES_IsAnyCheckerSignalled()
+#if NUM_ISR_CHANNELS > 0
+	    || (ES_IsrChannelAllEmpty() != true)
+#endif
+	   )
+	{
+		IntMasterEnable();
+		return;
+	}
+	if (SleepTicks <= 1)
+	{
+		// the next tick is due anyway, so just wait for it
+		CPUwfi();
+		IntMasterEnable();
+		return;
+	}
+
+	// stretch the tick in progress to cover the whole sleep
+	HWREG(NVIC_ST_CTRL) &= ~NVIC_ST_CTRL_ENABLE;
+	Reload = HWREG(NVIC_ST_CURRENT) + (CountsPerTick * (SleepTicks - 1));
+	HWREG(NVIC_ST_RELOAD) = Reload;
+	HWREG(NVIC_ST_CURRENT) = 0;
+	HWREG(NVIC_ST_CTRL) |= NVIC_ST_CTRL_ENABLE;
+
+	CPUwfi();
+
+	// stop the count, reading CTRL also clears the count flag
+	Ctrl = HWREG(NVIC_ST_CTRL);
+	HWREG(NVIC_ST_CTRL) = Ctrl & ~NVIC_ST_CTRL_ENABLE;
+	if ((Ctrl & NVIC_ST_CTRL_COUNT) != 0)
+	{
+		// slept the whole way, the pending tick interrupt counts the last
+		// tick, and the rest of the new tick is already under way
+		HWREG(NVIC_ST_RELOAD) = (CountsPerTick - 1) -
+		                        (Reload - HWREG(NVIC_ST_CURRENT));
+		CompleteTicks = SleepTicks - 1;
+	}else
+	{
+		// woken early, count the whole ticks since the sleep began and
+		// finish off the tick that is part way through
+		Counted = (SleepTicks * CountsPerTick) - HWREG(NVIC_ST_CURRENT);
+		CompleteTicks = Counted / CountsPerTick;
+		HWREG(NVIC_ST_RELOAD) = ((CompleteTicks + 1) * CountsPerTick) - Counted;
+	}
+	HWREG(NVIC_ST_CURRENT) = 0;
+	HWREG(NVIC_ST_CTRL) |= NVIC_ST_CTRL_ENABLE;
+	// from the next reload on, back to one tick per period
+	HWREG(NVIC_ST_RELOAD) = CountsPerTick - 1;
+
+	TickCount += CompleteTicks;
+	SysTickCounter += CompleteTicks;
+	if (SysTickCounter < CompleteTicks)
+		++SysTickWraps;
+	IntMasterEnable();
+}
+#endif /* ES_TICKLESS_IDLE */
+
 /****************************************************************************
  Function
      ConsoleInit
@@ -273,3 +448,5 @@ inline void CPUsetFAULTMASK(uint32_t newFAULTMASK)
   }
 }
 #endif
+
+#endif /* ES_HOST_PORT */
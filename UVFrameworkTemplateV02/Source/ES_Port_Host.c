@@ -0,0 +1,798 @@
+//#define TEST
+/****************************************************************************
+ Module
+   ES_Port_Host.c
+
+ Revision
+   1.0.1
+
+ Description
+   This is the host (PC, x86 Linux) port of the Events & Services Framework.
+   It provides the same hardware specific routines as ES_Port.c so that the
+   framework and the services listed in ES_Configure.h can be run, measured
+   and regression tested without a LaunchPad on the bench.
+
+ Notes
+   Selected by defining ES_HOST_PORT on the compiler command line, in which
+   case ES_Port.c compiles to nothing and this file is built in its place.
+
+   Time in this port is virtual. The simulated tick interrupt is raised by
+   the port itself every time ES_Run finds all of the queues empty, since
+   nothing can happen before the next tick anyway. Simulated time therefore
+   runs as fast as the host can dispatch events and every run is exactly
+   repeatable. Dispatch times are measured with the host monotonic clock.
+   With ES_TICKLESS_IDLE set, _HW_Idle moves virtual time straight on to
+   the next timer expiry instead, as the target sleeps until then.
+
+   A simulated peripheral interrupt can be set up with ES_Host_SetIntHook.
+   It is raised on a host time period, and taken the next time that the
+   framework unmasks interrupts, as a real one would be. The time from then
+   until ES_Run picks the service it posted to is the interrupt latency.
+
+   Services that touch TivaWare peripherals need host stubs for those calls.
+
+   Un-commenting the #define TEST at the top of this file produces the
+   throughput benchmark, e.g.:
+     gcc -std=gnu99 -O2 -DES_HOST_PORT -IHeaders -I"TIVA Code"
+         Source/ES_Port_Host.c Source/ES_Framework.c Source/ES_Queue.c
+         Source/ES_Timers.c Source/ES_LookupTables.c Source/ES_CheckEvents.c
+         Source/ES_PostList.c (plus the service & event checker sources)
+
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/18/26 13:00 as      _HW_Idle wakes for the next polled event checker
+ 10/18/26 09:00 as      the benchmark prints the latency monitor results
+ 10/17/26 21:00 as      SysTickCounter is 32 bits, added _HW_GetTickCount64
+ 10/17/26 20:00 as      added _HW_Idle for the tickless idle mode, and a
+                        count of the idle wakeups
+ 10/17/26 18:00 as      added a simulated peripheral interrupt, the benchmark
+                        now counts events and measures interrupt latency
+ 10/17/26 15:00 as      benchmark prints the service profiles when enabled
+ 10/17/26 14:00 as      test Ready through ES_IsAnyReady
+ 10/17/26 09:10 as      first pass, based on ES_Port.c
+****************************************************************************/
+#ifdef ES_HOST_PORT
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <time.h>
+#include <x86intrin.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+#include "ES_Types.h"
+#include "ES_Timers.h"
+#include "ES_General.h"
+#include "ES_LookupTables.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define NO_SERVICE    0xFF
+#define NS_PER_SEC    1000000000ULL
+
+/*--------------------------- External Variables --------------------------*/
+// the framework's record of which queues have events in them
+extern ES_ReadyMask_t Ready;
+
+/*---------------------------- Module Functions ---------------------------*/
+static void SysTickIntHandler(void);
+static uint64_t HostNow(void);
+static void RaiseIntIfDue(void);
+
+/*---------------------------- Module Variables ---------------------------*/
+// same roles as in ES_Port.c
+static volatile uint16_t TickCount;
+static volatile uint32_t SysTickCounter = 0;
+static volatile uint32_t SysTickWraps = 0;
+
+// the simulated tick source
+static TimerRate_t TickRate = ES_Timer_RATE_OFF;
+static uint32_t VirtualTime;       // ticks raised since _HW_Timer_Init
+static uint32_t IntsMasked;        // simulated PRIMASK
+static uint8_t PendingTicks;       // ticks raised while masked
+static ES_HostTickHook_t *pTickHook;
+static uint32_t Wakeups;           // times the idle framework was woken
+
+// used by ES_Host_RunFor to get back out of ES_Run
+static jmp_buf RunForExit;
+static bool RunForActive;
+static uint32_t RunForStopTime;
+
+// dispatch measurement, see _HW_Process_Pending_Ints
+static ES_HostDispatchStats_t DispatchStats[MAX_NUM_SERVICES];
+static uint8_t LastDispatched = NO_SERVICE;
+static uint64_t LastStamp;
+
+// the simulated peripheral interrupt, see ES_Host_SetIntHook
+static ES_HostIntHook_t *pIntHook;
+static uint64_t IntPeriodCycles;   // in time stamp counts, cheaper to read
+static uint64_t LastIntTime;
+static uint8_t IntWaiting = NO_SERVICE;  // service posted to, not yet run
+static uint64_t IntRaisedAt;
+static ES_HostLatencyStats_t IntLatency;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+     _HW_Timer_Init
+ Parameters
+     TimerRate_t Rate, one of the ES_Timer_RATE_XX values
+ Returns
+     None.
+ Description
+     Starts the simulated tick source. The rate is recorded only so that
+     ES_Timer_RATE_OFF can stop the ticks, all other rates tick identically
+     in virtual time.
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+void _HW_Timer_Init(TimerRate_t Rate)
+{
+  TickRate = Rate;
+  TickCount = 0;
+  SysTickCounter = 0;
+  SysTickWraps = 0;
+  VirtualTime = 0;
+  PendingTicks = 0;
+  IntsMasked = 0;
+  Wakeups = 0;
+}
+
+/****************************************************************************
+ Function
+     _HW_Host_Tick
+ Parameters
+     None.
+ Returns
+     None.
+ Description
+     Raises the simulated tick interrupt. If the simulated interrupts are
+     masked, the tick is held pending until _HW_Host_RestoreInts unmasks them.
+ Notes
+     Called by the port whenever the framework goes idle, but may also be
+     called by a test harness to inject ticks at specific points.
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+void _HW_Host_Tick(void)
+{
+  if (IntsMasked != 0)
+  {
+    ++PendingTicks;
+  }else
+  {
+    SysTickIntHandler();
+  }
+}
+
+/****************************************************************************
+ Function
+     _HW_Host_MaskInts / _HW_Host_RestoreInts
+ Parameters
+     uint32_t OldMask (restore only) the value returned by _HW_Host_MaskInts
+ Returns
+     _HW_Host_MaskInts returns the mask state prior to the call
+ Description
+     host equivalents of CPUgetPRIMASK_cpsid & CPUsetPRIMASK, used by the
+     EnterCritical & ExitCritical macros in ES_Port.h
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+uint32_t _HW_Host_MaskInts(void)
+{
+  uint32_t OldMask = IntsMasked;
+  IntsMasked = 1;
+  return OldMask;
+}
+
+void _HW_Host_RestoreInts(uint32_t OldMask)
+{
+  IntsMasked = OldMask;
+  // take any ticks that arrived while we were masked
+  while ((IntsMasked == 0) && (PendingTicks > 0))
+  {
+    PendingTicks--;
+    SysTickIntHandler();
+  }
+  if ((IntsMasked == 0) && (pIntHook != (ES_HostIntHook_t *)0))
+  {
+    RaiseIntIfDue();
+  }
+}
+
+/****************************************************************************
+ Function
+    _HW_GetTickCount()
+ Parameters
+    none
+ Returns
+    uint32_t   count of number of system ticks that have occurred.
+ Description
+    wrapper for access to SysTickCounter
+ Notes
+
+ Author
+    as, 10/17/26 09:10
+****************************************************************************/
+uint32_t _HW_GetTickCount(void)
+{
+   return (SysTickCounter);
+}
+
+/****************************************************************************
+ Function
+    _HW_GetTickCount64()
+ Parameters
+    none
+ Returns
+    uint64_t   count of number of system ticks that have occurred.
+ Description
+    SysTickCounter extended by the count of its wraps
+ Notes
+    The simulated tick cannot come in between the two reads.
+ Author
+    as, 10/17/26 21:00
+****************************************************************************/
+uint64_t _HW_GetTickCount64(void)
+{
+   return (((uint64_t)SysTickWraps << 32) | SysTickCounter);
+}
+
+/****************************************************************************
+ Function
+     _HW_Process_Pending_Ints
+ Parameters
+     none
+ Returns
+     always true.
+ Description
+     Advances virtual time if the framework is idle, then runs the framework
+     tick response for any ticks that have occurred, as on the target.
+ Notes
+     ES_Run calls this once before every dispatch, so the time between two
+     calls with Ready != 0 is the time taken to dispatch one event to the
+     highest priority service found on the earlier call. That is how the
+     per-service dispatch statistics are gathered without touching
+     ES_Framework.c.
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+bool _HW_Process_Pending_Ints( void )
+{
+  uint64_t Now = HostNow();
+
+  // close out the dispatch that ran since the last call
+  if (LastDispatched != NO_SERVICE)
+  {
+    uint64_t Elapsed = Now - LastStamp;
+    DispatchStats[LastDispatched].NumDispatches++;
+    DispatchStats[LastDispatched].TotalNs += Elapsed;
+    if (Elapsed > DispatchStats[LastDispatched].MaxNs)
+    {
+      DispatchStats[LastDispatched].MaxNs = (uint32_t)Elapsed;
+    }
+  }
+
+#if ES_TICKLESS_IDLE
+  // time only moves on in _HW_Idle
+  if (TickCount > 0)
+  {
+    uint16_t NumTicks = TickCount;
+    TickCount = 0;
+    ES_Timer_MultiTick_Resp(NumTicks);
+  }
+#else
+  // all the queues are empty, so nothing can happen until the next tick.
+  // Rather than spin, move virtual time straight to it.
+  if ((!ES_IsAnyReady(Ready)) && (TickRate != ES_Timer_RATE_OFF))
+  {
+    if ((RunForActive == true) && (VirtualTime == RunForStopTime))
+    {
+      longjmp(RunForExit, 1);
+    }
+    Wakeups++;
+    _HW_Host_Tick();
+    if (pTickHook != (ES_HostTickHook_t *)0)
+    {
+      pTickHook();
+    }
+  }
+
+  while (TickCount > 0)
+  {
+    /* call the framework tick response to actually run the timers */
+    ES_Timer_Tick_Resp();
+    TickCount--;
+  }
+#endif
+
+  // note which service ES_Run is about to dispatch to, and when
+  if (ES_IsAnyReady(Ready))
+  {
+    LastDispatched = ES_GetReadyPrior(Ready);
+    LastStamp = HostNow();
+    // which ends the wait for a simulated interrupt's service
+    if (LastDispatched == IntWaiting)
+    {
+      uint64_t Latency = LastStamp - IntRaisedAt;
+      IntLatency.NumInts++;
+      IntLatency.TotalNs += Latency;
+      if (Latency > IntLatency.MaxNs)
+      {
+        IntLatency.MaxNs = (uint32_t)Latency;
+      }
+      IntWaiting = NO_SERVICE;
+    }
+  }else
+  {
+    LastDispatched = NO_SERVICE;
+  }
+  return true; // always return true to allow loop test in ES_Run to proceed
+}
+
+#if ES_TICKLESS_IDLE
+/****************************************************************************
+ Function
+     _HW_Idle
+ Parameters
+     none
+ Returns
+     none.
+ Description
+     the host version of the tickless sleep: moves virtual time straight on
+     to the next timer expiry or polled event checker, or the longest sleep that the target's 24 bit
+     SysTick reload allows, and counts one wakeup.
+ Notes
+     A tick hook is a source of interrupts on every tick, so with one set
+     we only ever sleep for a tick at a time.
+ Author
+     as, 10/17/26 20:00
+****************************************************************************/
+void _HW_Idle(void)
+{
+  uint32_t SleepTicks;
+  uint32_t PollTicks;
+
+  if ((TickRate == ES_Timer_RATE_OFF) || ES_IsAnyReady(Ready) ||
+      ES_IsAnyCheckerSignalled())
+  {
+    return;
+  }
+  if ((RunForActive == true) && (VirtualTime == RunForStopTime))
+  {
+    longjmp(RunForExit, 1);
+  }
+  SleepTicks = ES_Timer_GetTicksToNextExpiry();
+  PollTicks = ES_GetTicksToNextPoll();
+  if (PollTicks < SleepTicks)
+  {
+    SleepTicks = PollTicks;
+  }
+  if (SleepTicks > (0x00FFFFFFUL / ((uint32_t)TickRate + 1)))
+  {
+    SleepTicks = 0x00FFFFFFUL / ((uint32_t)TickRate + 1);
+  }
+  if ((RunForActive == true) && (SleepTicks > (RunForStopTime - VirtualTime)))
+  {
+    SleepTicks = RunForStopTime - VirtualTime;
+  }
+  if ((pTickHook != (ES_HostTickHook_t *)0) || (SleepTicks == 0))
+  {
+    SleepTicks = 1;
+  }
+  Wakeups++;
+  // the ticks that the target would count up after its sleep
+  VirtualTime += SleepTicks - 1;
+  SysTickCounter += SleepTicks - 1;
+  if (SysTickCounter < (SleepTicks - 1))
+  {
+    ++SysTickWraps;
+  }
+  TickCount += SleepTicks - 1;
+  // and the one that wakes it
+  _HW_Host_Tick();
+  if (pTickHook != (ES_HostTickHook_t *)0)
+  {
+    pTickHook();
+  }
+}
+#endif /* ES_TICKLESS_IDLE */
+
+/****************************************************************************
+ Function
+     ES_Host_GetWakeups
+ Parameters
+     None.
+ Returns
+     uint32_t number of times the idle framework has been woken
+ Description
+     with ES_TICKLESS_IDLE this counts the sleeps, otherwise every tick
+     that found the framework idle
+ Notes
+
+ Author
+     as, 10/17/26 20:00
+****************************************************************************/
+uint32_t ES_Host_GetWakeups(void)
+{
+  return Wakeups;
+}
+
+/****************************************************************************
+ Function
+     _HW_Host_ReadCycles
+ Parameters
+     None.
+ Returns
+     uint32_t low 32 bits of the host time stamp counter
+ Description
+     host stand in for the DWT cycle counter, see ES_ReadCycleCounter
+ Notes
+
+ Author
+     as, 10/17/26 11:00
+****************************************************************************/
+uint32_t _HW_Host_ReadCycles(void)
+{
+  return (uint32_t)__rdtsc();
+}
+
+/****************************************************************************
+ Function
+     ES_Host_GetVirtualTime
+ Parameters
+     None.
+ Returns
+     uint32_t number of simulated ticks since _HW_Timer_Init
+ Description
+     a wider view of the same time base as _HW_GetTickCount
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+uint32_t ES_Host_GetVirtualTime(void)
+{
+  return VirtualTime;
+}
+
+/****************************************************************************
+ Function
+     ES_Host_SetTickHook
+ Parameters
+     ES_HostTickHook_t * pNewHook, function to call after each simulated tick
+                                   or NULL to remove the hook
+ Returns
+     None.
+ Description
+     lets a test harness act as the simulated hardware, posting events to
+     the services once per tick
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+void ES_Host_SetTickHook(ES_HostTickHook_t *pNewHook)
+{
+  pTickHook = pNewHook;
+}
+
+/****************************************************************************
+ Function
+     ES_Host_RunFor
+ Parameters
+     uint32_t NumTicks, how many ticks of virtual time to run the framework
+ Returns
+     int, one of the ES_Return_t values: Success if the time ran out,
+     otherwise whatever failure ES_Run returned
+ Description
+     runs ES_Run until NumTicks of virtual time have passed
+ Notes
+     ES_Run only returns on an error, so we leave it through longjmp from
+     _HW_Process_Pending_Ints. That happens only while the framework is idle,
+     so no service is ever interrupted part way through a RunFunc.
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+int ES_Host_RunFor(uint32_t NumTicks)
+{
+  int ReturnVal;
+
+  RunForStopTime = VirtualTime + NumTicks;
+  RunForActive = true;
+  if (setjmp(RunForExit) == 0)
+  {
+    ReturnVal = ES_Run();
+  }else
+  {
+    ReturnVal = Success;
+  }
+  RunForActive = false;
+  LastDispatched = NO_SERVICE;
+  return ReturnVal;
+}
+
+/****************************************************************************
+ Function
+     ES_Host_GetDispatchStats
+ Parameters
+     uint8_t WhichService, the service number (index into ServDescList)
+     ES_HostDispatchStats_t * pStats, where to copy the statistics
+ Returns
+     bool, false if WhichService does not exist
+ Description
+     returns the dispatch count and timing gathered for one service
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+****************************************************************************/
+bool ES_Host_GetDispatchStats(uint8_t WhichService,
+                              ES_HostDispatchStats_t *pStats)
+{
+  if (WhichService >= NUM_SERVICES)
+  {
+    return false;
+  }
+  *pStats = DispatchStats[WhichService];
+  return true;
+}
+
+/****************************************************************************
+ Function
+     ES_Host_SetIntHook
+ Parameters
+     ES_HostIntHook_t * pNewHook, the simulated interrupt response routine,
+                                  or NULL to remove it
+     uint32_t PeriodNs, host nanoseconds between interrupts
+ Returns
+     None.
+ Description
+     sets up a simulated peripheral interrupt. The hook posts its event and
+     returns the number of the service it posted to (or 0xFF for none), so
+     that the port can time how long that service waits to be dispatched.
+ Notes
+     The hook runs with the simulated interrupts masked, as on the target.
+ Author
+     as, 10/17/26 18:00
+****************************************************************************/
+void ES_Host_SetIntHook(ES_HostIntHook_t *pNewHook, uint32_t PeriodNs)
+{
+  uint64_t StartNs = HostNow();
+  uint64_t StartCycles = __rdtsc();
+
+  // find the time stamp counter rate over a millisecond
+  while ((HostNow() - StartNs) < 1000000ULL)
+    ;
+  IntPeriodCycles = (__rdtsc() - StartCycles) * PeriodNs / 1000000ULL;
+  pIntHook = pNewHook;
+  LastIntTime = __rdtsc();
+  IntWaiting = NO_SERVICE;
+  IntLatency.NumInts = 0;
+  IntLatency.TotalNs = 0;
+  IntLatency.MaxNs = 0;
+}
+
+/****************************************************************************
+ Function
+     ES_Host_GetIntLatency
+ Parameters
+     ES_HostLatencyStats_t * pStats, where to copy the statistics
+ Returns
+     None.
+ Description
+     returns the latency statistics for the simulated interrupt
+ Notes
+
+ Author
+     as, 10/17/26 18:00
+****************************************************************************/
+void ES_Host_GetIntLatency(ES_HostLatencyStats_t *pStats)
+{
+  *pStats = IntLatency;
+}
+
+/****************************************************************************
+ Function
+     ConsoleInit
+ Parameters
+     none
+ Returns
+     none.
+ Description
+     nothing to do on the host, stdio is already the console
+ Notes
+
+ Author
+     as, 10/17/26 09:10
+ ****************************************************************************/
+void ConsoleInit(void)
+{
+}
+
+/****************************************************************************
+ Function
+     kbhit
+ Parameters
+     none
+ Returns
+     int, always 0
+ Description
+     stands in for the termio.c version so IsNewKeyReady() links on the host
+ Notes
+     keystrokes are not simulated, a test harness posts ES_NEW_KEY directly
+ Author
+     as, 10/17/26 09:10
+ ****************************************************************************/
+int kbhit(void)
+{
+  return 0;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static void SysTickIntHandler(void)
+{
+  ++TickCount;          /* flag that it occurred and needs a response */
+  if (++SysTickCounter == 0)     // keep the free running time going
+  {
+    ++SysTickWraps;
+  }
+  ++VirtualTime;
+}
+
+// called as the simulated interrupts are unmasked
+static void RaiseIntIfDue(void)
+{
+  uint64_t Now = __rdtsc();
+  uint8_t PostedTo;
+
+  if ((Now - LastIntTime) < IntPeriodCycles)
+  {
+    return;
+  }
+  LastIntTime = Now;
+  Now = HostNow();
+  IntsMasked = 1;             // as in any interrupt response routine
+  PostedTo = pIntHook();
+  IntsMasked = 0;
+  // time from the oldest post not yet seen through to its dispatch
+  if ((PostedTo != NO_SERVICE) && (IntWaiting == NO_SERVICE))
+  {
+    IntWaiting = PostedTo;
+    IntRaisedAt = Now;
+  }
+}
+
+static uint64_t HostNow(void)
+{
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return ((uint64_t)Now.tv_sec * NS_PER_SEC) + (uint64_t)Now.tv_nsec;
+}
+
+/***************************************************************************
+ Test Harness: throughput & latency benchmark for the service table in
+ ES_Configure.h
+ ***************************************************************************/
+#ifdef TEST
+
+// length of the run, in virtual ticks
+#define BENCH_TICKS 100000UL
+
+// host time between simulated interrupts
+#define BENCH_INT_PERIOD_NS 10000UL
+
+// the simulated interrupt posts to the highest priority service, the load
+// goes to all of the others (to service 0 as well if it is the only one)
+#define INT_SERVICE (NUM_SERVICES - 1)
+#define NUM_LOADED ((NUM_SERVICES > 1) ? (NUM_SERVICES - 1) : 1)
+
+static uint64_t EventsPosted;
+
+// fill the loaded services' queues on each tick. ES_NO_EVENT is used as the
+// load because every RunFunc ignores it, so we measure the framework and the
+// services' dispatch overhead rather than their application behavior
+static void LoadEveryService(void)
+{
+  ES_Event LoadEvent;
+  uint8_t i;
+
+  LoadEvent.EventType = ES_NO_EVENT;
+  LoadEvent.EventParam = 0;
+  for (i = 0; i < NUM_LOADED; i++)
+  {
+    while (ES_PostToService(i, LoadEvent) == true)
+    {
+      EventsPosted++;
+    }
+  }
+}
+
+// stands in for a peripheral that needs a prompt response
+static uint8_t SimulatedInt(void)
+{
+  ES_Event IntEvent;
+
+  IntEvent.EventType = ES_NO_EVENT;
+  IntEvent.EventParam = 0;
+  if (ES_PostToService(INT_SERVICE, IntEvent) != true)
+  {
+    return NO_SERVICE;
+  }
+  EventsPosted++;
+  return INT_SERVICE;
+}
+
+int main(void)
+{
+  ES_Return_t ErrorType;
+  ES_HostDispatchStats_t Stats;
+  ES_HostLatencyStats_t Latency;
+  uint64_t StartTime;
+  uint64_t ElapsedNs;
+  uint8_t i;
+
+  puts("Events & Services host throughput benchmark");
+  printf("%s %s\n", __TIME__, __DATE__);
+  printf("batch dispatch %s\n", ES_BATCH_DISPATCH ? "on" : "off");
+
+  ErrorType = ES_Initialize(ES_Timer_RATE_1mS);
+  if (ErrorType != Success)
+  {
+    printf("Failed Initialization (%d)\n", ErrorType);
+    return 1;
+  }
+  ES_Host_SetTickHook(LoadEveryService);
+  ES_Host_SetIntHook(SimulatedInt, BENCH_INT_PERIOD_NS);
+
+  StartTime = HostNow();
+  ErrorType = (ES_Return_t)ES_Host_RunFor(BENCH_TICKS);
+  ElapsedNs = HostNow() - StartTime;
+  if (ErrorType != Success)
+  {
+    printf("ES_Run failed (%d)\n", ErrorType);
+    return 1;
+  }
+
+  // with batch dispatch on, each dispatch here covers a whole batch
+  printf("%lu virtual ticks in %.3f ms of host time\n", BENCH_TICKS,
+         (double)ElapsedNs / 1.0e6);
+  printf("Service  Dispatches  Mean(ns)  Max(ns)\n");
+  for (i = 0; i < NUM_SERVICES; i++)
+  {
+    ES_Host_GetDispatchStats(i, &Stats);
+    printf("%7u  %10lu  %8.1f  %7lu\n", i, (unsigned long)Stats.NumDispatches,
+           (Stats.NumDispatches == 0) ? 0.0 :
+             (double)Stats.TotalNs / Stats.NumDispatches,
+           (unsigned long)Stats.MaxNs);
+  }
+  // every event posted has been run, as the run only ends when idle
+  printf("%.0f events dispatched per second\n",
+         (double)EventsPosted * NS_PER_SEC / (double)ElapsedNs);
+  ES_Host_GetIntLatency(&Latency);
+  printf("service %u interrupt latency: %lu ints, mean %.1f ns, max %lu ns\n",
+         INT_SERVICE, (unsigned long)Latency.NumInts,
+         (Latency.NumInts == 0) ? 0.0 :
+           (double)Latency.TotalNs / Latency.NumInts,
+         (unsigned long)Latency.MaxNs);
+#if ES_PROFILE_SERVICES
+  // and the framework's own view, in time stamp counts
+  ES_PrintServiceProfiles();
+#endif
+#if ES_LATENCY_MONITOR
+  ES_PrintLatencyStats();
+#endif
+  return 0;
+}
+#endif /* TEST */
+
+#endif /* ES_HOST_PORT */
+/*------------------------------ End of file ------------------------------*/
@@ -5,10 +5,27 @@
  Description
      Implements a FIFO circular buffer of EF_Event in a block of memory
  Notes
-
+     There are two queue engines behind the same functions. A queue whose
+     size is a power of two uses the ring engine, which wraps its indices 
+     with a mask and keeps free running head/tail counts, so no divide is
+     needed inside the critical regions. Any other size uses the original
+     engine with its modulo arithmetic.
+     With ES_QUEUE_TELEMETRY set, the header also holds the statistics for
+     the queue, which makes it more than 1 ES_Event long. Size blocks with
+     ES_QUEUE_BLOCK_SIZE rather than assuming 1 entry of overhead.
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 12:00 as       added ES_PeekQueue & ES_SpliceToFront for the bulk
+                         recall of deferred events
+ 10/18/26 11:00 as       added ES_GetQueueNumFree for ES_Publish
+ 10/18/26 09:00 as       added ES_GetQueueOldestSlot for the latency monitor
+ 10/17/26 17:00 as       added ES_GetQueueNewestSlot & ES_MergeWithPending
+                         for event coalescing
+ 10/17/26 16:00 as       added the optional high water, post & drop counts
+                         and the overflow hook
+ 10/17/26 15:00 as       added ES_GetQueueNumEntries
+ 10/17/26 11:00 as       added the power-of-two ring engine
  01/15/12 09:34 jec      converted to use the new C99 types from types.h
  08/09/11 18:16 jec      started coding
 *****************************************************************************/
@@ -20,6 +37,11 @@
 /*----------------------------- Module Defines ----------------------------*/
 unsigned int _PRIMASK_temp;
 //unsigned int _FAULTMASK_temp;
+
+// values for the Engine field common to both queue headers
+#define QUEUE_ENGINE_MODULO 0
+#define QUEUE_ENGINE_RING   1
+
 // QueueSize is max number of entries in the queue
 // CurrentIndex is the 'read-from' index,
 // actually CurrentIndex + sizeof(EF_Queue_t)
@@ -27,13 +49,49 @@ unsigned int _PRIMASK_temp;
 typedef struct {  uint8_t QueueSize;
                   uint8_t CurrentIndex;
                   uint8_t NumEntries;
+                  uint8_t Engine;
+#if ES_QUEUE_TELEMETRY
+                  ES_QueueStats_t Stats;
+#endif
 } ES_Queue_t;
 
 typedef ES_Queue_t * pQueue_t;
 
+// Header for the ring engine. QueueSize and Engine sit in the same places as
+// in ES_Queue_t. Head & Tail are free running counts of the events removed
+// and added, so (Tail - Head) is the number of entries and (count & 
+// (QueueSize-1)) is the index. Since QueueSize divides 256, the uint8_t
+// counts wrap cleanly.
+typedef struct {  uint8_t QueueSize;
+                  uint8_t Head;
+                  uint8_t Tail;
+                  uint8_t Engine;
+#if ES_QUEUE_TELEMETRY
+                  ES_QueueStats_t Stats;
+#endif
+} ES_RingQueue_t;
+
+typedef ES_RingQueue_t * pRingQueue_t;
+
+#if ES_QUEUE_TELEMETRY
+// make sure that ES_QUEUE_HEADER_EVENTS really covers the header
+typedef char QueueHeaderSizeCheck[(sizeof(ES_Queue_t) <=
+                       ES_QUEUE_HEADER_EVENTS * sizeof(ES_Event)) ? 1 : -1];
+#endif
+
 /*---------------------------- Module Functions ---------------------------*/
+#if ES_QUEUE_TELEMETRY
+static void NotePost( pQueue_t pThisQueue, uint8_t NumEntries );
+static void NoteDrop( ES_Event * pBlock, ES_Event Dropped );
+#endif
+static uint8_t SlotAt( ES_Event * pBlock, uint8_t Position );
+static void PushFront( ES_Event * pBlock, ES_Event Event2Add );
+static void DropFront( ES_Event * pBlock, uint8_t NumToDrop );
 
 /*---------------------------- Module Variables ---------------------------*/
+#if ES_QUEUE_TELEMETRY
+static ES_QueueOverflowHook_t * pOverflowHook;
+#endif
 
 /*------------------------------ Module Code ------------------------------*/
 /****************************************************************************
@@ -52,6 +110,9 @@ typedef ES_Queue_t * pQueue_t;
    ES_Event (at 4 bytes; 2 enum, 2 param) is greater than the 
    sizeof(ES_Queue_t), you only need to declare an array of ES_Event
    with 1 more element than you need for the actual queue.
+   If the room left after the header is a power of two the queue uses the
+   ring engine, see ES_QUEUE_BLOCK_SIZE in ES_Queue.h to size a block for it
+   at compile time. The block must be bigger than the header.
  Author
    J. Edward Carryer, 08/09/11, 18:40
 ****************************************************************************/
@@ -61,9 +122,18 @@ uint8_t ES_InitQueue( ES_Event * pBlock, uint8_t BlockSize )
    // initialize the Queue by setting up initial values for elements
    pThisQueue = (pQueue_t)pBlock;
    // use all but the structure overhead as the Queue
-   pThisQueue->QueueSize = BlockSize - 1;
+   pThisQueue->QueueSize = BlockSize - ES_QUEUE_HEADER_EVENTS;
    pThisQueue->CurrentIndex = 0;
    pThisQueue->NumEntries = 0;
+#if ES_QUEUE_TELEMETRY
+   ES_ResetQueueStats( pBlock );
+#endif
+   // power of two sizes get the ring engine (a queue of 1 gains nothing)
+   if ( (pThisQueue->QueueSize > 1) && 
+        ((pThisQueue->QueueSize & (pThisQueue->QueueSize - 1)) == 0) )
+     pThisQueue->Engine = QUEUE_ENGINE_RING;
+   else
+     pThisQueue->Engine = QUEUE_ENGINE_MODULO;
    return(pThisQueue->QueueSize);
 }
 
@@ -86,20 +156,45 @@ bool ES_EnQueueFIFO( ES_Event * pBlock, ES_Event Event2Add )
 {
    pQueue_t pThisQueue;
    pThisQueue = (pQueue_t)pBlock;
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      if ( (uint8_t)(pThisRing->Tail - pThisRing->Head) < pThisRing->QueueSize)
+      {  // mask the tail count to get the index, step past the header
+         EnterCritical();   // save interrupt state, turn ints off
+         pBlock[ ES_QUEUE_HEADER_EVENTS + 
+                 (pThisRing->Tail & (pThisRing->QueueSize - 1))] = Event2Add;
+         pThisRing->Tail++;
+#if ES_QUEUE_TELEMETRY
+         NotePost( pThisQueue, (uint8_t)(pThisRing->Tail - pThisRing->Head));
+#endif
+         ExitCritical();  // restore saved interrupt state
+         return(true);
+      }
+#if ES_QUEUE_TELEMETRY
+      NoteDrop( pBlock, Event2Add );
+#endif
+      return(false);
+   }
    // index will go from 0 to QueueSize-1 so use '<' to test if there is space
    if ( pThisQueue->NumEntries < pThisQueue->QueueSize)
    {  // save the new event, use % to create circular buffer in block
-      // 1+ to step past the Queue struct at the beginning of the
-      // block
+      // step past the Queue struct at the beginning of the block
       EnterCritical();   // save interrupt state, turn ints off
-      pBlock[ 1 + ((pThisQueue->CurrentIndex + pThisQueue->NumEntries)
+      pBlock[ ES_QUEUE_HEADER_EVENTS + ((pThisQueue->CurrentIndex + pThisQueue->NumEntries)
                % pThisQueue->QueueSize)] = Event2Add;
       pThisQueue->NumEntries++;          // inc number of entries
+#if ES_QUEUE_TELEMETRY
+      NotePost( pThisQueue, pThisQueue->NumEntries );
+#endif
       ExitCritical();  // restore saved interrupt state
       
       return(true);
-   }else
-      return(false);
+   }
+#if ES_QUEUE_TELEMETRY
+   NoteDrop( pBlock, Event2Add );
+#endif
+   return(false);
 }
 
 /****************************************************************************
@@ -123,6 +218,26 @@ bool ES_EnQueueLIFO( ES_Event * pBlock, ES_Event Event2Add )
 {
    pQueue_t pThisQueue;
    pThisQueue = (pQueue_t)pBlock;
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      if ( (uint8_t)(pThisRing->Tail - pThisRing->Head) < pThisRing->QueueSize)
+      {  // back up the head count, the mask takes care of the wrap
+         EnterCritical();   // save interrupt state, turn ints off
+         pThisRing->Head--;
+         pBlock[ ES_QUEUE_HEADER_EVENTS + 
+                 (pThisRing->Head & (pThisRing->QueueSize - 1))] = Event2Add;
+#if ES_QUEUE_TELEMETRY
+         NotePost( pThisQueue, (uint8_t)(pThisRing->Tail - pThisRing->Head));
+#endif
+         ExitCritical();  // restore saved interrupt state
+         return(true);
+      }
+#if ES_QUEUE_TELEMETRY
+      NoteDrop( pBlock, Event2Add );
+#endif
+      return(false);
+   }
    // index will go from 0 to QueueSize-1 so use '<' to test if there is space
     if ( pThisQueue->NumEntries < pThisQueue->QueueSize){
       EnterCritical();   // save interrupt state, turn ints off
@@ -135,11 +250,18 @@ bool ES_EnQueueLIFO( ES_Event * pBlock, ES_Event Event2Add )
       else{
         pThisQueue->CurrentIndex--;
       }  
-      pBlock[ 1 + pThisQueue->CurrentIndex ] = Event2Add;
+      pBlock[ ES_QUEUE_HEADER_EVENTS + pThisQueue->CurrentIndex ] = Event2Add;
+#if ES_QUEUE_TELEMETRY
+      NotePost( pThisQueue, pThisQueue->NumEntries );
+#endif
       ExitCritical();  // restore saved interrupt state      
       return(true);
-    }else // in case no room on the queue
-      return(false);
+    }
+    // in case no room on the queue
+#if ES_QUEUE_TELEMETRY
+    NoteDrop( pBlock, Event2Add );
+#endif
+    return(false);
 }
 
 
@@ -165,10 +287,28 @@ uint8_t ES_DeQueue( ES_Event * pBlock, ES_Event * pReturnEvent )
    uint8_t NumLeft;
 
    pThisQueue = (pQueue_t)pBlock;
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      if ( pThisRing->Tail != pThisRing->Head)
+      {
+         EnterCritical();   // save interrupt state, turn ints off
+         *pReturnEvent = 
+                pBlock[ ES_QUEUE_HEADER_EVENTS + (pThisRing->Head & (pThisRing->QueueSize - 1))];
+         pThisRing->Head++;
+         NumLeft = (uint8_t)(pThisRing->Tail - pThisRing->Head);
+         ExitCritical();  // restore saved interrupt state
+      }else { // no items left in the queue
+         (*pReturnEvent).EventType = ES_NO_EVENT;
+         (*pReturnEvent).EventParam = 0;
+         NumLeft = 0;
+      }
+      return NumLeft;
+   }
    if ( pThisQueue->NumEntries > 0)
    {
       EnterCritical();   // save interrupt state, turn ints off
-      *pReturnEvent = pBlock[ 1 + pThisQueue->CurrentIndex ];
+      *pReturnEvent = pBlock[ ES_QUEUE_HEADER_EVENTS + pThisQueue->CurrentIndex ];
       // inc the index
       pThisQueue->CurrentIndex++;
       // this way we only do the modulo operation when we really need to
@@ -204,9 +344,402 @@ bool ES_IsQueueEmpty( ES_Event * pBlock )
    pQueue_t pThisQueue;
 
    pThisQueue = (pQueue_t)pBlock;
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+      return(((pRingQueue_t)pBlock)->Tail == ((pRingQueue_t)pBlock)->Head);
    return(pThisQueue->NumEntries == 0);
 }
 
+/****************************************************************************
+ Function
+   ES_GetQueueNumEntries
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+ Returns
+   uint8_t : the number of events currently in the Queue
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/17/26, 15:00
+****************************************************************************/
+uint8_t ES_GetQueueNumEntries( ES_Event * pBlock )
+{
+   pQueue_t pThisQueue;
+
+   pThisQueue = (pQueue_t)pBlock;
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+      return (uint8_t)(((pRingQueue_t)pBlock)->Tail -
+                       ((pRingQueue_t)pBlock)->Head);
+   return pThisQueue->NumEntries;
+}
+
+/****************************************************************************
+ Function
+   ES_GetQueueNumFree
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+ Returns
+   uint8_t : the number of events that can still be added to the Queue
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/18/26, 11:00
+****************************************************************************/
+uint8_t ES_GetQueueNumFree( ES_Event * pBlock )
+{
+   // QueueSize is in the same place in the headers of both engines
+   return ((pQueue_t)pBlock)->QueueSize - ES_GetQueueNumEntries( pBlock );
+}
+
+/****************************************************************************
+ Function
+   ES_GetQueueNewestSlot
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+ Returns
+   uint8_t : the slot holding the last event added FIFO, ES_QUEUE_NO_SLOT if
+             the Queue is empty
+ Description
+   A slot is the position of an entry in the block. It does not change while
+   the entry is in the Queue, so it can be used to find the entry again with
+   ES_MergeWithPending.
+ Notes
+
+ Author
+   as, 10/17/26, 17:00
+****************************************************************************/
+uint8_t ES_GetQueueNewestSlot( ES_Event * pBlock )
+{
+   pQueue_t pThisQueue;
+   uint8_t Slot = ES_QUEUE_NO_SLOT;
+
+   pThisQueue = (pQueue_t)pBlock;
+   EnterCritical();
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      if ( pThisRing->Tail != pThisRing->Head )
+         Slot = (uint8_t)(pThisRing->Tail - 1) & (pThisRing->QueueSize - 1);
+   }else if ( pThisQueue->NumEntries > 0 )
+      Slot = (uint8_t)((pThisQueue->CurrentIndex + pThisQueue->NumEntries - 1)
+                        % pThisQueue->QueueSize);
+   ExitCritical();
+   return Slot;
+}
+
+/****************************************************************************
+ Function
+   ES_GetQueueOldestSlot
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+ Returns
+   uint8_t : the slot holding the next event that ES_DeQueue will return,
+             ES_QUEUE_NO_SLOT if the Queue is empty
+ Description
+   the other end of the Queue from ES_GetQueueNewestSlot. After an
+   ES_EnQueueLIFO it is the slot of the event just added.
+ Notes
+
+ Author
+   as, 10/18/26, 09:00
+****************************************************************************/
+uint8_t ES_GetQueueOldestSlot( ES_Event * pBlock )
+{
+   pQueue_t pThisQueue;
+   uint8_t Slot = ES_QUEUE_NO_SLOT;
+
+   pThisQueue = (pQueue_t)pBlock;
+   EnterCritical();
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      if ( pThisRing->Tail != pThisRing->Head )
+         Slot = pThisRing->Head & (pThisRing->QueueSize - 1);
+   }else if ( pThisQueue->NumEntries > 0 )
+      Slot = pThisQueue->CurrentIndex;
+   ExitCritical();
+   return Slot;
+}
+
+/****************************************************************************
+ Function
+   ES_PeekQueue
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+   uint8_t Position : which entry, 0 for the next one out
+   ES_Event * pReturnEvent : used to return a copy of the entry
+ Returns
+   uint8_t : the slot holding the entry, ES_QUEUE_NO_SLOT if the Queue has
+             no entry at Position
+ Description
+   looks at an entry without removing it
+ Notes
+
+ Author
+   as, 10/18/26, 12:00
+****************************************************************************/
+uint8_t ES_PeekQueue( ES_Event * pBlock, uint8_t Position,
+                      ES_Event * pReturnEvent )
+{
+   uint8_t Slot = ES_QUEUE_NO_SLOT;
+
+   EnterCritical();
+   if ( Position < ES_GetQueueNumEntries( pBlock ) )
+   {
+      Slot = SlotAt( pBlock, Position );
+      *pReturnEvent = pBlock[ ES_QUEUE_HEADER_EVENTS + Slot ];
+   }
+   ExitCritical();
+   return Slot;
+}
+
+/****************************************************************************
+ Function
+   ES_SpliceToFront
+ Parameters
+   ES_Event * pDest : the Queue to move the entries to
+   ES_Event * pSource : the Queue to move them from
+ Returns
+   uint8_t : the number of entries moved
+ Description
+   moves the entries of pSource to the front of pDest, in the same order,
+   so that they all come out of pDest ahead of what was already there. If
+   pDest does not have room for all of them, as many as fit are moved from
+   the front of pSource and the rest are left behind.
+ Notes
+   The whole move is one critical region, rather than one per entry.
+ Author
+   as, 10/18/26, 12:00
+****************************************************************************/
+uint8_t ES_SpliceToFront( ES_Event * pDest, ES_Event * pSource )
+{
+   uint8_t NumToMove;
+   uint8_t i;
+
+   EnterCritical();
+   NumToMove = ES_GetQueueNumEntries( pSource );
+   if ( NumToMove > ES_GetQueueNumFree( pDest ) )
+      NumToMove = ES_GetQueueNumFree( pDest );
+   // push the last one to move first, so that they keep their order
+   for ( i = NumToMove; i > 0; i-- )
+      PushFront( pDest,
+                 pSource[ ES_QUEUE_HEADER_EVENTS + SlotAt( pSource, i - 1 ) ] );
+   DropFront( pSource, NumToMove );
+   ExitCritical();
+   return NumToMove;
+}
+
+/****************************************************************************
+ Function
+   ES_MergeWithPending
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+   uint8_t Slot : where an event of the same type was last seen
+   ES_Event Event2Add : the new event
+   bool Replace : true to overwrite the pending event with Event2Add
+ Returns
+   bool : true if an event of the same type is still pending in Slot, in
+          which case Event2Add has been merged with it
+ Description
+   the lookup behind event coalescing. If the entry in Slot is still in the
+   Queue and has the same EventType as Event2Add, then either replace it with
+   Event2Add or leave it be (Replace false), in both cases Event2Add need
+   not be queued.
+ Notes
+   Slot is only a hint, it is checked before it is used, so a stale slot
+   simply gives a false return.
+ Author
+   as, 10/17/26, 17:00
+****************************************************************************/
+bool ES_MergeWithPending( ES_Event * pBlock, uint8_t Slot, ES_Event Event2Add,
+                          bool Replace )
+{
+   pQueue_t pThisQueue;
+   uint8_t Age;      // number of entries ahead of Slot in the Queue
+   uint8_t NumEntries;
+   bool Merged = false;
+
+   pThisQueue = (pQueue_t)pBlock;
+   if ( Slot >= pThisQueue->QueueSize )
+      return false;
+   EnterCritical();
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      Age = (uint8_t)(Slot - pThisRing->Head) & (pThisRing->QueueSize - 1);
+      NumEntries = (uint8_t)(pThisRing->Tail - pThisRing->Head);
+   }else
+   {
+      if ( Slot >= pThisQueue->CurrentIndex )
+         Age = Slot - pThisQueue->CurrentIndex;
+      else
+         Age = Slot + pThisQueue->QueueSize - pThisQueue->CurrentIndex;
+      NumEntries = pThisQueue->NumEntries;
+   }
+   if ( (Age < NumEntries) && 
+        (pBlock[ ES_QUEUE_HEADER_EVENTS + Slot ].EventType ==
+                                                    Event2Add.EventType) )
+   {
+      if ( Replace )
+         pBlock[ ES_QUEUE_HEADER_EVENTS + Slot ] = Event2Add;
+      Merged = true;
+   }
+   ExitCritical();
+   return Merged;
+}
+
+#if ES_QUEUE_TELEMETRY
+/****************************************************************************
+ Function
+   ES_GetQueueStats
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+   ES_QueueStats_t * pStats : where to copy the statistics
+ Returns
+   nothing
+ Description
+   copies the high water mark and the post & drop counts for the Queue
+ Notes
+
+ Author
+   as, 10/17/26, 16:00
+****************************************************************************/
+void ES_GetQueueStats( ES_Event * pBlock, ES_QueueStats_t * pStats )
+{
+   EnterCritical();   // an ISR could be posting to this queue
+   *pStats = ((pQueue_t)pBlock)->Stats;
+   ExitCritical();
+}
+
+/****************************************************************************
+ Function
+   ES_ResetQueueStats
+ Parameters
+   ES_Event * pBlock : pointer to the block of memory in use as the Queue
+ Returns
+   nothing
+ Description
+   clears the statistics for the Queue, ES_InitQueue does this too
+ Notes
+
+ Author
+   as, 10/17/26, 16:00
+****************************************************************************/
+void ES_ResetQueueStats( ES_Event * pBlock )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+
+   EnterCritical();
+   pThisQueue->Stats.NumEnqueued = 0;
+   pThisQueue->Stats.NumDropped = 0;
+   pThisQueue->Stats.HighWater = 0;
+   ExitCritical();
+}
+
+/****************************************************************************
+ Function
+   ES_SetQueueOverflowHook
+ Parameters
+   ES_QueueOverflowHook_t * pHook : function to call when a post is refused,
+                                    NULL for none
+ Returns
+   nothing
+ Description
+   sets the one hook that is called for a refused post to any queue
+ Notes
+   the hook is called after the drop has been counted, with interrupts in
+   the state that the poster left them
+ Author
+   as, 10/17/26, 16:00
+****************************************************************************/
+void ES_SetQueueOverflowHook( ES_QueueOverflowHook_t * pHook )
+{
+   pOverflowHook = pHook;
+}
+#endif /* ES_QUEUE_TELEMETRY */
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// the slot of the entry Position places from the front, call with ints off
+static uint8_t SlotAt( ES_Event * pBlock, uint8_t Position )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+      return (uint8_t)(((pRingQueue_t)pBlock)->Head + Position) &
+                                                (pThisQueue->QueueSize - 1);
+   return (uint8_t)((pThisQueue->CurrentIndex + Position) % 
+                                                pThisQueue->QueueSize);
+}
+
+// adds an entry at the front, call with ints off and only if there is room
+static void PushFront( ES_Event * pBlock, ES_Event Event2Add )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      pRingQueue_t pThisRing = (pRingQueue_t)pBlock;
+      pThisRing->Head--;
+      pBlock[ ES_QUEUE_HEADER_EVENTS + 
+              (pThisRing->Head & (pThisRing->QueueSize - 1))] = Event2Add;
+   }else
+   {
+      pThisQueue->NumEntries++;
+      if (pThisQueue->CurrentIndex == 0)
+         pThisQueue->CurrentIndex = pThisQueue->QueueSize - 1;
+      else
+         pThisQueue->CurrentIndex--;
+      pBlock[ ES_QUEUE_HEADER_EVENTS + pThisQueue->CurrentIndex ] = Event2Add;
+   }
+#if ES_QUEUE_TELEMETRY
+   NotePost( pThisQueue, ES_GetQueueNumEntries( pBlock ) );
+#endif
+}
+
+// removes entries from the front, call with ints off
+static void DropFront( ES_Event * pBlock, uint8_t NumToDrop )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+
+   if ( pThisQueue->Engine == QUEUE_ENGINE_RING )
+   {
+      ((pRingQueue_t)pBlock)->Head += NumToDrop;
+   }else
+   {
+      pThisQueue->CurrentIndex = (uint8_t)((pThisQueue->CurrentIndex + 
+                                   NumToDrop) % pThisQueue->QueueSize);
+      pThisQueue->NumEntries -= NumToDrop;
+   }
+}
+
+#if ES_QUEUE_TELEMETRY
+// counts a successful post, called with interrupts off
+static void NotePost( pQueue_t pThisQueue, uint8_t NumEntries )
+{
+   pThisQueue->Stats.NumEnqueued++;
+   if ( NumEntries > pThisQueue->Stats.HighWater )
+      pThisQueue->Stats.HighWater = NumEntries;
+}
+
+// counts a refused post, saturating rather than wrapping, then tells the hook
+static void NoteDrop( ES_Event * pBlock, ES_Event Dropped )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+
+   EnterCritical();
+   if ( pThisQueue->Stats.NumDropped != 0xFFFF )
+      pThisQueue->Stats.NumDropped++;
+   ExitCritical();
+   if ( pOverflowHook != (ES_QueueOverflowHook_t *)0 )
+      pOverflowHook( pBlock, Dropped );
+}
+#endif
+
 #if 0
 /****************************************************************************
  Function
@@ -243,8 +776,41 @@ void QueueFlushQueue( uint8_t * pBlock )
 #include <stdio.h>
 #include "ES_General.h"
 
-static ES_Event TestQueue[3+1];
+#define NUM_TIMED_POSTS 1000
+
+static ES_Event TestQueue[ES_QUEUE_BLOCK_SIZE(3, 0)];
+static ES_Event TestRing[ES_QUEUE_BLOCK_SIZE(3, 1)];
+// the same depth as a service queue with each engine, for the timing test
+static ES_Event ModuloQueue[ES_QUEUE_BLOCK_SIZE(5, 0)];
+static ES_Event RingQueue[ES_QUEUE_BLOCK_SIZE(5, 1)];
 volatile  uint8_t NumLeft; // for debugging visibility
+#if ES_QUEUE_TELEMETRY
+static uint8_t HookCalls;
+
+static void CountOverflows( ES_Event * pBlock, ES_Event Dropped ){
+  if ( (pBlock == TestRing) && (Dropped.EventParam == 7) )
+    HookCalls++;
+}
+#endif
+
+// measure the cycles spent in ES_EnQueueFIFO, dequeuing after each post so
+// that the indices keep moving around the whole queue
+static uint32_t TimePosts( ES_Event * pBlock ){
+  ES_Event MyEvent;
+  uint32_t Start;
+  uint32_t Total = 0;
+  uint16_t i;
+
+  MyEvent.EventType = ES_NO_EVENT;
+  MyEvent.EventParam = 0;
+  for (i = 0; i < NUM_TIMED_POSTS; i++){
+    Start = ES_ReadCycleCounter();
+    ES_EnQueueFIFO( pBlock, MyEvent );
+    Total += ES_ReadCycleCounter() - Start;
+    ES_DeQueue( pBlock, &MyEvent );
+  }
+  return Total;
+}
 
 void main(void){
   ES_Event MyEvent;
@@ -299,6 +865,53 @@ void main(void){
   // so pull off the 8, leaving 2 entries
   NumLeft = ES_DeQueue( TestQueue, &MyEvent);
   NumLeft += 3; //to keep the compiler from optimizing away the last save
+
+  // now run the same sequence through the ring engine, rounded up to 4
+  ES_InitQueue( TestRing, ARRAY_SIZE(TestRing) );
+  MyEvent.EventParam = 1;
+  ES_EnQueueFIFO( TestRing, MyEvent );
+  MyEvent.EventParam = 11;
+  ES_EnQueueLIFO( TestRing, MyEvent );
+  MyEvent.EventParam = 3;
+  ES_EnQueueFIFO( TestRing, MyEvent );
+  MyEvent.EventParam = 5;
+  ES_EnQueueFIFO( TestRing, MyEvent );
+  MyEvent.EventParam = 7;
+  if ( ES_EnQueueFIFO( TestRing, MyEvent ) != false ) // should be full now
+    puts("ring queue accepted a post when full\r");
+  // the events should come out as 11,1,3,5
+  NumLeft = ES_DeQueue( TestRing, &MyEvent);
+  if ( (NumLeft != 3) || (MyEvent.EventParam != 11) )
+    puts("ring queue LIFO post out of order\r");
+  NumLeft = ES_DeQueue( TestRing, &MyEvent);
+  if ( (NumLeft != 2) || (MyEvent.EventParam != 1) )
+    puts("ring queue FIFO post out of order\r");
+
+#if ES_QUEUE_TELEMETRY
+  { // with 2 entries left, top the ring up to full and post once more
+    ES_QueueStats_t Stats;
+    ES_SetQueueOverflowHook( CountOverflows );
+    MyEvent.EventParam = 7;
+    ES_EnQueueFIFO( TestRing, MyEvent ); // 3 entries
+    ES_EnQueueFIFO( TestRing, MyEvent ); // 4 entries, full
+    ES_EnQueueFIFO( TestRing, MyEvent ); // refused, and the hook is called
+    // so 6 posts in all, 2 refused (1 before the hook was set), peak of 4
+    ES_GetQueueStats( TestRing, &Stats );
+    if ( (Stats.NumEnqueued != 6) || (Stats.NumDropped != 2) ||
+         (Stats.HighWater != 4) || (HookCalls != 1) )
+      puts("queue telemetry counts wrong\r");
+    ES_SetQueueOverflowHook( (ES_QueueOverflowHook_t *)0 );
+  }
+#endif
+
+  // and compare the time each engine takes per post
+  ES_InitCycleCounter();
+  ES_InitQueue( ModuloQueue, ARRAY_SIZE(ModuloQueue) );
+  ES_InitQueue( RingQueue, ARRAY_SIZE(RingQueue) );
+  printf("modulo engine : %lu cycles/post\r\n",
+         (unsigned long)(TimePosts( ModuloQueue ) / NUM_TIMED_POSTS));
+  printf("ring engine   : %lu cycles/post\r\n",
+         (unsigned long)(TimePosts( RingQueue ) / NUM_TIMED_POSTS));
   
   while(1)
     ;
@@ -21,6 +21,10 @@
  -------------- ---     --------
  10/11/15 10:30 jec     first pass
  10/11/15 18:10 jec     converted to post events to the framework
+ 10/17/26 12:00 as      post through the ISR channels so that the handlers
+                        no longer disable interrupts
+ 10/17/26 23:00 as      timer B posts to TimeBPrio, it was getting TimeAPrio.
+                        For more than two short timers see ES_ShortTimerPool.c
  
 ****************************************************************************/
 // the common headers for I/O, C99 types 
@@ -50,6 +54,7 @@
 // the framework headers
 #include "ES_Framework.h"
 #include "ES_Configure.h"
+#include "ES_IsrChannel.h"
 
 
 // module level functions
@@ -90,7 +95,7 @@ void ES_ShortTimerInit(uint8_t TimeAPrio, uint8_t TimeBPrio){
   TimerPrescaleSet(TIMER5_BASE, TIMER_BOTH, PRE_1uS);
 // log the service to which the timeout will be posted
   Timer_A_Priority = TimeAPrio;
-  Timer_B_Priority = TimeAPrio;
+  Timer_B_Priority = TimeBPrio;
       
 }
 
@@ -147,7 +152,7 @@ void ShortTimerAHandler(void){
 // protect against timer that was not correctly initialized  
   if (Timer_A_Priority != SHORT_TIMER_UNUSED)
   {
-    ES_PostToService( Timer_A_Priority, ThisEvent);
+    ES_IsrChannelPost( ISR_CHANNEL_SHORT_TIMER_A, Timer_A_Priority, ThisEvent);
   }
 }
 
@@ -167,7 +172,7 @@ void ShortTimerBHandler(void){
 // protect against timer that was not correctly initialized  
   if (Timer_B_Priority != SHORT_TIMER_UNUSED)
   {
-    ES_PostToService( Timer_B_Priority, ThisEvent);
+    ES_IsrChannelPost( ISR_CHANNEL_SHORT_TIMER_B, Timer_B_Priority, ThisEvent);
   }
   
 }
@@ -0,0 +1,433 @@
+//#define TEST
+/****************************************************************************
+ Module
+     ES_ShortTimerPool.c
+ Description
+     A pool of microsecond one shot timers, any number of them, that all
+     share the one hardware timer (16/32 bit Timer Module 4).
+ Notes
+     Timer 4 free runs as a 32 bit up counter at the system clock, and its
+     match interrupt is set for the earliest deadline of the running
+     channels. The running channels are kept in a list sorted by deadline,
+     so starting a channel costs a walk of the list, but the interrupt only
+     ever looks at the head: it posts every channel that is due and sets the
+     match for the next one.
+
+     Deadlines are compared by the signed difference of the counter values,
+     which is right across the counter wrapping for any two deadlines less
+     than 2^31 counts (53 seconds at 40MHz) apart, hence
+     ES_SHORT_TIMER_POOL_MAX_US.
+
+     The timeouts are posted through an ISR channel. Start and Stop work
+     on the list with interrupts off, and Start posts a channel that is
+     already due itself, so it never overlaps the interrupt and the ISR
+     channel still has only one writer at a time.
+
+     ES_ShortTimer.c's two timers on Timer 5 are untouched by this module.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/17/26 23:00 as      started coding
+*****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+// the headers to access the timer hardware
+#include "inc/hw_memmap.h"
+#include "inc/hw_types.h"
+#include "inc/hw_timer.h"
+#include "inc/hw_ints.h"
+
+// the headers to access the TivaWare Library
+#include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
+#include "driverlib/interrupt.h"
+
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+#include "ES_IsrChannel.h"
+#include "ES_ShortTimerPool.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+// timer counts per microsecond, based on the 40MHz clock rate
+#define COUNTS_PER_US 40
+
+// marks the end of the deadline list
+#define POOL_NONE 0xFF
+
+#if NUM_SHORT_TIMER_CHANNELS >= POOL_NONE
+#error NUM_SHORT_TIMER_CHANNELS must be less than 255
+#endif
+
+#if (ES_SHORT_TIMER_POOL_MAX_US * COUNTS_PER_US) >= 0x80000000UL
+#error ES_SHORT_TIMER_POOL_MAX_US is too long for the deadline comparisons
+#endif
+
+#if defined(TEST) && defined(ES_HOST_PORT)
+// the test harness at the end of the file stands in for Timer 4 and the
+// ISR channel
+#define SIMULATED_HW
+static void RecordTimeout( uint8_t WhichService, ES_Event ThisEvent );
+#define POST_TIMEOUT(WhichService, ThisEvent) \
+          RecordTimeout( WhichService, ThisEvent )
+#else
+#define POST_TIMEOUT(WhichService, ThisEvent) \
+          ES_IsrChannelPost( ISR_CHANNEL_SHORT_TIMER_POOL, WhichService, \
+                             ThisEvent )
+#endif
+
+typedef struct {
+  uint32_t Deadline;      // counter value at which the channel times out
+  uint8_t Owner;          // the service to post the timeout to
+  uint8_t Next;           // the channel with the next deadline
+  bool Running;
+} PoolChannel_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+void ShortTimerPoolHandler( void );
+static void InsertChannel( uint8_t Channel );
+static void RemoveChannel( uint8_t Channel );
+static void ExpireDue( void );
+static void HW_Init( void );
+static uint32_t HW_ReadCounter( void );
+static void HW_SetMatch( uint32_t Match );
+
+/*---------------------------- Module Variables ---------------------------*/
+static PoolChannel_t Channels[NUM_SHORT_TIMER_CHANNELS];
+static uint8_t ListHead = POOL_NONE;
+static bool PoolReady = false;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   sets up Timer 4 to free run with its match interrupt enabled, and stops
+   every channel
+ Notes
+   only the first call does anything, so every service that uses the pool
+   can call it from its init function
+ Author
+   as, 10/17/26, 23:00
+****************************************************************************/
+void ES_ShortTimerPoolInit( void ){
+  uint8_t i;
+
+  if ( PoolReady == true )
+    return;
+  for ( i = 0; i < NUM_SHORT_TIMER_CHANNELS; i++ ){
+    Channels[i].Running = false;
+    Channels[i].Next = POOL_NONE;
+  }
+  ListHead = POOL_NONE;
+  HW_Init();
+  PoolReady = true;
+}
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolStart
+ Parameters
+   uint8_t Channel : the channel to start
+   uint8_t WhichService : number of the service to post the timeout to
+   uint32_t Microseconds : time until the timeout
+ Returns
+   bool : false for a bad channel, service or time, or before the pool has
+          been initialized
+ Description
+   starts (or restarts) a channel, it posts ES_SHORT_TIMEOUT once
+ Notes
+   A time of 0, or one too short to set the match for in time, is posted
+   straight away.
+ Author
+   as, 10/17/26, 23:00
+****************************************************************************/
+bool ES_ShortTimerPoolStart( uint8_t Channel, uint8_t WhichService,
+                             uint32_t Microseconds ){
+  if ( (Channel >= NUM_SHORT_TIMER_CHANNELS) ||
+       (WhichService >= NUM_SERVICES) ||
+       (Microseconds > ES_SHORT_TIMER_POOL_MAX_US) || (PoolReady != true) )
+    return false;
+
+  EnterCritical();
+  if ( Channels[Channel].Running == true )
+    RemoveChannel( Channel );
+  Channels[Channel].Owner = WhichService;
+  Channels[Channel].Deadline = HW_ReadCounter() +
+                               (Microseconds * COUNTS_PER_US);
+  Channels[Channel].Running = true;
+  InsertChannel( Channel );
+  // a new earliest deadline needs the match moving
+  if ( ListHead == Channel )
+    ExpireDue();
+  ExitCritical();
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolStop
+ Parameters
+   uint8_t Channel : the channel to stop
+ Returns
+   bool : false for a bad channel
+ Description
+   stops a channel without posting its timeout
+ Notes
+   The match is left where it was. If it was for this channel the interrupt
+   finds nothing due, and sets the match for whatever is next.
+ Author
+   as, 10/17/26, 23:00
+****************************************************************************/
+bool ES_ShortTimerPoolStop( uint8_t Channel ){
+  if ( Channel >= NUM_SHORT_TIMER_CHANNELS )
+    return false;
+
+  EnterCritical();
+  if ( Channels[Channel].Running == true ){
+    RemoveChannel( Channel );
+    Channels[Channel].Running = false;
+  }
+  ExitCritical();
+  return true;
+}
+
+/****************************************************************************
+ Function
+   ES_ShortTimerPoolIsRunning
+ Parameters
+   uint8_t Channel : the channel to query
+ Returns
+   bool : true if the channel has been started and not yet timed out
+ Description
+   see above
+ Notes
+
+ Author
+   as, 10/17/26, 23:00
+****************************************************************************/
+bool ES_ShortTimerPoolIsRunning( uint8_t Channel ){
+  if ( Channel >= NUM_SHORT_TIMER_CHANNELS )
+    return false;
+  return Channels[Channel].Running;
+}
+
+/****************************************************************************
+ Function
+   ShortTimerPoolHandler
+ Parameters
+   None
+ Returns
+   None
+ Description
+   interrupt response for the Timer 4A match, posts the channels that are
+   due and sets the match for the next one
+ Notes
+
+ Author
+   as, 10/17/26, 23:00
+****************************************************************************/
+void ShortTimerPoolHandler( void ){
+#ifndef SIMULATED_HW
+  TimerIntClear( TIMER4_BASE, TIMER_TIMA_MATCH );
+#endif
+  ExpireDue();
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// puts a channel in the deadline list after any with the same deadline
+static void InsertChannel( uint8_t Channel ){
+  uint8_t * pLink = &ListHead;
+  uint32_t Deadline = Channels[Channel].Deadline;
+
+  while ( (*pLink != POOL_NONE) &&
+          ((int32_t)(Channels[*pLink].Deadline - Deadline) <= 0) )
+    pLink = &Channels[*pLink].Next;
+  Channels[Channel].Next = *pLink;
+  *pLink = Channel;
+}
+
+// takes a channel out of the deadline list
+static void RemoveChannel( uint8_t Channel ){
+  uint8_t * pLink = &ListHead;
+
+  while ( (*pLink != POOL_NONE) && (*pLink != Channel) )
+    pLink = &Channels[*pLink].Next;
+  if ( *pLink == Channel )
+    *pLink = Channels[Channel].Next;
+}
+
+// posts the channels at the head of the list that are due, then sets the
+// match for the first one that is not. Called with interrupts off.
+static void ExpireDue( void ){
+  ES_Event ThisEvent;
+  uint8_t Channel;
+
+  ThisEvent.EventType = ES_SHORT_TIMEOUT;
+  while ( (Channel = ListHead) != POOL_NONE ){
+    if ( (int32_t)(Channels[Channel].Deadline - HW_ReadCounter()) > 0 ){
+      HW_SetMatch( Channels[Channel].Deadline );
+      // if the counter reached the deadline while the match was being set
+      // the match was missed, so carry on and post it here
+      if ( (int32_t)(Channels[Channel].Deadline - HW_ReadCounter()) > 0 )
+        break;
+    }
+    ListHead = Channels[Channel].Next;
+    Channels[Channel].Running = false;
+    ThisEvent.EventParam = Channel;
+    POST_TIMEOUT( Channels[Channel].Owner, ThisEvent );
+  }
+}
+
+#ifndef SIMULATED_HW
+// Timer 4 as one 32 bit up counter over the full range, interrupting on
+// the match
+static void HW_Init( void ){
+  SysCtlPeripheralEnable( SYSCTL_PERIPH_TIMER4 );
+  TimerConfigure( TIMER4_BASE, TIMER_CFG_PERIODIC_UP );
+  TimerLoadSet( TIMER4_BASE, TIMER_A, 0xFFFFFFFFUL );
+  HWREG(TIMER4_BASE + TIMER_O_TAMR) |= TIMER_TAMR_TAMIE;
+  TimerIntEnable( TIMER4_BASE, TIMER_TIMA_MATCH );
+  IntEnable( INT_TIMER4A_TM4C123 );
+  TimerEnable( TIMER4_BASE, TIMER_A );
+}
+
+static uint32_t HW_ReadCounter( void ){
+  return TimerValueGet( TIMER4_BASE, TIMER_A );
+}
+
+static void HW_SetMatch( uint32_t Match ){
+  TimerMatchSet( TIMER4_BASE, TIMER_A, Match );
+}
+#endif /* SIMULATED_HW */
+
+/***************************************************************************
+ Test Harness: host test against a simulated Timer 4. Random starts and
+ stops of every channel, with time moving on in random steps across the
+ counter wrapping. Every timeout must come on the count it was due and
+ only once, and a stopped channel must not time out.
+ ***************************************************************************/
+#ifdef SIMULATED_HW
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_ROUNDS 2000000UL
+
+static uint64_t SimTime;         // the counter, before it is cut to 32 bits
+static uint32_t SimMatch;
+static uint64_t Due[NUM_SHORT_TIMER_CHANNELS];
+static uint8_t DueOwner[NUM_SHORT_TIMER_CHANNELS];
+static bool Expected[NUM_SHORT_TIMER_CHANNELS];
+static uint32_t NumTimeouts;
+static uint32_t NumErrors;
+
+static void HW_Init( void ){
+  SimTime = 0xFFF00000UL;   // close to the wrap
+}
+
+static uint32_t HW_ReadCounter( void ){
+  return (uint32_t)SimTime;
+}
+
+static void HW_SetMatch( uint32_t Match ){
+  SimMatch = Match;
+}
+
+static void RecordTimeout( uint8_t WhichService, ES_Event ThisEvent ){
+  uint8_t Channel = (uint8_t)ThisEvent.EventParam;
+
+  NumTimeouts++;
+  if ( (ThisEvent.EventType != ES_SHORT_TIMEOUT) ||
+       (Channel >= NUM_SHORT_TIMER_CHANNELS) || (Expected[Channel] != true) ||
+       (WhichService != DueOwner[Channel]) || (SimTime != Due[Channel]) ){
+    printf("bad timeout: channel %u at %llu\n", Channel,
+           (unsigned long long)SimTime);
+    NumErrors++;
+    return;
+  }
+  Expected[Channel] = false;
+}
+
+// moves the counter on, taking the match interrupt as the counter gets to
+// the match value
+static void RunCounter( uint32_t Counts ){
+  uint32_t ToMatch;
+
+  while ( Counts > 0 ){
+    // a match at the count we are on now is not seen again until the
+    // counter has gone all the way round
+    ToMatch = SimMatch - (uint32_t)SimTime;
+    if ( (ToMatch == 0) || (ToMatch > Counts) ){
+      SimTime += Counts;
+      Counts = 0;
+    }else{
+      SimTime += ToMatch;
+      Counts -= ToMatch;
+      ShortTimerPoolHandler();
+    }
+  }
+}
+
+static uint32_t RandomTime( void ){
+  switch ( rand() % 4 ){
+    case 0 : return rand() % 4;
+    case 1 : return rand() % 100;
+    case 2 : return rand() % 20000;
+    default : return ((uint32_t)rand() * 16) % ES_SHORT_TIMER_POOL_MAX_US;
+  }
+}
+
+int main( void ){
+  uint32_t Round;
+  uint8_t Channel;
+  uint8_t Owner;
+  uint32_t Microseconds;
+  uint8_t Missing = 0;
+
+  printf("ES_ShortTimerPool test, %u channels\n", NUM_SHORT_TIMER_CHANNELS);
+  srand(1);
+  ES_ShortTimerPoolInit();
+  for ( Round = 0; Round < TEST_ROUNDS; Round++ ){
+    Channel = rand() % NUM_SHORT_TIMER_CHANNELS;
+    if ( (rand() % 4) != 0 ){
+      Owner = rand() % NUM_SERVICES;
+      Microseconds = RandomTime();
+      Due[Channel] = SimTime + ((uint64_t)Microseconds * COUNTS_PER_US);
+      DueOwner[Channel] = Owner;
+      Expected[Channel] = true;
+      if ( ES_ShortTimerPoolStart( Channel, Owner, Microseconds ) != true )
+        NumErrors++;
+    }else{
+      ES_ShortTimerPoolStop( Channel );
+      Expected[Channel] = false;
+    }
+    if ( ES_ShortTimerPoolIsRunning( Channel ) != Expected[Channel] )
+      NumErrors++;
+    RunCounter( RandomTime() * COUNTS_PER_US / 8 );
+  }
+  // let everything still running time out
+  RunCounter( (ES_SHORT_TIMER_POOL_MAX_US + 1) * COUNTS_PER_US );
+  for ( Channel = 0; Channel < NUM_SHORT_TIMER_CHANNELS; Channel++ ){
+    if ( Expected[Channel] == true )
+      Missing++;
+  }
+  if ( ES_ShortTimerPoolStart( 0, 0, ES_SHORT_TIMER_POOL_MAX_US + 1 ) ||
+       ES_ShortTimerPoolStart( NUM_SHORT_TIMER_CHANNELS, 0, 10 ) ||
+       ES_ShortTimerPoolStart( 0, NUM_SERVICES, 10 ) )
+    NumErrors++;
+
+  printf("%lu timeouts over %llu counter wraps, %lu errors, %u missing\n",
+         (unsigned long)NumTimeouts, (unsigned long long)(SimTime >> 32),
+         (unsigned long)NumErrors, Missing);
+  return ((NumErrors == 0) && (Missing == 0)) ? 0 : 1;
+}
+#endif /* SIMULATED_HW */
+/*------------------------------ End of file ------------------------------*/
@@ -1,18 +1,45 @@
+//#define TEST
 /****************************************************************************
  Module
      ES_Timers.c
 
  Description
-     This is a module implementing  8 16 bit timers all using the RTI
-     timebase
+     This is a module implementing the 16 or 32 bit (see ES_TIMER_BITS)
+     timers listed in TIMER_TABLE all using the RTI timebase
 
  Notes
      Everything is done in terms of RTI Ticks, which can change from
      application to application.
 
+     The running timers are kept in a hierarchical timing wheel rather than
+     being counted down one by one, so the work done on each tick does not
+     grow with the number of running timers. Each timer holds the tick count
+     at which it expires. A timer due within WHEEL_SLOTS ticks sits in the
+     level 0 slot for its expiry tick, one due later sits in a slot of a
+     higher level, each level covering WHEEL_SLOTS times the span of the one
+     below. Each time the level 0 index wraps, the next slot of the level
+     above is moved down (cascaded), so a timer is touched at most once per
+     level on its way to expiring.
+
+     A timer given a period with ES_Timer_SetPeriod goes back in the wheel
+     as it expires, due one period after the tick it was due on, so it keeps
+     its phase however late its service gets round to the timeout.
+
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/17/26 22:00 as       added periodic timers, reloaded from TMR_Period as
+                         they expire
+ 10/17/26 21:00 as       timer width set by ES_TIMER_BITS, with the wheel
+                         levels to match, added ES_Timer_GetTime64
+ 10/17/26 20:00 as       added ES_Timer_GetTicksToNextExpiry and
+                         ES_Timer_MultiTick_Resp for the tickless idle mode,
+                         with a host test of the idle wakeups
+ 10/17/26 19:00 as       replaced the per tick scan of the active timers with
+                         a hierarchical timing wheel
+ 10/17/26 14:00 as       timers and their post functions come from TIMER_TABLE,
+                         active flags are an array of 32 bit words so there
+                         can be any number of timers
  10/27/14 14:02 jec      moved ticking of 'time' to ES_Port to allow it to tick
                          even while blocking. required change to ES_GetTime too
  10/20/13 10:48 jec      moved definition of BITS_PER_BYTE to ES_General.h
@@ -47,7 +74,6 @@
 #include "ES_General.h"
 #include "ES_Events.h"
 #include "ES_PostList.h"
-#include "ES_LookupTables.h"
 #include "ES_Timers.h"
 #include "ES_Port.h"
 /*--------------------------- External Variables --------------------------*/
@@ -57,57 +83,80 @@
 /*------------------------------ Module Types -----------------------------*/
 
 /*
-   the size of Tflag sets the number of timers, uint8 = 8, uint16 = 16 ...)
-   to add more timers, you will need to change the data type and modify
-   the initialization of TMR_TimerArray and TMR_MaskArray
+   the wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots, enough levels
+   to cover the longest time that can be put on a timer
 */
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS ((ES_TIMER_BITS + WHEEL_BITS - 1) / WHEEL_BITS)
 
-typedef uint16_t Tflag_t;
+// the slot a timer expiring at Expiry sits in at a given level
+#define WHEEL_INDEX(Expiry, Level) \
+          (((Expiry) >> ((Level) * WHEEL_BITS)) & WHEEL_MASK)
 
-typedef uint16_t Timer_t; // sets size of timers to 16 bits
+// marks the end of a slot's list, and a timer not in the wheel
+#define TMR_NONE 0xFF
 
+typedef ES_TimerTime_t Timer_t; // sets size of timers, by ES_TIMER_BITS
+
+// the wheel must reach the longest time that fits in a Timer_t
+typedef char WheelSpanCheck[((WHEEL_BITS * WHEEL_LEVELS) >=
+                             (sizeof(Timer_t) * 8)) ? 1 : -1];
+// and the timer numbers must not run into TMR_NONE
+typedef char TimerCountCheck[(NUM_TIMERS < TMR_NONE) ? 1 : -1];
 
 /*---------------------------- Module Functions ---------------------------*/
+static void LinkTimer(uint8_t Num);
+static void UnlinkTimer(uint8_t Num);
+static void CascadeSlot(uint8_t Level);
+static void SkipTicks(uint32_t NumTicks);
 
 /*---------------------------- Module Variables ---------------------------*/
-static Timer_t TMR_TimerArray[sizeof(Tflag_t)*BITS_PER_BYTE]=
-                                            { 0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0, 
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0,
-                                              0x0 };
-
-static Tflag_t TMR_ActiveFlags;
-
-static pPostFunc const Timer2PostFunc[sizeof(Tflag_t)*BITS_PER_BYTE] = 
-                                            { TIMER0_RESP_FUNC,
-                                              TIMER1_RESP_FUNC,
-                                              TIMER2_RESP_FUNC,
-                                              TIMER3_RESP_FUNC,
-                                              TIMER4_RESP_FUNC,
-                                              TIMER5_RESP_FUNC,
-                                              TIMER6_RESP_FUNC,
-                                              TIMER7_RESP_FUNC, 
-                                              TIMER8_RESP_FUNC,
-                                              TIMER9_RESP_FUNC,
-                                              TIMER10_RESP_FUNC,
-                                              TIMER11_RESP_FUNC,
-                                              TIMER12_RESP_FUNC,
-                                              TIMER13_RESP_FUNC,
-                                              TIMER14_RESP_FUNC,
-                                              TIMER15_RESP_FUNC
-                                              };
+// the time set on each timer, or the time it had left when it was stopped
+static Timer_t TMR_TimerArray[NUM_TIMERS];
+
+// the period that a timer is reloaded with as it expires, 0 for one shot
+static Timer_t TMR_Period[NUM_TIMERS];
+
+// for running timers, the tick count when the timer expires
+static uint32_t TMR_Expiry[NUM_TIMERS];
+
+// the level of the wheel that a timer is in, TMR_NONE when not running
+static uint8_t TMR_Level[NUM_TIMERS];
+
+// each slot is a doubly linked list of timer numbers
+static uint8_t TMR_Next[NUM_TIMERS];
+static uint8_t TMR_Prev[NUM_TIMERS];
+static uint8_t TMR_Wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+// number of ticks processed by ES_Timer_Tick_Resp
+static uint32_t TMR_Now;
+
+// prototypes for the post functions named in TIMER_TABLE
+#define ES_TIMER( Name, PostFunc ) PostFunc_t PostFunc;
+#define ES_TIMER_UNUSED( Name )
+TIMER_TABLE
+#undef ES_TIMER
+#undef ES_TIMER_UNUSED
+
+#if defined(TEST) && defined(ES_HOST_PORT)
+// the test harness takes every timeout itself
+static bool TestPost(ES_Event ThisEvent);
+#endif
+
+static pPostFunc const Timer2PostFunc[NUM_TIMERS] = {
+#if defined(TEST) && defined(ES_HOST_PORT)
+#define ES_TIMER( Name, PostFunc ) TestPost,
+#define ES_TIMER_UNUSED( Name ) TestPost,
+#else
+#define ES_TIMER( Name, PostFunc ) PostFunc,
+#define ES_TIMER_UNUSED( Name ) TIMER_UNUSED,
+#endif
+  TIMER_TABLE
+#undef ES_TIMER
+#undef ES_TIMER_UNUSED
+};
   
 
 /*------------------------------ Module Code ------------------------------*/
@@ -129,6 +178,20 @@ static pPostFunc const Timer2PostFunc[sizeof(Tflag_t)*BITS_PER_BYTE] =
 ****************************************************************************/
 void ES_Timer_Init(TimerRate_t Rate)
 {
+   uint8_t i;
+   uint8_t Level;
+
+   // empty the wheel, with every timer stopped
+   for( Level = 0; Level < WHEEL_LEVELS; Level++ )
+      for( i = 0; i < WHEEL_SLOTS; i++ )
+         TMR_Wheel[Level][i] = TMR_NONE;
+   for( i = 0; i < NUM_TIMERS; i++ )
+   {
+      TMR_TimerArray[i] = 0;
+      TMR_Period[i] = 0;
+      TMR_Level[i] = TMR_NONE;
+   }
+   TMR_Now = 0;
    // call the hardware init routine
    _HW_Timer_Init(Rate);
 }
@@ -138,18 +201,19 @@ void ES_Timer_Init(TimerRate_t Rate)
      ES_Timer_SetTimer
  Parameters
      unsigned char Num, the number of the timer to set.
-     unsigned int NewTime, the new time to set on that timer
+     ES_TimerTime_t NewTime, the new time to set on that timer
  Returns
      ES_Timer_ERR if requested timer does not exist or has no service 
      ES_Timer_OK  otherwise
  Description
      sets the time for a timer, but does not make it active.
  Notes
-     None.
+     As when the timers were counted down in place, setting the time on a
+     running timer restarts it with the new time.
  Author
      J. Edward Carryer, 02/24/97 17:11
 ****************************************************************************/
-ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, uint16_t NewTime)
+ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, ES_TimerTime_t NewTime)
 {
    /* tried to set a timer that doesn't exist */
    if( (Num >= ARRAY_SIZE(TMR_TimerArray)) ||
@@ -158,6 +222,12 @@ ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, uint16_t NewTime)
        (NewTime == 0) ) /* no time being set */
       return ES_Timer_ERR;  
    TMR_TimerArray[Num] = NewTime;
+   if( TMR_Level[Num] != TMR_NONE )
+   {
+      UnlinkTimer(Num);
+      TMR_Expiry[Num] = TMR_Now + NewTime;
+      LinkTimer(Num);
+   }
    return ES_Timer_OK;
 }
 
@@ -169,8 +239,8 @@ ES_TimerReturn_t ES_Timer_SetTimer(uint8_t Num, uint16_t NewTime)
  Returns
      ES_Timer_ERR for error ES_Timer_OK for success
  Description
-     simply sets the active flag in TMR_ActiveFlags to (re)start a
-     stopped timer.
+     puts a stopped timer back in the wheel, to run for the rest of its
+     time. Starting a running timer has no effect.
  Notes
      None.
  Author
@@ -183,7 +253,11 @@ ES_TimerReturn_t ES_Timer_StartTimer(uint8_t Num)
        /* tried to set a timer with no time on it */
        (TMR_TimerArray[Num] == 0) )
       return ES_Timer_ERR;  
-   TMR_ActiveFlags |= BitNum2SetMask[Num]; /* set timer as active */
+   if( TMR_Level[Num] == TMR_NONE ) /* set timer as active */
+   {
+      TMR_Expiry[Num] = TMR_Now + TMR_TimerArray[Num];
+      LinkTimer(Num);
+   }
    return ES_Timer_OK;
 }
 
@@ -195,8 +269,8 @@ ES_TimerReturn_t ES_Timer_StartTimer(uint8_t Num)
  Returns
      ES_Timer_ERR for error (timer doesn't exist) ES_Timer_OK for success.
  Description
-     simply clears the bit in TMR_ActiveFlags associated with this
-     timer. This will cause it to stop counting.
+     takes the timer out of the wheel, keeping the time it had left so
+     that ES_Timer_StartTimer can carry on from there.
  Notes
      None.
  Author
@@ -206,7 +280,11 @@ ES_TimerReturn_t ES_Timer_StopTimer(uint8_t Num)
 {
    if( Num >= ARRAY_SIZE(TMR_TimerArray) )
       return ES_Timer_ERR;  /* tried to set a timer that doesn't exist */
-   TMR_ActiveFlags &= BitNum2ClrMask[Num]; /* set timer as inactive */
+   if( TMR_Level[Num] != TMR_NONE ) /* set timer as inactive */
+   {
+      UnlinkTimer(Num);
+      TMR_TimerArray[Num] = (Timer_t)(TMR_Expiry[Num] - TMR_Now);
+   }
    return ES_Timer_OK;
 }
 
@@ -215,7 +293,7 @@ ES_TimerReturn_t ES_Timer_StopTimer(uint8_t Num)
      ES_Timer_InitTimer
  Parameters
      unsigned char Num, the number of the timer to start
-     unsigned int NewTime, the number of ticks to be counted
+     ES_TimerTime_t NewTime, the number of ticks to be counted
  Returns
      ES_Timer_ERR if the requested timer does not exist, ES_Timer_OK otherwise.
  Description
@@ -226,7 +304,7 @@ ES_TimerReturn_t ES_Timer_StopTimer(uint8_t Num)
  Author
      J. Edward Carryer, 02/24/97 14:51
 ****************************************************************************/
-ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, uint16_t NewTime)
+ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, ES_TimerTime_t NewTime)
 {
    /* tried to set a timer that doesn't exist */
    if( (Num >= ARRAY_SIZE(TMR_TimerArray)) ||
@@ -236,10 +314,69 @@ ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, uint16_t NewTime)
        (NewTime == 0) )
       return ES_Timer_ERR;  
    TMR_TimerArray[Num] = NewTime;
-   TMR_ActiveFlags |= BitNum2SetMask[Num]; /* set timer as active */
+   if( TMR_Level[Num] != TMR_NONE )
+      UnlinkTimer(Num);
+   TMR_Expiry[Num] = TMR_Now + NewTime;
+   LinkTimer(Num); /* set timer as active */
    return ES_Timer_OK;
 }
 
+/****************************************************************************
+ Function
+     ES_Timer_SetPeriod
+ Parameters
+     unsigned char Num, the number of the timer
+     ES_TimerTime_t Period, the time to reload the timer with each time it
+     expires, 0 to go back to a one shot timer
+ Returns
+     ES_Timer_ERR if requested timer does not exist or has no service 
+     ES_Timer_OK  otherwise
+ Description
+     makes a timer periodic. Its time until the first timeout is still set
+     by ES_Timer_InitTimer or ES_Timer_SetTimer & ES_Timer_StartTimer, and it
+     then times out every Period ticks until it is stopped.
+ Notes
+     The reload is done in ES_Timer_Tick_Resp, from the tick the timer was
+     due on, so the period does not stretch by the time it takes the service
+     to respond to the timeout. Changing the period of a running timer takes
+     effect from its next timeout.
+ Author
+     as, 10/17/26 22:00
+****************************************************************************/
+ES_TimerReturn_t ES_Timer_SetPeriod(uint8_t Num, ES_TimerTime_t Period)
+{
+   /* tried to set a timer that doesn't exist */
+   if( (Num >= ARRAY_SIZE(TMR_TimerArray)) ||
+   /* tried to set a timer without a service */
+       (Timer2PostFunc[Num] == TIMER_UNUSED) )
+      return ES_Timer_ERR;
+   TMR_Period[Num] = Period;
+   return ES_Timer_OK;
+}
+
+/****************************************************************************
+ Function
+     ES_Timer_InitPeriodicTimer
+ Parameters
+     unsigned char Num, the number of the timer to start
+     ES_TimerTime_t Period, the number of ticks between timeouts
+ Returns
+     ES_Timer_ERR if requested timer does not exist, has no service or
+     Period is 0, ES_Timer_OK  otherwise
+ Description
+     starts a timer that times out every Period ticks, the first Period
+     ticks from now, until it is stopped
+ Notes
+     None.
+ Author
+     as, 10/17/26 22:00
+****************************************************************************/
+ES_TimerReturn_t ES_Timer_InitPeriodicTimer(uint8_t Num, ES_TimerTime_t Period)
+{
+   if( (Period == 0) || (ES_Timer_SetPeriod(Num, Period) != ES_Timer_OK) )
+      return ES_Timer_ERR;
+   return ES_Timer_InitTimer(Num, Period);
+}
 
 /****************************************************************************
  Function
@@ -257,9 +394,28 @@ ES_TimerReturn_t ES_Timer_InitTimer(uint8_t Num, uint16_t NewTime)
  Author
      J. Edward Carryer, 06/01/04 08:04
 ****************************************************************************/
-uint16_t ES_Timer_GetTime(void)
+ES_TimerTime_t ES_Timer_GetTime(void)
 {
-   return (_HW_GetTickCount());
+   return ((ES_TimerTime_t)_HW_GetTickCount());
+}
+
+/****************************************************************************
+ Function
+     ES_Timer_GetTime64
+ Parameters
+     None.
+ Returns
+     uint64_t the number of ticks since the timer module was initialized
+ Description
+     The same time as ES_Timer_GetTime, but wide enough that it never wraps
+     in practice, for time stamps that must be compared across long runs.
+ Notes
+ Author
+     as, 10/17/26 21:00
+****************************************************************************/
+uint64_t ES_Timer_GetTime64(void)
+{
+   return (_HW_GetTickCount64());
 }
 
 /****************************************************************************
@@ -271,45 +427,302 @@ uint16_t ES_Timer_GetTime(void)
      None.
  Description
      This is the new Tick response routine to support the timer module.
-     It will increment time, to maintain the functionality of the
-     GetTime() timer and it will check through the active timers,
-     decrementing each active timers count, if the count goes to 0, it
-     will post an event to the corresponding SM and clear the active flag to
-     prevent further counting.
+     It advances the wheel by one tick, posting an ES_TIMEOUT event to the
+     corresponding SM for every timer that expires on this tick and taking
+     it out of the wheel to prevent further counting, or putting it back in
+     for its next period if it is periodic.
  Notes
      Called from _Timer_Int_Resp in ES_Port.c.
+     The work is the cascade of at most one slot per level, plus the timers
+     that actually expire, however many timers are running.
  Author
      J. Edward Carryer, 02/24/97 15:06
 ****************************************************************************/
 void ES_Timer_Tick_Resp(void)
 {
-	static Tflag_t NeedsProcessing;
-	static uint8_t NextTimer2Process;
+	static uint8_t Level;
+	static uint8_t Slot;
+	static uint8_t ExpiredTimer;
 	static ES_Event NewEvent;
 
-	if (TMR_ActiveFlags != 0) /* if !=0 , then at least 1 timer is active */
+	TMR_Now++;
+	// when the low bits wrap, move the next slot of each level above down,
+	// working from the highest level that wrapped
+	for (Level = 1; (Level < WHEEL_LEVELS) &&
+	     (WHEEL_INDEX(TMR_Now, Level - 1) == 0); Level++)
+		;
+	while (--Level > 0)
+		CascadeSlot(Level);
+
+	// everything left in this level 0 slot expires now. Take each one off
+	// before posting, so the post function may restart any timer
+	Slot = WHEEL_INDEX(TMR_Now, 0);
+	while ((ExpiredTimer = TMR_Wheel[0][Slot]) != TMR_NONE)
 	{
-		// start by getting a list of all the active timers
-		NeedsProcessing = TMR_ActiveFlags;
-		do{
-			// find the MSB that is set
-			NextTimer2Process = ES_GetMSBitSet(NeedsProcessing);
-			/* decrement that timer, check if timed out */
-			if(--TMR_TimerArray[NextTimer2Process] == 0)
+		UnlinkTimer(ExpiredTimer);
+		if (TMR_Period[ExpiredTimer] != 0)
+		{
+			// periodic, due again one period on from this tick. A period is
+			// at least one tick, so it cannot land back in this slot
+			TMR_TimerArray[ExpiredTimer] = TMR_Period[ExpiredTimer];
+			TMR_Expiry[ExpiredTimer] += TMR_Period[ExpiredTimer];
+			LinkTimer(ExpiredTimer);
+		}else
+		{
+			TMR_TimerArray[ExpiredTimer] = 0;
+		}
+		NewEvent.EventType = ES_TIMEOUT;
+		NewEvent.EventParam = ExpiredTimer;
+		/* post the timeout event to the right Service */
+		Timer2PostFunc[ExpiredTimer](NewEvent);
+	}
+}
+
+/****************************************************************************
+ Function
+     ES_Timer_MultiTick_Resp
+ Parameters
+     uint32_t NumTicks, the number of ticks that have passed
+ Returns
+     None.
+ Description
+     the tick response for several ticks at once, as after the core has
+     slept through them in the tickless idle mode.
+ Notes
+     Any run of ticks in which no timer expires is taken in a single step,
+     so the cost does not grow with the length of the sleep.
+ Author
+     as, 10/17/26 20:00
+****************************************************************************/
+void ES_Timer_MultiTick_Resp(uint32_t NumTicks)
+{
+	uint32_t Skip;
+
+	while (NumTicks > 0)
+	{
+		if (NumTicks > 1)
+		{
+			// the ticks before the next expiry need no response
+			Skip = ES_Timer_GetTicksToNextExpiry() - 1;
+			if (Skip >= NumTicks)
+				Skip = NumTicks - 1;
+			if (Skip > 0)
 			{
-				NewEvent.EventType = ES_TIMEOUT;
-				NewEvent.EventParam = NextTimer2Process;
-				/* post the timeout event to the right Service */
-				Timer2PostFunc[NextTimer2Process](NewEvent);
-				/* and stop counting */
-				TMR_ActiveFlags &= BitNum2ClrMask[NextTimer2Process];
+				SkipTicks(Skip);
+				NumTicks -= Skip;
 			}
-			// mark off the active timer that we just processed
-			NeedsProcessing &= BitNum2ClrMask[NextTimer2Process];
-		}while(NeedsProcessing != 0);
-      
+		}
+		ES_Timer_Tick_Resp();
+		NumTicks--;
+	}
+}
+
+/****************************************************************************
+ Function
+     ES_Timer_GetTicksToNextExpiry
+ Parameters
+     None.
+ Returns
+     uint32_t the number of ticks until the next running timer expires,
+     ES_TIMER_NO_EXPIRY if no timer is running
+ Description
+     lets the port sleep through the ticks on which nothing would happen
+ Notes
+     The slots of each level expire in order, starting with the one after
+     the current slot, so only the first occupied slot of each level needs
+     to be looked at.
+ Author
+     as, 10/17/26 20:00
+****************************************************************************/
+uint32_t ES_Timer_GetTicksToNextExpiry(void)
+{
+	uint32_t Soonest = ES_TIMER_NO_EXPIRY;
+	uint32_t Delta;
+	uint8_t Level;
+	uint8_t Step;
+	uint8_t Slot = 0;
+	uint8_t Num;
+
+	for (Level = 0; Level < WHEEL_LEVELS; Level++)
+	{
+		for (Step = 1; Step <= WHEEL_SLOTS; Step++)
+		{
+			Slot = (WHEEL_INDEX(TMR_Now, Level) + Step) & WHEEL_MASK;
+			if (TMR_Wheel[Level][Slot] != TMR_NONE)
+				break;
+		}
+		if (Step > WHEEL_SLOTS) /* nothing running at this level */
+			continue;
+		for (Num = TMR_Wheel[Level][Slot]; Num != TMR_NONE; Num = TMR_Next[Num])
+		{
+			Delta = TMR_Expiry[Num] - TMR_Now;
+			if (Delta < Soonest)
+				Soonest = Delta;
+		}
+	}
+	return Soonest;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// puts a timer in the wheel, on the lowest level that reaches its expiry
+static void LinkTimer(uint8_t Num)
+{
+	uint32_t Delta = TMR_Expiry[Num] - TMR_Now;
+	uint8_t Level = 0;
+	uint8_t Slot;
+
+	while ((Level < (WHEEL_LEVELS - 1)) &&
+	       (Delta >= (1UL << ((Level + 1) * WHEEL_BITS))))
+		Level++;
+	Slot = WHEEL_INDEX(TMR_Expiry[Num], Level);
+	TMR_Level[Num] = Level;
+	TMR_Prev[Num] = TMR_NONE;
+	TMR_Next[Num] = TMR_Wheel[Level][Slot];
+	if (TMR_Next[Num] != TMR_NONE)
+		TMR_Prev[TMR_Next[Num]] = Num;
+	TMR_Wheel[Level][Slot] = Num;
+}
+
+// takes a timer out of the wheel, leaving it stopped
+static void UnlinkTimer(uint8_t Num)
+{
+	uint8_t Level = TMR_Level[Num];
+
+	if (TMR_Prev[Num] != TMR_NONE)
+		TMR_Next[TMR_Prev[Num]] = TMR_Next[Num];
+	else
+		TMR_Wheel[Level][WHEEL_INDEX(TMR_Expiry[Num], Level)] = TMR_Next[Num];
+	if (TMR_Next[Num] != TMR_NONE)
+		TMR_Prev[TMR_Next[Num]] = TMR_Prev[Num];
+	TMR_Level[Num] = TMR_NONE;
+}
+
+// moves time on by NumTicks, in which no timer may expire, and re-files the
+// running timers for the new time
+static void SkipTicks(uint32_t NumTicks)
+{
+	uint8_t Num;
+
+	TMR_Now += NumTicks;
+	for (Num = 0; Num < NUM_TIMERS; Num++)
+	{
+		if (TMR_Level[Num] != TMR_NONE)
+		{
+			UnlinkTimer(Num);
+			LinkTimer(Num);
+		}
+	}
+}
+
+// re-files the timers in the current slot of a level, which are now close
+// enough to their expiry for a lower level
+static void CascadeSlot(uint8_t Level)
+{
+	uint8_t Slot = WHEEL_INDEX(TMR_Now, Level);
+	uint8_t Num;
+
+	while ((Num = TMR_Wheel[Level][Slot]) != TMR_NONE)
+	{
+		UnlinkTimer(Num);
+		LinkTimer(Num);
 	}
 }
+/***************************************************************************
+ Test Harness: host count of the idle wakeups under a typical timer load,
+ with a mix of periodic and restarted timers. Build it with ES_Port_Host.c
+ and the framework, once with ES_TICKLESS_IDLE set and once without, to
+ compare. With the EVENT_CHECK_TABLE as shipped, Check4Keystroke every
+ 10mS, expect 1000 wakeups/s without and 100/s with it set.
+ ***************************************************************************/
+#if defined(TEST) && defined(ES_HOST_PORT)
+#include <stdio.h>
+
+#define TEST_TICKS 600000UL  // ten minutes at the 1mS rate
+
+// a typical load, a status blink, a sensor poll, a button debounce, a
+// heartbeat, a slow retry and a supervision timeout, handed out to the
+// timers in TIMER_TABLE in turn. With 32 bit timers the first is a courtesy
+// lamp timeout, longer than a 16 bit timer can reach.
+static const ES_TimerTime_t LoadPeriods[] = {
+#if ES_TIMER_BITS == 32
+	90000UL,
+#endif
+	500, 100, 20, 1000, 250, 5000 };
+
+static uint32_t DueTime[NUM_TIMERS];
+static uint32_t NumTimeouts;
+static uint32_t NumLate;
+
+#define LOAD_PERIOD(Num) LoadPeriods[(Num) % ARRAY_SIZE(LoadPeriods)]
+
+// the even numbered timers are periodic, the odd ones are restarted by
+// TestPost as a service would
+static void ArmTimer(uint8_t Num)
+{
+	DueTime[Num] = ES_Host_GetVirtualTime() + LOAD_PERIOD(Num);
+	if ((Num % 2) == 0)
+		ES_Timer_InitPeriodicTimer(Num, LOAD_PERIOD(Num));
+	else
+		ES_Timer_InitTimer(Num, LOAD_PERIOD(Num));
+}
+
+// every timeout must come on the tick it was due
+static bool TestPost(ES_Event ThisEvent)
+{
+	uint8_t Num = (uint8_t)ThisEvent.EventParam;
+
+	NumTimeouts++;
+	if (ES_Host_GetVirtualTime() != DueTime[Num])
+		NumLate++;
+	if ((Num % 2) == 0)
+		DueTime[Num] += LOAD_PERIOD(Num);
+	else
+		ArmTimer(Num);
+	return true;
+}
+
+int main(void)
+{
+	uint8_t i;
+	bool TimeOK;
+
+	printf("ES_Timers idle wakeup test, %u bit timers, tickless idle %s\n",
+	       ES_TIMER_BITS, ES_TICKLESS_IDLE ? "on" : "off");
+	ES_Timer_Init(ES_Timer_RATE_1mS);
+	for (i = 0; i < NUM_TIMERS; i++)
+		ArmTimer(i);
+
+	// play the part of an idle ES_Run. The checkers must have their pass,
+	// as _HW_Idle sleeps no longer than the next polled checker is due
+	while (ES_Host_GetVirtualTime() < TEST_TICKS)
+	{
+		_HW_Process_Pending_Ints();
+#if ES_TICKLESS_IDLE
+		if (ES_CheckUserEvents() != true)
+			_HW_Idle();
+#else
+		ES_CheckUserEvents();
+#endif
+	}
+	_HW_Process_Pending_Ints();  // for the timers due on the last tick
+	TimeOK = (ES_Timer_GetTime() == (ES_TimerTime_t)ES_Host_GetVirtualTime()) &&
+	         (ES_Timer_GetTime64() == ES_Host_GetVirtualTime()) &&
+	         ES_Timer_IsAfter(ES_Timer_GetTime(), ES_Host_GetVirtualTime() - 1) &&
+	         (ES_Timer_GetElapsed(ES_Host_GetVirtualTime() - 20) == 20);
+
+	printf("%lu timers, %lu ticks, %lu timeouts (%lu late)\n",
+	       (unsigned long)NUM_TIMERS, (unsigned long)ES_Host_GetVirtualTime(),
+	       (unsigned long)NumTimeouts, (unsigned long)NumLate);
+	printf("%lu wakeups, %.1f per second, ES_Timer_GetTime %s\n",
+	       (unsigned long)ES_Host_GetWakeups(),
+	       ES_Host_GetWakeups() * 1000.0 / ES_Host_GetVirtualTime(),
+	       TimeOK ? "in step" : "WRONG");
+	return ((NumLate == 0) && TimeOK) ? 0 : 1;
+}
+#endif /* TEST */
+
 /*------------------------------- Footnotes -------------------------------*/
 /*------------------------------ End of file ------------------------------*/
 
@@ -0,0 +1,314 @@
+//#define TEST
+/****************************************************************************
+ Module
+     ES_Trace.c
+ Description
+     The event trace buffer: a ring of records of the posts and dispatches
+     made by the framework, for post-mortem analysis.
+ Notes
+     The trace is lossy on purpose. Recording never waits and never fails,
+     when the ring is full the oldest record is overwritten, and the reader
+     is told how many it missed with an ES_TRACE_LOST record.
+
+     Records can come from ISRs as well as ES_Run, so each one is written
+     with interrupts off. That is a dozen stores, about the cost of a post.
+     The counts are free running uint32_t, masked by ES_TRACE_SIZE - 1, which
+     must be a power of two no larger than 32768.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/18/26 10:00 as      started coding
+*****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+#include "ES_Trace.h"
+#ifdef ES_HOST_PORT
+#include <stdio.h>
+#else
+#include "termio.h"
+#endif
+
+#if ES_TRACE_SIZE > 0
+/*----------------------------- Module Defines ----------------------------*/
+#define TRACE_INDEX_MASK (ES_TRACE_SIZE - 1)
+
+#if ((ES_TRACE_SIZE & TRACE_INDEX_MASK) != 0) || (ES_TRACE_SIZE > 32768)
+#error ES_TRACE_SIZE must be a power of two no larger than 32768
+#endif
+
+// the raw bytes of the dump go to the console UART, with no newline mapping
+#ifdef ES_HOST_PORT
+#define PutTraceByte( Byte ) putchar( Byte )
+#else
+#define PutTraceByte( Byte ) TERMIO_PutChar( Byte )
+#endif
+
+typedef struct {
+  uint32_t Time;
+  uint16_t EventParam;
+  uint16_t Sequence;
+  uint8_t EventType;
+  uint8_t Kind;
+  uint8_t Source;
+  uint8_t Target;
+} TraceEntry_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static void EncodeEntry( TraceEntry_t const * pEntry, uint8_t * pDest );
+
+/*---------------------------- Module Variables ---------------------------*/
+uint8_t ES_TraceSource = ES_TRACE_SOURCE_NONE;
+
+static TraceEntry_t Entries[ES_TRACE_SIZE];
+static uint32_t NumWritten;   // records ever made
+static uint32_t NumRead;      // records ever read or skipped over
+static bool Enabled;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+   ES_TraceInit
+ Parameters
+   None
+ Returns
+   None
+ Description
+   empties the trace and starts the cycle counter, called by ES_Initialize
+ Notes
+
+ Author
+   as, 10/18/26, 10:00
+****************************************************************************/
+void ES_TraceInit( void ){
+  ES_InitCycleCounter();
+  NumWritten = 0;
+  NumRead = 0;
+  ES_TraceSource = ES_TRACE_SOURCE_NONE;
+  Enabled = true;
+}
+
+/****************************************************************************
+ Function
+   ES_TraceRecord
+ Parameters
+   uint8_t Kind : one of the ES_TRACE_ kinds
+   uint8_t Target : the service that the event is for
+   ES_Event ThisEvent : the event
+ Returns
+   None
+ Description
+   adds a record to the trace, overwriting the oldest if it is full
+ Notes
+   may be called from an ISR
+ Author
+   as, 10/18/26, 10:00
+****************************************************************************/
+void ES_TraceRecord( uint8_t Kind, uint8_t Target, ES_Event ThisEvent ){
+  TraceEntry_t * pEntry;
+
+  if ( Enabled != true )
+    return;
+  EnterCritical();
+  pEntry = &Entries[NumWritten & TRACE_INDEX_MASK];
+  pEntry->Time = ES_ReadCycleCounter();
+  pEntry->EventParam = ThisEvent.EventParam;
+  pEntry->Sequence = (uint16_t)NumWritten;
+  pEntry->EventType = (uint8_t)ThisEvent.EventType;
+  pEntry->Kind = Kind;
+  pEntry->Source = ES_TraceSource;
+  pEntry->Target = Target;
+  NumWritten++;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+   ES_TraceEnable
+ Parameters
+   bool Enable : false to freeze the trace, true to carry on
+ Returns
+   None
+ Description
+   see ES_Trace.h
+ Notes
+
+ Author
+   as, 10/18/26, 10:00
+****************************************************************************/
+void ES_TraceEnable( bool Enable ){
+  Enabled = Enable;
+}
+
+/****************************************************************************
+ Function
+   ES_TraceRead
+ Parameters
+   uint8_t * pDest : where to put the records
+   uint16_t MaxBytes : the room at pDest
+ Returns
+   uint16_t : the number of bytes written, a whole number of records
+ Description
+   moves the oldest unread records out in the binary form
+ Notes
+   Call it from ES_Run's side only. Each record is copied with interrupts
+   off, so a post from an ISR can not overwrite it half way through.
+ Author
+   as, 10/18/26, 10:00
+****************************************************************************/
+uint16_t ES_TraceRead( uint8_t * pDest, uint16_t MaxBytes ){
+  TraceEntry_t ThisEntry;
+  uint32_t NumLost;
+  uint16_t NumBytes = 0;
+
+  while ( (MaxBytes - NumBytes) >= ES_TRACE_RECORD_BYTES ){
+    EnterCritical();
+    NumLost = 0;
+    if ( (NumWritten - NumRead) > ES_TRACE_SIZE ){
+      // the writers have lapped us, skip to the oldest record still held
+      NumLost = (NumWritten - NumRead) - ES_TRACE_SIZE;
+      NumRead = NumWritten - ES_TRACE_SIZE;
+    }
+    if ( NumLost != 0 ){
+      // dated with the oldest record held, to keep the records in time order
+      ThisEntry.Time = Entries[NumRead & TRACE_INDEX_MASK].Time;
+      ThisEntry.EventParam = (NumLost > 0xFFFF) ? 0xFFFF : (uint16_t)NumLost;
+      ThisEntry.Sequence = (uint16_t)NumRead;
+      ThisEntry.EventType = ES_NO_EVENT;
+      ThisEntry.Kind = ES_TRACE_LOST;
+      ThisEntry.Source = ES_TRACE_SOURCE_NONE;
+      ThisEntry.Target = ES_TRACE_SOURCE_NONE;
+    }else if ( NumRead != NumWritten ){
+      ThisEntry = Entries[NumRead & TRACE_INDEX_MASK];
+      NumRead++;
+    }else{
+      ExitCritical();
+      break;    // all read
+    }
+    ExitCritical();
+    EncodeEntry( &ThisEntry, pDest + NumBytes );
+    NumBytes += ES_TRACE_RECORD_BYTES;
+  }
+  return NumBytes;
+}
+
+/****************************************************************************
+ Function
+   ES_TraceDump
+ Parameters
+   None
+ Returns
+   None
+ Description
+   sends every unread record out of the console UART as one frame
+ Notes
+   Slow, the trace is frozen while it runs so that the count in the header
+   stays right. Records made by ISRs meanwhile are not kept.
+ Author
+   as, 10/18/26, 10:00
+****************************************************************************/
+void ES_TraceDump( void ){
+  uint8_t Record[ES_TRACE_RECORD_BYTES];
+  uint32_t NumRecords;
+  bool WasEnabled = Enabled;
+  uint8_t i;
+
+  Enabled = false;
+  EnterCritical();
+  NumRecords = NumWritten - NumRead;
+  ExitCritical();
+  if ( NumRecords > ES_TRACE_SIZE )
+    NumRecords = ES_TRACE_SIZE + 1;   // the oldest held, and the lost record
+  for ( i = 0; i < sizeof(ES_TRACE_MAGIC) - 1; i++ )
+    PutTraceByte( ES_TRACE_MAGIC[i] );
+  PutTraceByte( ES_TRACE_VERSION );
+  PutTraceByte( ES_TRACE_RECORD_BYTES );
+  PutTraceByte( (uint8_t)NumRecords );
+  PutTraceByte( (uint8_t)(NumRecords >> 8) );
+  while ( ES_TraceRead( Record, sizeof(Record) ) != 0 ){
+    for ( i = 0; i < sizeof(Record); i++ )
+      PutTraceByte( Record[i] );
+  }
+  Enabled = WasEnabled;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// writes an entry out in the little endian binary form
+static void EncodeEntry( TraceEntry_t const * pEntry, uint8_t * pDest ){
+  pDest[0] = (uint8_t)pEntry->Time;
+  pDest[1] = (uint8_t)(pEntry->Time >> 8);
+  pDest[2] = (uint8_t)(pEntry->Time >> 16);
+  pDest[3] = (uint8_t)(pEntry->Time >> 24);
+  pDest[4] = (uint8_t)pEntry->EventParam;
+  pDest[5] = (uint8_t)(pEntry->EventParam >> 8);
+  pDest[6] = (uint8_t)pEntry->Sequence;
+  pDest[7] = (uint8_t)(pEntry->Sequence >> 8);
+  pDest[8] = pEntry->EventType;
+  pDest[9] = pEntry->Kind;
+  pDest[10] = pEntry->Source;
+  pDest[11] = pEntry->Target;
+}
+
+/***************************************************************************
+ Test Harness: host check of the wrap & lost record handling, the trace it
+ dumps to stdout can be fed to ES_TraceDecode
+ ***************************************************************************/
+#if defined(TEST) && defined(ES_HOST_PORT)
+int main( void ){
+  ES_Event ThisEvent;
+  uint8_t Buffer[4 * ES_TRACE_RECORD_BYTES];
+  uint16_t NumBytes;
+  uint32_t i;
+  uint32_t Errors = 0;
+
+  ES_TraceInit();
+  // fill it less than full, everything must come back in order
+  ThisEvent.EventType = ES_TIMEOUT;
+  for ( i = 0; i < 3; i++ ){
+    ThisEvent.EventParam = (uint16_t)i;
+    ES_TRACE( ES_TRACE_POST, 0, ThisEvent );
+  }
+  NumBytes = ES_TraceRead( Buffer, sizeof(Buffer) );
+  if ( (NumBytes != 3 * ES_TRACE_RECORD_BYTES) || (Buffer[4] != 0) ||
+       (Buffer[ES_TRACE_RECORD_BYTES * 2 + 4] != 2) )
+    Errors++;
+
+  // overflow it, the first record read must report the loss
+  for ( i = 0; i < ES_TRACE_SIZE + 5; i++ ){
+    ThisEvent.EventParam = (uint16_t)i;
+    ES_TRACE( ES_TRACE_POST, 1, ThisEvent );
+  }
+  NumBytes = ES_TraceRead( Buffer, 2 * ES_TRACE_RECORD_BYTES );
+  if ( (NumBytes != 2 * ES_TRACE_RECORD_BYTES) ||
+       (Buffer[9] != ES_TRACE_LOST) || (Buffer[4] != 5) ||
+       (Buffer[ES_TRACE_RECORD_BYTES + 4] != 5) )
+    Errors++;
+
+  // and a frozen trace takes nothing
+  ES_TraceEnable( false );
+  ES_TRACE( ES_TRACE_POST, 1, ThisEvent );
+  ES_TraceEnable( true );
+
+  // a timeline for the decoder: posts to 2 services, dispatched in turn
+  ES_TraceInit();
+  for ( i = 0; i < 8; i++ ){
+    ThisEvent.EventParam = (uint16_t)i;
+    ES_TRACE_SET_SOURCE( ES_TRACE_SOURCE_ISR(0) );
+    ES_TRACE( ES_TRACE_POST, (uint8_t)(i & 1), ThisEvent );
+    ES_TRACE_SET_SOURCE( (uint8_t)(i & 1) );
+    ES_TRACE( ES_TRACE_DISPATCH, (uint8_t)(i & 1), ThisEvent );
+  }
+  ES_TRACE_SET_SOURCE( ES_TRACE_SOURCE_NONE );
+  ES_TraceDump();
+  fflush( stdout );
+
+  fprintf( stderr, "ES_Trace test %s\n", (Errors == 0) ? "passed" : "FAILED" );
+  return (Errors == 0) ? 0 : 1;
+}
+#endif /* TEST */
+
+#endif /* ES_TRACE_SIZE > 0 */
+/*------------------------------ End of file ------------------------------*/
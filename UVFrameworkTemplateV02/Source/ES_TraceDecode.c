@@ -0,0 +1,367 @@
+/****************************************************************************
+ Module
+     ES_TraceDecode.c
+ Description
+     Host (PC) program that decodes the binary event trace from ES_Trace.c
+     into a listing of every record and a timeline for each service.
+ Notes
+     Not part of the target build. Build it on the PC with e.g.:
+       gcc -std=gnu99 -O2 -DES_HOST_PORT -IHeaders -I"TIVA Code"
+           Source/ES_TraceDecode.c -o ES_TraceDecode
+     and run it on a capture of the console UART after ES_TraceDump:
+       ES_TraceDecode [-c cycles_per_uS] [-r] [capture file]
+     -c sets the cycle counter rate, 40 for the 40MHz target. -r reads bare
+     records, as moved out by ES_TraceRead (over CAN say), rather than
+     ES_TraceDump frames. The capture is read from stdin if no file is
+     given. Anything between frames (console text) is skipped.
+
+     The queue wait of each dispatch is found by replaying the posts: each
+     service's queue is modelled as a list of post times, FIFO posts join
+     the back, LIFO posts the front and dispatches leave from the front.
+     A recall moves its events to the front together and logs them in
+     queue order, so a run of recall records goes in at the front in the
+     order it was logged. Two recalls with no other record for the service
+     between them are taken as one, the second's events modelled behind
+     the first's.
+     After an ES_TRACE_LOST record the model starts again empty, so the
+     waits of the events that were queued across the loss are unknown, or
+     wrong where posts after the loss are paired with them.
+ History
+ When           Who     What/Why
+ -------------- ---     --------
+ 10/18/26 13:00 as      recalls now go in at the front of the queue model,
+                        ES_SpliceToService logs no ES_TRACE_POST_LIFO
+ 10/18/26 10:00 as      started coding
+*****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ES_Trace.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+// more records than any trace will hold, frames are appended end to end
+#define MAX_RECORDS (1UL << 20)
+#define MAX_SERVICES 256
+// the most events modelled as waiting in any one queue
+#define MAX_WAITING 256
+
+#define DEFAULT_CYCLES_PER_US 40.0
+
+typedef struct {
+  uint64_t Time;          // unwrapped cycle counter
+  uint16_t EventParam;
+  uint16_t Sequence;
+  uint8_t EventType;
+  uint8_t Kind;
+  uint8_t Source;
+  uint8_t Target;
+} Record_t;
+
+// the modelled contents of a service's queue, as post times
+typedef struct {
+  uint64_t PostTime[MAX_WAITING];
+  uint16_t Head;          // index of the front entry
+  uint16_t NumWaiting;
+} QueueModel_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static size_t ReadAll( FILE * pFile, uint8_t ** ppData );
+static uint32_t DecodeFrames( uint8_t const * pData, size_t Size, bool Raw );
+static void DecodeRecords( uint8_t const * pData, uint32_t NumRecords );
+static void PrintListing( void );
+static void PrintTimelines( void );
+static void PrintSource( uint8_t Source );
+static void PushBack( QueueModel_t * pQueue, uint64_t Time );
+static void PushFront( QueueModel_t * pQueue, uint64_t Time );
+static void InsertAt( QueueModel_t * pQueue, uint16_t Position, uint64_t Time );
+static bool PopFront( QueueModel_t * pQueue, uint64_t * pTime );
+
+/*---------------------------- Module Variables ---------------------------*/
+static Record_t * Records;
+static uint32_t NumRecords;
+static uint64_t LastTime;       // for unwrapping the 32 bit times
+static double CyclesPerUs = DEFAULT_CYCLES_PER_US;
+static QueueModel_t Queue;     // of the service whose timeline is printing
+
+static char const * const KindNames[] = {
+  "post", "post lifo", "post all", "merge", "drop", "defer", "recall",
+  "dispatch", "lost"
+};
+
+/*------------------------------ Module Code ------------------------------*/
+int main( int argc, char * argv[] ){
+  FILE * pFile = stdin;
+  uint8_t * pData;
+  size_t Size;
+  bool Raw = false;
+  int i;
+
+  for ( i = 1; i < argc; i++ ){
+    if ( (strcmp( argv[i], "-c" ) == 0) && (i + 1 < argc) ){
+      CyclesPerUs = atof( argv[++i] );
+    }else if ( strcmp( argv[i], "-r" ) == 0 ){
+      Raw = true;
+    }else if ( argv[i][0] == '-' ){
+      fprintf( stderr,
+               "usage: %s [-c cycles_per_uS] [-r] [capture file]\n", argv[0] );
+      return 2;
+    }else if ( (pFile = fopen( argv[i], "rb" )) == NULL ){
+      perror( argv[i] );
+      return 1;
+    }
+  }
+  if ( CyclesPerUs <= 0 )
+    CyclesPerUs = DEFAULT_CYCLES_PER_US;
+
+  Records = malloc( MAX_RECORDS * sizeof(Record_t) );
+  Size = ReadAll( pFile, &pData );
+  if ( (Records == NULL) || (pData == NULL) ){
+    fputs( "out of memory\n", stderr );
+    return 1;
+  }
+  if ( DecodeFrames( pData, Size, Raw ) == 0 ){
+    fputs( "no trace records found\n", stderr );
+    return 1;
+  }
+  PrintListing();
+  PrintTimelines();
+  return 0;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+// reads the whole capture into memory
+static size_t ReadAll( FILE * pFile, uint8_t ** ppData ){
+  size_t Size = 0;
+  size_t Room = 65536;
+  size_t NumRead;
+  uint8_t * pData = malloc( Room );
+
+  while ( (pData != NULL) &&
+          ((NumRead = fread( pData + Size, 1, Room - Size, pFile )) > 0) ){
+    Size += NumRead;
+    if ( Size == Room ){
+      Room *= 2;
+      pData = realloc( pData, Room );
+    }
+  }
+  *ppData = pData;
+  return Size;
+}
+
+// finds the ES_TraceDump frames in the capture, or takes all of it as bare
+// records, and decodes them. Returns the number of records.
+static uint32_t DecodeFrames( uint8_t const * pData, size_t Size, bool Raw ){
+  size_t Pos = 0;
+  uint32_t Count;
+
+  if ( Raw ){
+    DecodeRecords( pData, (uint32_t)(Size / ES_TRACE_RECORD_BYTES) );
+    return NumRecords;
+  }
+  while ( Pos + ES_TRACE_HEADER_BYTES <= Size ){
+    if ( memcmp( pData + Pos, ES_TRACE_MAGIC, 4 ) != 0 ){
+      Pos++;    // console text between frames
+      continue;
+    }
+    if ( (pData[Pos + 4] != ES_TRACE_VERSION) ||
+         (pData[Pos + 5] != ES_TRACE_RECORD_BYTES) ){
+      fprintf( stderr, "skipping frame of version %u, %u byte records\n",
+               pData[Pos + 4], pData[Pos + 5] );
+      Pos += 4;
+      continue;
+    }
+    Count = pData[Pos + 6] | ((uint32_t)pData[Pos + 7] << 8);
+    Pos += ES_TRACE_HEADER_BYTES;
+    if ( Pos + (size_t)Count * ES_TRACE_RECORD_BYTES > Size ){
+      fprintf( stderr, "frame cut short, %u records expected\n",
+               (unsigned)Count );
+      Count = (uint32_t)((Size - Pos) / ES_TRACE_RECORD_BYTES);
+    }
+    DecodeRecords( pData + Pos, Count );
+    Pos += (size_t)Count * ES_TRACE_RECORD_BYTES;
+  }
+  return NumRecords;
+}
+
+// turns records from the binary form into Records, unwrapping the times
+static void DecodeRecords( uint8_t const * pData, uint32_t Count ){
+  Record_t * pRecord;
+  uint32_t Time;
+
+  for ( ; (Count > 0) && (NumRecords < MAX_RECORDS);
+        Count--, pData += ES_TRACE_RECORD_BYTES ){
+    pRecord = &Records[NumRecords++];
+    Time = pData[0] | ((uint32_t)pData[1] << 8) |
+           ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+    // records are in time order, so each is less than a wrap after the last
+    LastTime += (uint32_t)(Time - (uint32_t)LastTime);
+    pRecord->Time = LastTime;
+    pRecord->EventParam = (uint16_t)(pData[4] | (pData[5] << 8));
+    pRecord->Sequence = (uint16_t)(pData[6] | (pData[7] << 8));
+    pRecord->EventType = pData[8];
+    pRecord->Kind = pData[9];
+    pRecord->Source = pData[10];
+    pRecord->Target = pData[11];
+  }
+}
+
+// prints every record in order, with the time from the first in uS
+static void PrintListing( void ){
+  uint32_t i;
+  uint16_t Expected = Records[0].Sequence;
+  Record_t const * pRecord;
+
+  puts( "        time(uS)  seq  what       source  target  type   param" );
+  for ( i = 0; i < NumRecords; i++ ){
+    pRecord = &Records[i];
+    if ( (pRecord->Kind != ES_TRACE_LOST) && (pRecord->Sequence != Expected) )
+      printf( "  ... %u records missing\n",
+              (unsigned)(uint16_t)(pRecord->Sequence - Expected) );
+    Expected = pRecord->Sequence + 1;
+    if ( pRecord->Kind == ES_TRACE_LOST ){
+      Expected = pRecord->Sequence;   // the next record carries on from here
+      printf( "%16.2f  ---  %u records lost\n",
+              (pRecord->Time - Records[0].Time) / CyclesPerUs,
+              pRecord->EventParam );
+      continue;
+    }
+    printf( "%16.2f %5u  %-9s  ",
+            (pRecord->Time - Records[0].Time) / CyclesPerUs, pRecord->Sequence,
+            (pRecord->Kind < sizeof(KindNames) / sizeof(KindNames[0])) ?
+                KindNames[pRecord->Kind] : "?" );
+    PrintSource( pRecord->Source );
+    if ( pRecord->Target == ES_TRACE_SOURCE_NONE )
+      printf( "       -" );
+    else
+      printf( "  %6u", pRecord->Target );
+    printf( "  %4u  %6u\n", pRecord->EventType, pRecord->EventParam );
+  }
+}
+
+// replays the posts and dispatches and prints each service's timeline
+static void PrintTimelines( void ){
+  uint32_t i;
+  uint16_t Service;
+  Record_t const * pRecord;
+  uint64_t PostTime;
+  uint64_t Wait;
+  uint64_t MaxWait;
+  uint32_t NumDispatches;
+  uint32_t NumUnknown;
+  uint16_t NumRecalled;   // of the recall being replayed, 0 between recalls
+
+  for ( Service = 0; Service < MAX_SERVICES; Service++ ){
+    memset( &Queue, 0, sizeof(Queue) );
+    NumDispatches = 0;
+    NumUnknown = 0;
+    MaxWait = 0;
+    NumRecalled = 0;
+    for ( i = 0; i < NumRecords; i++ ){
+      pRecord = &Records[i];
+      if ( pRecord->Kind == ES_TRACE_LOST ){
+        memset( &Queue, 0, sizeof(Queue) );
+        NumRecalled = 0;
+        continue;
+      }
+      if ( pRecord->Target != Service )
+        continue;
+      if ( pRecord->Kind != ES_TRACE_RECALL )
+        NumRecalled = 0;
+      switch ( pRecord->Kind ){
+        case ES_TRACE_POST :
+        case ES_TRACE_POST_ALL :
+          PushBack( &Queue, pRecord->Time );
+          break;
+        case ES_TRACE_POST_LIFO :
+          PushFront( &Queue, pRecord->Time );
+          break;
+        case ES_TRACE_RECALL :
+          // behind the events of this recall that are already in
+          InsertAt( &Queue, NumRecalled++, pRecord->Time );
+          break;
+        case ES_TRACE_DISPATCH :
+          if ( NumDispatches == 0 )
+            printf( "\nservice %u\n        time(uS)  wait(uS)  type   param\n",
+                    Service );
+          NumDispatches++;
+          printf( "%16.2f  ", (pRecord->Time - Records[0].Time) / CyclesPerUs );
+          if ( PopFront( &Queue, &PostTime ) ){
+            Wait = pRecord->Time - PostTime;
+            if ( Wait > MaxWait )
+              MaxWait = Wait;
+            printf( "%8.2f", Wait / CyclesPerUs );
+          }else{
+            NumUnknown++;
+            printf( "%8s", "?" );
+          }
+          printf( "  %4u  %6u\n", pRecord->EventType, pRecord->EventParam );
+          break;
+        default :   // merges, drops & defers leave the queue alone
+          break;
+      }
+    }
+    if ( NumDispatches != 0 )
+      printf( "service %u: %u dispatches, longest wait %.2f uS, %u unknown\n",
+              Service, (unsigned)NumDispatches, MaxWait / CyclesPerUs,
+              (unsigned)NumUnknown );
+  }
+}
+
+// prints the source column
+static void PrintSource( uint8_t Source ){
+  if ( Source == ES_TRACE_SOURCE_NONE )
+    printf( "     -" );
+  else if ( (Source & 0x80) != 0 )
+    printf( " isr%-2u", Source & 0x7F );
+  else
+    printf( "%6u", Source );
+}
+
+// the model is bigger than any queue, so it only fills if the trace is bad
+static void PushBack( QueueModel_t * pQueue, uint64_t Time ){
+  if ( pQueue->NumWaiting >= MAX_WAITING )
+    return;
+  pQueue->PostTime[(pQueue->Head + pQueue->NumWaiting) % MAX_WAITING] = Time;
+  pQueue->NumWaiting++;
+}
+
+static void PushFront( QueueModel_t * pQueue, uint64_t Time ){
+  if ( pQueue->NumWaiting >= MAX_WAITING )
+    return;
+  pQueue->Head = (pQueue->Head + MAX_WAITING - 1) % MAX_WAITING;
+  pQueue->PostTime[pQueue->Head] = Time;
+  pQueue->NumWaiting++;
+}
+
+// puts Time Position entries back from the front, or at the back if the
+// queue is shorter than that
+static void InsertAt( QueueModel_t * pQueue, uint16_t Position, uint64_t Time ){
+  uint16_t i;
+
+  if ( pQueue->NumWaiting >= MAX_WAITING )
+    return;
+  if ( Position > pQueue->NumWaiting )
+    Position = pQueue->NumWaiting;
+  // make room at the front, then move the ones ahead of Position up into it
+  pQueue->Head = (pQueue->Head + MAX_WAITING - 1) % MAX_WAITING;
+  for ( i = 0; i < Position; i++ )
+    pQueue->PostTime[(pQueue->Head + i) % MAX_WAITING] =
+        pQueue->PostTime[(pQueue->Head + i + 1) % MAX_WAITING];
+  pQueue->PostTime[(pQueue->Head + Position) % MAX_WAITING] = Time;
+  pQueue->NumWaiting++;
+}
+
+// takes the post time of the event at the front, false if it is not known
+static bool PopFront( QueueModel_t * pQueue, uint64_t * pTime ){
+  if ( pQueue->NumWaiting == 0 )
+    return false;   // posted before the trace starts, or lost
+  *pTime = pQueue->PostTime[pQueue->Head];
+  pQueue->Head = (pQueue->Head + 1) % MAX_WAITING;
+  pQueue->NumWaiting--;
+  return true;
+}
+/*------------------------------ End of file ------------------------------*/
@@ -1,3 +1,4 @@
+//#define TEST
 /****************************************************************************
         Module:
         MS_CAN_top_layer.c
@@ -7,14 +8,58 @@
 
         Between the 360 lighting master and slave nodes, we will encode all of our data within the 29-bit identifiers
 
+        Framing: the top bits of the identifier give the kind of frame (see MS_CAN_top_layer.h). Plain commands carry
+        2 bytes, lamp frames carry CAN_LAMP_COMMANDS_PER_FRAME packed lamp commands in the full 8 bytes, and transport
+        frames carry the pieces of a longer transfer.
+
+        Addressing: every node ID is a single bit (see MS_CAN_top_layer.h). A command from the master carries the
+        master's bit plus the bits of every slave it is for, and each slave's receive object filters on the master's
+        bit and its own, so one frame reaches any set of slaves (ALL_SLAVES_GROUP for a whole scene). Frames from a
+        slave carry only its own bit, so they never look like a command. All identifiers are sent extended, so the
+        masks always compare the same 29 bits.
+
+        Receive path: the ISR copies every received frame into a preallocated ring (CAN_RX_RING_SIZE frames) and posts
+        a single ES_CAN_RX event to the owning service for each batch, through its own ISR channel. The service then
+        pulls the frames out with CAN_Internal_Bus_Get_Frame. The ISR services each pending message object once per
+        entry, so its time is bounded by the number of objects however busy the bus is.
+
+        Transmit path: frames to send go into a software queue of CAN_TX_QUEUE_SIZE frames, ordered like the bus
+        orders them (lowest identifier first, then in the order they were queued), behind a fixed pool of
+        CAN_TX_OBJECT_COUNT message objects. The TX complete interrupts refill the pool from the queue.
+        When the queue is full the send is refused, and ES_CAN_TX_READY is posted to the owning service once there is
+        room again.
+
+        Transport: CAN_Transport_Send splits up to CAN_TRANSPORT_MAX_LENGTH bytes (an animation table, say) into frames
+        the way ISO 15765-2 (ISO-TP) does: a single frame if it fits in 7 bytes, otherwise a first frame with the length,
+        then consecutive frames of 7 bytes with a 4 bit sequence number. The receiver paces the sender with flow
+        control frames, one per CAN_TRANSPORT_BLOCK_SIZE consecutive frames, so it never has more coming than its
+        receive ring can hold. Transport frames are handled by the module inside CAN_Internal_Bus_Get_Frame, the
+        owning service only sees ES_CAN_TRANSPORT_RX and ES_CAN_TRANSPORT_DONE.
+
+        Polling: CAN_Master_Poll_Slaves arms one remote request object per slave, so the controller sends the
+        requests back to back and the replies come in as fast as the slaves can answer. The replies are kept in a
+        per slave table, and ES_CAN_POLL_DONE is posted once they are all in or CAN_POLL_TIMER runs out. Each poll
+        object is cleared once its reply is in or the poll ends, so that the slave's later frames reach the ring.
    
         External Functions Required:
 
         Public Functions:
-				  void Initialize_CAN_Internal_Bus(uint8_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data)
-          void CAN_Master_Command_Slave(uint32_t slave_id, uint8_t * p_cmd_data)
+				  void Initialize_CAN_Internal_Bus(uint8_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data, uint8_t owner_service)
+          bool CAN_Master_Command_Slave(uint32_t slave_ids, uint8_t * p_cmd_data)
           void CAN_Master_Request_Slave(uint32_t slave_id)
-          void CAN_Slave_Send_Master(uint8_t * p_slave_data)
+          bool CAN_Slave_Send_Master(uint8_t * p_slave_data)
+          bool CAN_Internal_Bus_Get_Frame(CAN_Frame_t * p_frame)
+          uint32_t CAN_Internal_Bus_Get_Rx_Dropped(void)
+          uint8_t CAN_Internal_Bus_Get_Tx_Room(void)
+          bool CAN_Master_Poll_Slaves(uint32_t slave_ids, uint16_t timeout)
+          bool CAN_Master_Get_Poll_Reply(uint32_t slave_id, CAN_Frame_t * p_frame)
+          uint32_t CAN_Master_Get_Poll_Replied(void)
+          bool CAN_Internal_Bus_Post_Poll_Timeout(ES_Event ThisEvent)
+          bool CAN_Master_Command_Lamps(uint32_t slave_ids, CAN_Lamp_Command_t const * p_commands, uint8_t count)
+          uint8_t CAN_Unpack_Lamp_Commands(CAN_Frame_t const * p_frame, CAN_Lamp_Command_t * p_commands)
+          bool CAN_Transport_Send(uint32_t node_id, uint8_t const * p_data, uint16_t length)
+          uint16_t CAN_Transport_Get_Rx(uint8_t * p_dest, uint16_t max_length, uint32_t * p_from)
+          bool CAN_Internal_Bus_Post_Transport_Timeout(ES_Event ThisEvent)
           void CAN_Internal_Bus_ISR(void)
         
 ****************************************************************************/
@@ -42,9 +87,18 @@
 #include "inc/hw_types.h"
 #include "inc/hw_gpio.h"
 #include "inc/hw_sysctl.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_can.h"
 #include "driverlib/sysctl.h"
 #include "driverlib/pin_map.h"  // Define PART_TM4C123GH6PM in project
 #include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+#include "ES_IsrChannel.h"
+#include "ES_LookupTables.h"
 
 #include "MS_CAN_top_layer.h"
 #include "driverlib/can.h"
@@ -62,16 +116,16 @@
 #define MASTER_NODE                0
 #define SLAVE_NODE                 1
 
-// Node ID's
-//   The lowest binary value ID wins arbitration
-#define MASTER_NODE_ID             ((uint32_t) 1<<0)
-#define SLAVE_NODE_01_ID           ((uint32_t) 1<<1)
-#define SLAVE_NODE_02_ID           ((uint32_t) 1<<2)
+// Node ID's are in MS_CAN_top_layer.h
+//   The lowest binary value ID wins arbitration, so a command to one slave goes ahead of a command to a group
 
 // Mask to allow master to receive from all slave nodes
-#define ALL_SLAVES_ID_MASK         (0x00000001)             // Allow only the master to pass through
+#define ALL_SLAVES_ID_MASK         (MASTER_NODE_ID)         // Allow only the master to pass through
 #define ALL_SLAVES_ID              (0x00000000)             // As long as the data isn't from the master, we accept it
 
+// Every bit of the 29-bit identifier that can name a slave, the bits below the frame kind
+#define ALL_SLAVE_BITS             (((uint32_t) 1<<CAN_KIND_SHIFT) - 1 - MASTER_NODE_ID)
+
 // Message Object Numbers
 #define MASTER_RX_OBJ_ID           32
 #define MASTER_REQUEST_OBJ_ID      31
@@ -81,6 +135,99 @@
 // This Node Info
 #define THIS_NODE_TYPE             MASTER_NODE
 
+// Receive ring, the count of frames is a power of two no larger than 128 so that the free running uint8_t indices wrap cleanly
+#define CAN_RX_RING_SIZE           16
+#define CAN_RX_RING_MASK           (CAN_RX_RING_SIZE - 1)
+#if ((CAN_RX_RING_SIZE & CAN_RX_RING_MASK) != 0) || (CAN_RX_RING_SIZE > 128)
+#error CAN_RX_RING_SIZE must be a power of two no larger than 128
+#endif
+
+// Transmit engine, objects 1 to CAN_TX_OBJECT_COUNT are the pool of transmit objects (the highest two are for receiving)
+#define CAN_TX_OBJECT_COUNT        8
+#define CAN_TX_OBJECT_MAP          ((uint32_t)((1ULL << CAN_TX_OBJECT_COUNT) - 1))
+#define CAN_TX_QUEUE_SIZE          32
+#if (CAN_TX_OBJECT_COUNT < 1) || (CAN_TX_OBJECT_COUNT > 30)
+#error CAN_TX_OBJECT_COUNT must be from 1 to 30
+#endif
+#if (CAN_TX_QUEUE_SIZE < 1) || (CAN_TX_QUEUE_SIZE > 255)
+#error CAN_TX_QUEUE_SIZE must be from 1 to 255
+#endif
+
+// Poll objects, one remote request object per slave in a poll, just above the transmit pool
+#define CAN_POLL_OBJECT_FIRST      (CAN_TX_OBJECT_COUNT + 1)
+#define CAN_POLL_OBJECT_COUNT      16
+#define CAN_POLL_OBJECT_MAP        ((uint32_t)(((1ULL << CAN_POLL_OBJECT_COUNT) - 1) << (CAN_POLL_OBJECT_FIRST - 1)))
+#if (CAN_POLL_OBJECT_FIRST + CAN_POLL_OBJECT_COUNT - 1) >= MASTER_REQUEST_OBJ_ID
+#error The poll objects run into the request and receive objects
+#endif
+
+// Transport, the first byte of every frame is the protocol control information (PCI): the frame type in the high
+// nibble, and in the low nibble the length (single frame), the top of the length (first frame), the sequence number
+// (consecutive frame) or the flow status (flow control)
+#define TP_TYPE_MASK               0xF0
+#define TP_SINGLE_FRAME            0x00
+#define TP_FIRST_FRAME             0x10
+#define TP_CONSECUTIVE_FRAME       0x20
+#define TP_FLOW_CONTROL            0x30
+#define TP_FLOW_CONTINUE           0                     // Flow status: send the next block
+#define TP_FLOW_WAIT               1                     // Flow status: hold on, another flow control will follow
+#define TP_FLOW_OVERFLOW           2                     // Flow status: the transfer is refused
+#define TP_SINGLE_FRAME_DATA       7                     // Data bytes in each kind of frame
+#define TP_FIRST_FRAME_DATA        6
+#define TP_CONSECUTIVE_FRAME_DATA  7
+#define TP_FLOW_CONTROL_LENGTH     3                     // PCI, block size, separation time
+
+#define CAN_TRANSPORT_RX_SIZE      1024                  // The longest transfer we can take in
+#define CAN_TRANSPORT_BLOCK_SIZE   8                     // Consecutive frames we take per flow control
+#define CAN_TRANSPORT_TX_SHARE     (CAN_TX_QUEUE_SIZE / 2)   // Most of the transmit queue a transfer may fill, the rest is for commands
+#define CAN_TRANSPORT_TIMEOUT      1000                  // Ticks to wait on the other end of a transfer (ISO-TP's N_Bs and N_Cr)
+#if (CAN_TRANSPORT_BLOCK_SIZE < 1) || (CAN_TRANSPORT_BLOCK_SIZE > (CAN_RX_RING_SIZE / 2))
+#error CAN_TRANSPORT_BLOCK_SIZE must be from 1 to half the receive ring
+#endif
+#if CAN_TRANSPORT_RX_SIZE > CAN_TRANSPORT_MAX_LENGTH
+#error CAN_TRANSPORT_RX_SIZE can not be longer than a transfer
+#endif
+
+// Size of the data stores handed to Initialize_CAN_Internal_Bus
+#define NUM_DATA_BYTES_DATA_STORE  2
+
+// Bit for a message object (1-32) in a bit map of objects
+#define OBJECT_BIT(object_id)      ((uint32_t) 1<<((object_id) - 1))
+
+// A frame waiting in the transmit queue
+typedef struct
+{
+     CAN_Frame_t frame;
+     uint16_t order;                                 // Frames with the same id go in the order they were queued
+} tx_entry_t;
+
+// Where each end of a transfer is up to
+typedef enum
+{
+     TP_IDLE,
+     TP_WAIT_FLOW,                                   // Sender: waiting for a flow control
+     TP_SENDING,                                     // Sender: queueing the consecutive frames of a block
+     TP_RECEIVING,                                   // Receiver: taking in the consecutive frames
+     TP_UNREAD                                       // Receiver: complete, waiting for CAN_Transport_Get_Rx
+} tp_state_t;
+
+#if defined(TEST) && defined(ES_HOST_PORT)
+// The test harness at the end of the file stands in for the CAN controller, the bus and the owning service
+#define SIMULATED_BUS
+static bool record_event(ES_Event this_event);
+static ES_TimerReturn_t record_timer(uint8_t timer, uint16_t time);
+static void sim_barrier(void);
+#undef ES_MemoryBarrier
+#define ES_MemoryBarrier()         sim_barrier()
+#define POST_FROM_ISR(this_event)  record_event(this_event)
+#define POST_EVENT(this_event)     record_event(this_event)
+#define START_TIMER(timer, time)   record_timer(timer, time)
+#else
+#define POST_FROM_ISR(this_event)  ES_IsrChannelPost(ISR_CHANNEL_CAN_INTERNAL_BUS, event_owner_service, this_event)
+#define POST_EVENT(this_event)     ES_PostToService(event_owner_service, this_event)
+#define START_TIMER(timer, time)   ES_Timer_InitTimer(timer, time)
+#endif
+
 // ######################################################################################################################################################################
 // ---------------------------- Module Level Variables
 // ######################################################################################################################################################################
@@ -90,6 +237,56 @@ static uint32_t * p_My_Node_ID;         // This node's ID
 static uint8_t * p_My_RX_Data;          // This node's data store for incoming data
 static uint8_t * p_My_Remote_Data;      // This node's data store for incoming data that was requested (master), or data that we will send on request (slave)
 
+// Receive pipeline. The ISR only writes rx_tail, the owning service only writes rx_head
+static CAN_Frame_t rx_ring[CAN_RX_RING_SIZE];     // Frames waiting for the owning service
+static volatile uint8_t rx_head;                  // Count of frames taken by the service
+static volatile uint8_t rx_tail;                  // Count of frames added by the ISR
+static volatile bool rx_event_posted;             // An ES_CAN_RX is on its way and the service has not yet found the ring empty
+static uint32_t rx_dropped;                       // Frames lost to a full ring or overwritten in a message object, written by the ISR only
+static uint32_t rx_object_map;                    // Bit map of the message objects that receive frames
+static uint8_t event_owner_service;               // Service that gets the ES_CAN_RX and ES_CAN_TX_READY events
+
+// Transmit engine. Shared by the service and the ISR, so the service side works with interrupts off
+static tx_entry_t tx_queue[CAN_TX_QUEUE_SIZE];    // Binary heap, tx_queue[0] is the next frame to load
+static uint8_t tx_queue_count;                    // Frames in the heap
+static uint16_t tx_order;                         // Order stamp for the next frame queued
+static uint32_t tx_busy_objects;                  // Bit map of the pool objects loaded with a frame not yet sent
+static bool tx_room_wanted;                       // A send was refused, so ES_CAN_TX_READY is owed
+
+// Poll of the slaves. Shared by the service and its poll timeout, which both run in ES_Run, and by the ISR, so the
+// service side makes its changes with interrupts off
+static uint32_t poll_ids[CAN_POLL_OBJECT_COUNT];          // The slave polled by each poll object
+static CAN_Frame_t poll_replies[CAN_POLL_OBJECT_COUNT];   // The reply from each, valid once its bit is in poll_replied
+static volatile uint32_t poll_pending;                    // Bit map of the slaves we are still waiting on
+static volatile uint32_t poll_replied;                    // Bit map of the slaves that have replied
+static volatile bool poll_active;                         // A poll is running
+static bool poll_done_owed;                               // The poll is over but ES_CAN_POLL_DONE has not been posted
+
+// Transport sender. Shared by the service and its transport timeout, which both run in ES_Run, and by the ISR (which
+// keeps the transmit queue topped up), so the ES_Run side makes its changes with interrupts off
+static uint8_t const * p_tp_tx_data;              // The caller's data, used until the last frame is queued
+static uint16_t tp_tx_length;                     // Bytes in the transfer
+static uint16_t tp_tx_queued;                     // Bytes queued so far
+static uint32_t tp_tx_peer;                       // The node we are sending to
+static uint8_t tp_tx_sequence;                    // Sequence number of the next consecutive frame
+static uint8_t tp_tx_block_left;                  // Consecutive frames before the next flow control, 0 for no limit
+static volatile tp_state_t tp_tx_state;
+static bool tp_tx_done_owed;                      // The transfer is over but ES_CAN_TRANSPORT_DONE has not been posted
+static uint8_t tp_tx_result;                      // EventParam for the ES_CAN_TRANSPORT_DONE
+
+// Transport receiver, only used from CAN_Internal_Bus_Get_Frame and CAN_Transport_Get_Rx by the owning service
+static uint8_t tp_rx_buffer[CAN_TRANSPORT_RX_SIZE];
+static uint16_t tp_rx_length;                     // Bytes in the transfer
+static uint16_t tp_rx_received;                   // Bytes taken in so far
+static uint32_t tp_rx_peer;                       // The node sending to us
+static uint8_t tp_rx_sequence;                    // Sequence number of the next consecutive frame
+static uint8_t tp_rx_block_left;                  // Consecutive frames before we send the next flow control
+static ES_TimerTime_t tp_rx_last;                 // When the last frame of the transfer came in
+static tp_state_t tp_rx_state;
+static CAN_Frame_t tp_rx_held;                    // A single or first frame put off while the buffer is unread
+static bool tp_rx_holding;                        // tp_rx_held is waiting
+static uint32_t tp_rx_dropped;                    // Single frames lost with one already held, kept apart from the ISR's rx_dropped
+
 // ######################################################################################################################################################################
 // ---------------------------- Private Function Prototypes
 // ######################################################################################################################################################################
@@ -97,7 +294,22 @@ static uint8_t * p_My_Remote_Data;      // This node's data store for incoming d
 static void can_master_receive_slave(void);
 static void can_slave_respond_master(void);
 static void can_slave_receive_master(void);
-static uint32_t find_avail_tx_object(uint32_t ui32Base);
+static bool can_receive_frame(uint32_t object_id);
+static bool can_queue_frame(uint32_t id, uint8_t * p_data, uint8_t length);
+static void can_load_tx_objects(void);
+static void can_tx_complete(uint32_t object_id);
+static void can_poll_reply(uint32_t object_id);
+static uint8_t count_bits(uint32_t bits);
+static void can_pack_lamp_command(CAN_Lamp_Command_t const * p_command, uint8_t * p_dest);
+static bool can_take_frame(CAN_Frame_t * p_frame);
+static uint32_t can_transport_id(uint32_t peer);
+static void can_transport_pump(void);
+static void can_transport_receive(CAN_Frame_t const * p_frame);
+static void can_transport_flow(CAN_Frame_t const * p_frame, uint32_t peer);
+static void can_transport_send_flow(uint32_t peer, uint8_t flow_status);
+static bool tx_entry_before(tx_entry_t const * p_a, tx_entry_t const * p_b);
+static void tx_queue_push(CAN_Frame_t const * p_frame);
+static void tx_queue_pop(CAN_Frame_t * p_frame);
 
 // ######################################################################################################################################################################
 // ---------------------------- Public Functions
@@ -112,12 +324,16 @@ static uint32_t find_avail_tx_object(uint32_t ui32Base);
           uint8_t * p_rx_data:          a pointer to where this module place new data received
           uint8_t * p_remote_data:      a pointer to where this module will place data that was requested (if we are the master)
                                              or where this module will pull data from (if we are the slave)
+          uint8_t owner_service:        the service that ES_CAN_RX events are posted to
 
      Description
           Initializes the CAN network's internal bus (required for master and all slaves)
 
+     Notes
+          CAN_Internal_Bus_ISR must be in the vector table entry for CAN0.
+
 ****************************************************************************/
-void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data)
+void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data, uint8_t * p_remote_data, uint8_t owner_service)
 {
      // ~~~~~~~~~~~~~~~~~~~~~
      // CAN INTERNAL BUS INIT
@@ -156,8 +372,8 @@ void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data,
      // X. Register the ISR for the CAN bus, we could do this manually BTW, probably the better idea...
      // CANIntRegister(CAN_INTERNAL_BUS_BASE, ***NEED FUNCTION POINTER***);
 
-     // 5. Enable CAN Interrupts
-     CANIntEnable(CAN_INTERNAL_BUS_BASE, CAN_INT_MASTER);
+     // 5. Enable CAN Interrupts, message objects and errors (bus off, error passive), but not every TXOK/RXOK
+     CANIntEnable(CAN_INTERNAL_BUS_BASE, CAN_INT_MASTER | CAN_INT_ERROR);
 
      // X. Save our node's ID pointer into this module for future use
      p_My_Node_ID = p_this_node_id;
@@ -166,16 +382,46 @@ void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data,
      p_My_RX_Data = p_rx_data;
      p_My_Remote_Data = p_remote_data;
 
+     // X. Empty the receive ring and note who gets the events
+     rx_head = 0;
+     rx_tail = 0;
+     rx_event_posted = false;
+     rx_dropped = 0;
+     event_owner_service = owner_service;
+
+     // X. Every transmit object is free and nothing is queued
+     tx_queue_count = 0;
+     tx_busy_objects = 0;
+     tx_room_wanted = false;
+
+     // X. No poll running
+     poll_pending = 0;
+     poll_replied = 0;
+     poll_active = false;
+     poll_done_owed = false;
+
+     // X. No transfers under way
+     tp_tx_state = TP_IDLE;
+     tp_tx_done_owed = false;
+     tp_rx_state = TP_IDLE;
+     tp_rx_holding = false;
+     tp_rx_dropped = 0;
+
      // X. Based on our node type, we set up appropriate message objects here
      if (MASTER_NODE_ID == *p_My_Node_ID)
      {
           can_master_receive_slave();
+          rx_object_map = OBJECT_BIT(MASTER_RX_OBJ_ID) | OBJECT_BIT(MASTER_REQUEST_OBJ_ID);     // Replies to our requests arrive in the request object
      }
      else
      {
           can_slave_respond_master();
           can_slave_receive_master();
+          rx_object_map = OBJECT_BIT(SLAVE_RX_OBJ_ID);                                           // The response object only ever transmits
      }
+
+     // X. Now that everything is set up, let the CAN interrupt in
+     IntEnable(INT_CAN0_TM4C123);
 }
 
 /****************************************************************************
@@ -183,17 +429,22 @@ void Initialize_CAN_Internal_Bus(uint32_t * p_this_node_id, uint8_t * p_rx_data,
           CAN_Master_Command_Slave
 
      Description
-          Sets up a message object to send a command to a specified slave node
+          Queues a command to a slave node, or to a group of them, for transmission. The whole group gets the command
+          from a single frame.
      
      Parameters
-          ui32 slave_id: id of slave
+          ui32 slave_ids: id of slave, or the OR of the ids of every slave in the group (e.g. ALL_SLAVES_GROUP)
           ui8 p_cmd_data: pointer to the command data to be sent
 
+     Returns
+          bool: false if slave_ids names no slave or includes the master, or if the transmit queue is full
+                (ES_CAN_TX_READY will follow once there is room)
+
      Notes
-          We might have to clear this message object after the TX complete interrupt. not sure if this would continue to send data...
+          The data is copied, so p_cmd_data may be re-used as soon as this returns.
 
 ****************************************************************************/
-void CAN_Master_Command_Slave(uint32_t slave_id, uint8_t * p_cmd_data)
+bool CAN_Master_Command_Slave(uint32_t slave_ids, uint8_t * p_cmd_data)
 {
      //
      // Definitions
@@ -201,24 +452,17 @@ void CAN_Master_Command_Slave(uint32_t slave_id, uint8_t * p_cmd_data)
      #define NUM_DATA_BYTES_MASTER_COMMAND_SLAVE 2                         // Number of bytes in data we are sending
 
      //
-     // Configure message (follows from page 85 of peripheral manual)
-     //
-     tCANMsgObject message_object = {0};                                   // Declare struct
-     message_object.ui32MsgID = slave_id;                                  // Message ID (The 11 or 29 bit identifier)
-     message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused for TX, set to 0
-     message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE;                     // Generate interrupt on TX complete
-     message_object.ui32MsgLen = NUM_DATA_BYTES_MASTER_COMMAND_SLAVE;      // Number of data bytes to send
-     message_object.pui8MsgData = p_cmd_data;                              // Pointer to 1st data byte
-
-     //
-     // Message Object ID: find lowest object available for transmit, we use the highest 2 registers for the RX data
+     // Only slave bits may be set, and at least one of them
      //
-     uint32_t object_id = find_avail_tx_object(CAN_INTERNAL_BUS_BASE);
+     if ((0 == slave_ids) || (0 != (slave_ids & ~ALL_SLAVE_BITS)))
+     {
+          return false;
+     }
 
      //
-     // Set up message object for transmitting commmands to slaves
+     // Queue the command with our bit set so the slaves know it is from us, the transmit engine finds it an object
      //
-     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_TX);
+     return can_queue_frame(MASTER_NODE_ID | slave_ids, p_cmd_data, NUM_DATA_BYTES_MASTER_COMMAND_SLAVE);
 }
 
 /****************************************************************************
@@ -233,8 +477,8 @@ void CAN_Master_Command_Slave(uint32_t slave_id, uint8_t * p_cmd_data)
           ui32 slave_id: id of slave
 
      Notes
-          We might want to set up a function that would allow requesting from all n-slaves. To do this, we would set up n objects for TX_REMOTE.
-          This way we wouldn't have to individually request then wait for response, then repeat n times.
+          To request from several slaves at once use CAN_Master_Poll_Slaves, which sets up n objects for TX_REMOTE.
+          This way we don't have to individually request then wait for response, then repeat n times.
 
 ****************************************************************************/
 void CAN_Master_Request_Slave(uint32_t slave_id)
@@ -250,7 +494,8 @@ void CAN_Master_Request_Slave(uint32_t slave_id)
      tCANMsgObject message_object = {0};                                   // Declare struct
      message_object.ui32MsgID = slave_id;                                  // Message ID (The 11 or 29 bit identifier)
      message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused, set to 0
-     message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE;                     // Which interrupt flag do we use for this?? !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE \
+          | MSG_OBJ_EXTENDED_ID;                                           // Interrupt when the reply arrives, the object turns into a receive object once the request is sent
      message_object.ui32MsgLen = NUM_DATA_BYTES_MASTER_REQUEST_SLAVE;      // Number of data bytes we are expecting to receive
      message_object.pui8MsgData = 0;                                       // Unused pointer value since requests use no data
 
@@ -260,9 +505,12 @@ void CAN_Master_Request_Slave(uint32_t slave_id)
      uint32_t object_id = MASTER_REQUEST_OBJ_ID;                           // 1 of 32 object buffers
 
      //
-     // Set up message object for requesting data from slaves
+     // Set up message object for requesting data from slaves, with interrupts off since the ISR also uses the
+     // message interface registers when it refills the transmit objects
      //
+     EnterCritical();
      CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_TX_REMOTE);
+     ExitCritical();
 }
 
 /****************************************************************************
@@ -270,13 +518,16 @@ void CAN_Master_Request_Slave(uint32_t slave_id)
           CAN_Slave_Send_Master
 
      Description
-          Sets up a message object to send data to the master
+          Queues data to send to the master
      
      Parameters
           ui8 p_cmd_data: pointer to the data to be sent
 
+     Returns
+          bool: false if the transmit queue is full, ES_CAN_TX_READY will follow once there is room
+
 ****************************************************************************/
-void CAN_Slave_Send_Master(uint8_t * p_slave_data)
+bool CAN_Slave_Send_Master(uint8_t * p_slave_data)
 {
      //
      // Definitions
@@ -284,273 +535,2477 @@ void CAN_Slave_Send_Master(uint8_t * p_slave_data)
      #define NUM_DATA_BYTES_SLAVE_SEND_MASTER 2                            // Number of bytes in data we are sending
 
      //
-     // Configure message (follows from page 85 of peripheral manual)
+     // Queue the data under our own id, the transmit engine finds it an object
      //
-     tCANMsgObject message_object = {0};                                   // Declare struct
-     message_object.ui32MsgID = *p_My_Node_ID;                             // Message ID (The 11 or 29 bit identifier)
-     message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused for TX, set to 0
-     message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE;                     // Generate interrupt on TX complete
-     message_object.ui32MsgLen = NUM_DATA_BYTES_SLAVE_SEND_MASTER;         // Number of data bytes to send
-     message_object.pui8MsgData = p_slave_data;                            // Pointer to 1st data byte
+     return can_queue_frame(*p_My_Node_ID, p_slave_data, NUM_DATA_BYTES_SLAVE_SEND_MASTER);
+}
 
-     //
-     // Message Object ID: find lowest object available for transmit, we use the highest registers for the RX data
-     //
-     uint32_t object_id = find_avail_tx_object(CAN_INTERNAL_BUS_BASE);
+/****************************************************************************
+     Public Function
+          CAN_Internal_Bus_Get_Frame
 
-     //
-     // Set up message object for transmitting data to master
-     //
-     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_TX);
+     Description
+          Takes the oldest received frame out of the receive ring. Call it from the owning service on ES_CAN_RX until it
+          returns false. The data of a command frame is also copied to the data store for its message object.
+     
+     Parameters
+          CAN_Frame_t * p_frame: where to put the frame
+
+     Returns
+          bool: false if there are no more frames
+
+     Notes
+          The service may find the ring already empty on an ES_CAN_RX, if it took the frames of that batch while
+          draining the previous one.
+          Transport frames are handled here and never returned, they lead to ES_CAN_TRANSPORT_RX and
+          ES_CAN_TRANSPORT_DONE instead.
+          Lamp frames leave the data stores alone, the service takes them apart with CAN_Unpack_Lamp_Commands.
+
+****************************************************************************/
+bool CAN_Internal_Bus_Get_Frame(CAN_Frame_t * p_frame)
+{
+     while (true == can_take_frame(p_frame))
+     {
+          if (CAN_KIND_TRANSPORT == CAN_FRAME_KIND(p_frame->id))
+          {
+               can_transport_receive(p_frame);
+               continue;
+          }
+
+          //
+          // Keep the data stores up to date, they only hold commands
+          //
+          if (CAN_KIND_COMMAND == CAN_FRAME_KIND(p_frame->id))
+          {
+               uint8_t * p_store = (MASTER_NODE_ID == *p_My_Node_ID) && (MASTER_REQUEST_OBJ_ID == p_frame->object) ? p_My_Remote_Data : p_My_RX_Data;
+               for (uint8_t i = 0; (i < p_frame->length) && (i < NUM_DATA_BYTES_DATA_STORE); i++)
+               {
+                    p_store[i] = p_frame->data[i];
+               }
+          }
+          return true;
+     }
+     return false;
 }
 
 /****************************************************************************
      Public Function
-          CAN_Internal_Bus_ISR
+          CAN_Master_Command_Lamps
 
      Description
-          This function handles CAN interrupts on the internal bus
+          Queues commands for the lamps of a slave, or of a group of them, packed CAN_LAMP_COMMANDS_PER_FRAME to a frame.
+          Every slave in the group gets every command, so a scene that is the same on each is one set of frames.
      
      Parameters
-          None
+          ui32 slave_ids: id of slave, or the OR of the ids of every slave in the group (e.g. ALL_SLAVES_GROUP)
+          CAN_Lamp_Command_t * p_commands: the commands
+          ui8 count: number of commands, up to CAN_LAMP_COMMANDS_PER_FRAME * CAN_TX_QUEUE_SIZE
+
+     Returns
+          bool: false if a command or slave_ids is bad, or if the transmit queue does not have room for all the frames
+                (ES_CAN_TX_READY will follow once there is room, CAN_Internal_Bus_Get_Tx_Room tells how much)
 
      Notes
-          This method of servicing interrupts requires that we don't get multiple interrupts at a time.
+          All of the frames are queued or none of them, so a scene never goes out half done.
 
 ****************************************************************************/
-void CAN_Internal_Bus_ISR(void)
+bool CAN_Master_Command_Lamps(uint32_t slave_ids, CAN_Lamp_Command_t const * p_commands, uint8_t count)
 {
+     uint16_t num_frames = (count + CAN_LAMP_COMMANDS_PER_FRAME - 1) / CAN_LAMP_COMMANDS_PER_FRAME;
+     CAN_Frame_t frame;
+     bool queued = true;
+
      //
-     // See the cause of the pending interrupts
+     // Check everything first, so that nothing is queued for a bad request
      //
-     uint32_t int_source = CANIntStatus(CAN_INTERNAL_BUS_BASE, (tCANIntStsReg) CAN_INT_STS_CAUSE);
-     // If the interrupt is a contoller status interrupt
-     if (0 == int_source)
+     if ((0 == count) || (num_frames > CAN_TX_QUEUE_SIZE) || (0 == slave_ids) || (0 != (slave_ids & ~ALL_SLAVE_BITS)))
      {
-          //
-          // Handle the status accordingly. For now get the status interrupt, in order to clear the int, save it, then do nothing.
-          //
-          uint32_t controller_status = CANStatusGet(CAN_INTERNAL_BUS_BASE, (tCANStsReg) CAN_STS_CONTROL);
+          return false;
      }
-     // Else if the interrupt is from a specific message object
-     else if ((0 < int_source) && (32 >= int_source))
+     for (uint8_t i = 0; i < count; i++)
      {
-          //
-          // Only process interrupts from RX's (the highest two objects 31-32)
-          //
-          if ((32 == int_source) || (31 == int_source))
-          {    
-               CANMessageGet(CAN_INTERNAL_BUS_BASE, int_source, 0, true);
-          }
-          else
+          if ((p_commands[i].lamp > CAN_LAMP_MAX) || (p_commands[i].fade_time > CAN_LAMP_FADE_MAX))
           {
-               CANIntClear(CAN_INTERNAL_BUS_BASE, int_source);
+               return false;
           }
+     }
 
-          //
-          // Otherwise, the interrupt is from a transmission complete from another message object.
-          //
-          // Do nothing.
+     frame.id = CAN_KIND_LAMPS | MASTER_NODE_ID | slave_ids;
+     frame.object = 0;                                                     // Not known until it is loaded
 
-          //
-          // Note: could use CANIntStatus(base,CAN_INT_STS_OBJECT) to see all objects that have pending interrupts
-          //
+     EnterCritical();
+     if ((CAN_TX_QUEUE_SIZE - tx_queue_count) >= num_frames)
+     {
+          while (0 != count)
+          {
+               uint8_t in_frame = (count > CAN_LAMP_COMMANDS_PER_FRAME) ? CAN_LAMP_COMMANDS_PER_FRAME : count;
+               frame.length = in_frame * CAN_LAMP_COMMAND_BYTES;
+               for (uint8_t i = 0; i < in_frame; i++)
+               {
+                    can_pack_lamp_command(p_commands++, &frame.data[i * CAN_LAMP_COMMAND_BYTES]);
+               }
+               count -= in_frame;
+               tx_queue_push(&frame);
+          }
+          can_load_tx_objects();
      }
-     // Else, the interrupt is unspecified in the documentation.
      else
      {
-          //
-          // Put break point here, but this should never happen.
-          //
+          // Backpressure, the owning service hears when there is room
+          tx_room_wanted = true;
+          queued = false;
      }
-
-     //
-     // Check interrupt status again to make sure everything is cleared (Page 82)?
-     //
+     ExitCritical();
+     return queued;
 }
 
-// ######################################################################################################################################################################
-// ---------------------------- Private Functions
-// ######################################################################################################################################################################
-
 /****************************************************************************
-     Private Function
-          can_master_receive_slave
+     Public Function
+          CAN_Unpack_Lamp_Commands
 
      Description
-          * This function should only be called once as part of the initialization for the internal CAN bus. *
-          Sets up a message object to receive data from any slave node.
-          This will only work IF the object is not cleared when we read the data;
-          IF the object is cleared then we will need to call this as part of every interrupt response.
-          Update: It looks like only the interrupt is cleared. (page 82 of API doc)
+          Unpacks the lamp commands in a frame received by a slave
      
      Parameters
-          None
+          CAN_Frame_t * p_frame: the frame, from CAN_Internal_Bus_Get_Frame
+          CAN_Lamp_Command_t * p_commands: room for CAN_LAMP_COMMANDS_PER_FRAME commands
+
+     Returns
+          uint8_t: number of commands unpacked, 0 if it is not a lamp frame
 
      Notes
-          We will most likely want to use a mask so that we can use a single object to receive data from multiple message id's
+          Packed commands are 4 bytes, the lamp in the top nibble of the first byte with the top 4 bits of the fade time
+          below it, then the rest of the fade time, the intensity and the colour.
 
 ****************************************************************************/
-static void can_master_receive_slave(void)
+uint8_t CAN_Unpack_Lamp_Commands(CAN_Frame_t const * p_frame, CAN_Lamp_Command_t * p_commands)
 {
-     //
-     // Definitions
-     //
-     #define NUM_DATA_BYTES_MASTER_RECEIVE_SLAVE 2                         // Number of bytes in data we are expecting to receive
-
-     //
-     // Configure message (follows from page 85 of peripheral manual)
-     //
-     tCANMsgObject message_object = {0};                                   // Declare struct
-     message_object.ui32MsgID = ALL_SLAVES_ID;                             // The message id for all slaves after the incoming ID is AND'ed with the mask below
-     message_object.ui32MsgIDMask = ALL_SLAVES_ID_MASK;                    // This mask is AND'ed with the incoming ID, if matches ID above, the message is received
-     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE \
-          | MSG_OBJ_USE_ID_FILTER;                                         // Enable RX interrupts and masking of incoming IDs
-     message_object.ui32MsgLen = NUM_DATA_BYTES_MASTER_RECEIVE_SLAVE;      // Number of data bytes we are expecting to receive
-     message_object.pui8MsgData = 0;                                       // Unused pointer value since receives send no data
-
-     //
-     // Message Object ID: use highest ID for incoming data from slaves
-     //
-     uint32_t object_id = MASTER_RX_OBJ_ID;                                // Use highest ID'ed object for incoming data from slaves
+     uint8_t count = 0;
 
-     //
-     // Set up message object for receiving data from slaves
-     //
-     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RX);
+     if (CAN_KIND_LAMPS != CAN_FRAME_KIND(p_frame->id))
+     {
+          return 0;
+     }
+     for (uint8_t offset = 0; (offset + CAN_LAMP_COMMAND_BYTES) <= p_frame->length; offset += CAN_LAMP_COMMAND_BYTES)
+     {
+          uint8_t const * p_packed = &p_frame->data[offset];
+          p_commands[count].lamp = p_packed[0] >> 4;
+          p_commands[count].fade_time = ((uint16_t)(p_packed[0] & 0x0F) << 8) | p_packed[1];
+          p_commands[count].intensity = p_packed[2];
+          p_commands[count].color = p_packed[3];
+          count++;
+     }
+     return count;
 }
 
 /****************************************************************************
-     Private Function
-          can_slave_respond_master
+     Public Function
+          CAN_Transport_Send
 
      Description
-          * This function should only be called once in the the initialization of a slave *
-          Sets up a message object to automatically respond to data requests from master
+          Starts sending a transfer of up to CAN_TRANSPORT_MAX_LENGTH bytes. ES_CAN_TRANSPORT_DONE is posted to the
+          owning service when the last frame has been queued (EventParam CAN_TRANSPORT_SENT), or when the transfer fails
+          (CAN_TRANSPORT_TIMED_OUT, CAN_TRANSPORT_REFUSED).
      
      Parameters
-          ui8 p_cmd_data: pointer to the requested data to be sent
+          ui32 node_id: the master sends to a single slave, a slave only to the master (MASTER_NODE_ID)
+          ui8 p_data: the data, which must be left alone until ES_CAN_TRANSPORT_DONE
+          ui16 length: number of bytes
+
+     Returns
+          bool: false if node_id or length is bad, if a transfer is already being sent, or if the transmit queue is full
+
+     Notes
+          There is one transfer at a time in each direction. We take no notice of the separation time in the flow
+          control, the frames go out as fast as the transmit queue can send them, which is what our receivers ask for.
 
 ****************************************************************************/
-static void can_slave_respond_master(void)
+bool CAN_Transport_Send(uint32_t node_id, uint8_t const * p_data, uint16_t length)
 {
-     //
-     // Definitions
-     //
-     #define NUM_DATA_BYTES_SLAVE_RESPOND_MASTER 2                         // Number of bytes in data we are sending
+     CAN_Frame_t frame;
+     bool started = false;
+     bool single_frame = (length <= TP_SINGLE_FRAME_DATA);
 
      //
-     // Configure message (follows from page 85 of peripheral manual)
+     // Check where it is going and how long it is
      //
-     tCANMsgObject message_object = {0};                                   // Declare struct
-     message_object.ui32MsgID = *p_My_Node_ID;                             // Message ID (The 11 or 29 bit identifier)
-     message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused for TX, set to 0
-     message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE;                     // Which interrupt flag do we use for this?? !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-     message_object.ui32MsgLen = NUM_DATA_BYTES_SLAVE_RESPOND_MASTER;      // Number of data bytes to send
-     message_object.pui8MsgData = p_My_Remote_Data;                        // Pointer to 1st data byte
+     if (MASTER_NODE_ID == *p_My_Node_ID)
+     {
+          if ((0 == node_id) || (0 != (node_id & ~ALL_SLAVE_BITS)) || (1 != count_bits(node_id)))
+          {
+               return false;
+          }
+     }
+     else if (MASTER_NODE_ID != node_id)
+     {
+          return false;
+     }
+     if ((0 == length) || (length > CAN_TRANSPORT_MAX_LENGTH))
+     {
+          return false;
+     }
 
      //
-     // Message Object ID: use second highest ID for fulfilling data requests
+     // A single frame if it fits, otherwise the first frame
      //
-     uint32_t object_id = SLAVE_RESPONSE_OBJ_ID;                           // 1 of 32 object buffers
+     frame.id = can_transport_id(node_id);
+     frame.object = 0;
+     if (single_frame)
+     {
+          frame.length = length + 1;
+          frame.data[0] = TP_SINGLE_FRAME | length;
+          for (uint8_t i = 0; i < length; i++)
+          {
+               frame.data[i + 1] = p_data[i];
+          }
+     }
+     else
+     {
+          frame.length = 8;
+          frame.data[0] = TP_FIRST_FRAME | (length >> 8);
+          frame.data[1] = length & 0xFF;
+          for (uint8_t i = 0; i < TP_FIRST_FRAME_DATA; i++)
+          {
+               frame.data[i + 2] = p_data[i];
+          }
+     }
 
-     //
-     // Set up message object for responding to requests from master
-     //
-     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RXTX_REMOTE);
+     EnterCritical();
+     if ((TP_IDLE == tp_tx_state) && (tx_queue_count < CAN_TX_QUEUE_SIZE))
+     {
+          tx_queue_push(&frame);
+          can_load_tx_objects();
+          if (!single_frame)
+          {
+               // The rest waits for the receiver's flow control
+               p_tp_tx_data = p_data;
+               tp_tx_length = length;
+               tp_tx_queued = TP_FIRST_FRAME_DATA;
+               tp_tx_peer = node_id;
+               tp_tx_sequence = 1;
+               tp_tx_state = TP_WAIT_FLOW;
+               START_TIMER(CAN_TRANSPORT_TIMER, CAN_TRANSPORT_TIMEOUT);
+          }
+          started = true;
+     }
+     else if (TP_IDLE == tp_tx_state)
+     {
+          // Backpressure, the owning service hears when there is room
+          tx_room_wanted = true;
+     }
+     ExitCritical();
+
+     if (started && single_frame)
+     {
+          ES_Event done_event;
+          done_event.EventType = ES_CAN_TRANSPORT_DONE;
+          done_event.EventParam = CAN_TRANSPORT_SENT;
+          POST_EVENT(done_event);
+     }
+     return started;
 }
 
 /****************************************************************************
-     Private Function
-          can_slave_receive_master
+     Public Function
+          CAN_Transport_Get_Rx
 
      Description
-          * This function should only be called once as part of the initialization for the internal CAN bus. *
-          Sets up a message object on a slave to receive data from the master that corresponds to a particular slave.
-          This will only work IF the object is not cleared when we read the data;
-          IF the object is cleared then we will need to call this as part of every interrupt response.
-          Update: It looks like only the interrupt is cleared. (page 82 of API doc)
+          Copies out the transfer announced by ES_CAN_TRANSPORT_RX, which frees the receiver for the next one
      
      Parameters
-          None
+          ui8 p_dest: where to put the data
+          ui16 max_length: the room at p_dest, any more is lost
+          ui32 p_from: where to put the id of the node that sent it
+
+     Returns
+          uint16_t: number of bytes copied, 0 if there is no transfer waiting
 
      Notes
-          None
+          Until this is called a new transfer is held off with a wait, or refused if there is already one held off.
 
 ****************************************************************************/
-static void can_slave_receive_master(void)
+uint16_t CAN_Transport_Get_Rx(uint8_t * p_dest, uint16_t max_length, uint32_t * p_from)
 {
-     //
-     // Definitions
-     //
-     #define NUM_DATA_BYTES_SLAVE_RECEIVE_MASTER 2                         // Number of bytes in data we are expecting to receive
+     uint16_t length = (tp_rx_length > max_length) ? max_length : tp_rx_length;
 
-     //
-     // Configure message (follows from page 85 of peripheral manual)
-     //
-     tCANMsgObject message_object = {0};                                   // Declare struct
-     message_object.ui32MsgID = *p_My_Node_ID;                             // The message id for this particular slave
-     message_object.ui32MsgIDMask = 0;                                     // This mask is AND'ed with the incoming ID, if matches ID above, the message is received
-     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE;                     // Enable RX interrupts and masking of incoming IDs
-     message_object.ui32MsgLen = NUM_DATA_BYTES_SLAVE_RECEIVE_MASTER;      // Number of data bytes we are expecting to receive
-     message_object.pui8MsgData = 0;                                       // Unused pointer value since receives send no data
-
-     //
-     // Message Object ID: use highest ID for incoming data from master
-     //
-     uint32_t object_id = SLAVE_RX_OBJ_ID;                                 // Use highest ID'ed object for incoming data from master
+     if (TP_UNREAD != tp_rx_state)
+     {
+          return 0;
+     }
+     for (uint16_t i = 0; i < length; i++)
+     {
+          p_dest[i] = tp_rx_buffer[i];
+     }
+     *p_from = tp_rx_peer;
+     tp_rx_state = TP_IDLE;
 
      //
-     // Set up message object for receiving commands from master
+     // Now take the transfer we held off, if there is one
      //
-     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RX);
+     if (true == tp_rx_holding)
+     {
+          tp_rx_holding = false;
+          can_transport_receive(&tp_rx_held);
+     }
+     return length;
 }
 
 /****************************************************************************
-     Private Function
-          find_avail_tx_object
+     Public Function
+          CAN_Internal_Bus_Post_Transport_Timeout
 
      Description
-          Finds highest priority available message object for transmission
+          The post function for CAN_TRANSPORT_TIMER in the TIMER_TABLE, not for calling directly. Gives up on a transfer
+          whose receiver has not sent a flow control in CAN_TRANSPORT_TIMEOUT.
      
      Parameters
-          CAN bus base
+          ES_Event ThisEvent: the ES_TIMEOUT
 
      Returns
-          uint32_t: integer object (1-32)
+          bool: true
 
      Notes
-          None
+          Called by ES_Timer_Tick_Resp from ES_Run, like the service, so only the ISR can get in while it runs. The
+          timer is restarted by every flow control, so the wait for the next
+          one is timed from the last one; a block takes a few ms, so that is close enough. While a block is still being
+          queued the timer is simply restarted.
 
 ****************************************************************************/
-static uint32_t find_avail_tx_object(uint32_t ui32Base)
+bool CAN_Internal_Bus_Post_Transport_Timeout(ES_Event ThisEvent)
 {
-     //
-     // Definitions
-     //
-     #define LSB_SET          0x01
-     #define MAX_TX_OBJECTS   30
+     bool timed_out = false;
 
-     //
-     // Get bit map of object pending transmission
-     //
-     uint32_t tx_bit_map = CANStatusGet(ui32Base, (tCANStsReg) CAN_STS_TXREQUEST);   // Returns bit map of objects pending transmission
+     EnterCritical();
+     if (TP_WAIT_FLOW == tp_tx_state)
+     {
+          tp_tx_state = TP_IDLE;
+          timed_out = true;
+     }
+     else if (TP_SENDING == tp_tx_state)
+     {
+          START_TIMER(CAN_TRANSPORT_TIMER, CAN_TRANSPORT_TIMEOUT);
+     }
+     ExitCritical();
 
-     //
-     // Find lowest object available for transmission
-     //
-     uint32_t object_id = 0;                                                         // Return invalid object id if none are available
-     for (int i = 0; i < MAX_TX_OBJECTS; i++)
+     if (true == timed_out)
      {
-          if ( ((tx_bit_map >> i) & LSB_SET) == 0 )
-          {
-               object_id = i+1;
-               break;
-          }
+          ThisEvent.EventType = ES_CAN_TRANSPORT_DONE;
+          ThisEvent.EventParam = CAN_TRANSPORT_TIMED_OUT;
+          POST_EVENT(ThisEvent);
      }
+     return true;
+}
 
-     //
-     // Return object id
-     //
-     return object_id;
+/****************************************************************************
+     Public Function
+          CAN_Internal_Bus_Get_Rx_Dropped
+
+     Description
+          Returns the number of frames lost because the receive ring was full, because a message object was
+          overwritten before the ISR could read it, or because a transport single frame came in with another already
+          waiting to be read
+     
+     Parameters
+          None
+
+****************************************************************************/
+uint32_t CAN_Internal_Bus_Get_Rx_Dropped(void)
+{
+     return rx_dropped + tp_rx_dropped;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Internal_Bus_Get_Tx_Room
+
+     Description
+          Returns the number of frames that can be sent before the transmit queue is full, so that a burst can be
+          sized to fit
+     
+     Parameters
+          None
+
+****************************************************************************/
+uint8_t CAN_Internal_Bus_Get_Tx_Room(void)
+{
+     return CAN_TX_QUEUE_SIZE - tx_queue_count;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Master_Poll_Slaves
+
+     Description
+          Requests data from every slave named, all at once. One remote request object is armed per slave, so the
+          controller sends the requests back to back. ES_CAN_POLL_DONE, with the number of slaves that did not reply in
+          EventParam, is posted to the owning service when the last reply is in or the timeout runs out.
+     
+     Parameters
+          ui32 slave_ids: the OR of the ids of the slaves to poll (e.g. ALL_SLAVES_GROUP)
+          ui16 timeout: how long to wait for the replies, in ticks of the ES timers (ms at the usual 1 mS rate)
+
+     Returns
+          bool: false if a poll is already running, if slave_ids names no slave or includes the master, if it
+                names more than CAN_POLL_OBJECT_COUNT slaves, or if timeout is 0 or CAN_POLL_TIMER can not be started
+
+     Notes
+          The replies of the last poll can be read until the next one is started.
+          Once its request is sent a poll object receives the data frames with its slave's id, and being below
+          MASTER_RX_OBJ_ID it gets them first, so each is cleared as soon as its reply is in or the poll ends. Until
+          then a frame that the slave sends of its own accord is taken for its reply.
+
+****************************************************************************/
+bool CAN_Master_Poll_Slaves(uint32_t slave_ids, uint16_t timeout)
+{
+     //
+     // Definitions
+     //
+     #define NUM_DATA_BYTES_MASTER_POLL_SLAVE 2                            // Number of bytes in data we are expecting from each slave
+
+     if ((0 == slave_ids) || (0 != (slave_ids & ~ALL_SLAVE_BITS)) || (count_bits(slave_ids) > CAN_POLL_OBJECT_COUNT) ||
+         (0 == timeout) || (true == poll_active))
+     {
+          return false;
+     }
+
+     //
+     // Without the timeout a slave that never replies would leave the poll running for good. It is left to run even
+     // if the replies beat it, see CAN_Internal_Bus_Post_Poll_Timeout
+     //
+     if (ES_Timer_OK != START_TIMER(CAN_POLL_TIMER, timeout))
+     {
+          return false;
+     }
+
+     //
+     // Configure message (follows from page 85 of peripheral manual), only the id changes from object to object
+     //
+     tCANMsgObject message_object = {0};                                   // Declare struct
+     message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused, set to 0
+     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE \
+          | MSG_OBJ_EXTENDED_ID;                                           // Interrupt when the reply arrives, the object turns into a receive object once the request is sent
+     message_object.ui32MsgLen = NUM_DATA_BYTES_MASTER_POLL_SLAVE;         // Number of data bytes we are expecting to receive
+     message_object.pui8MsgData = 0;                                       // Unused pointer value since requests use no data
+
+     //
+     // Start the poll and arm an object per slave in one go, with interrupts off so that no late reply to the last
+     // poll can be taken for one to this poll, and since the ISR also uses the message interface registers
+     //
+     EnterCritical();
+     poll_pending = slave_ids;
+     poll_replied = 0;
+     poll_active = true;
+     poll_done_owed = false;
+     uint8_t index = 0;
+     for (; 0 != slave_ids; index++)
+     {
+          poll_ids[index] = slave_ids & (~slave_ids + 1);                  // Lowest slave left
+          slave_ids &= ~poll_ids[index];
+          message_object.ui32MsgID = poll_ids[index];
+          CANMessageSet(CAN_INTERNAL_BUS_BASE, CAN_POLL_OBJECT_FIRST + index, &message_object, (tMsgObjType) MSG_OBJ_TYPE_TX_REMOTE);
+     }
+     for (; index < CAN_POLL_OBJECT_COUNT; index++)
+     {
+          poll_ids[index] = 0;                                             // Not in this poll, their objects are clear
+     }
+     ExitCritical();
+     return true;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Master_Get_Poll_Reply
+
+     Description
+          Gets a slave's reply to the last poll
+     
+     Parameters
+          ui32 slave_id: id of slave
+          CAN_Frame_t * p_frame: where to put the reply
+
+     Returns
+          bool: false if the slave was not in the last poll or has not replied
+
+****************************************************************************/
+bool CAN_Master_Get_Poll_Reply(uint32_t slave_id, CAN_Frame_t * p_frame)
+{
+     if (0 == (poll_replied & slave_id))
+     {
+          return false;
+     }
+     for (uint8_t index = 0; index < CAN_POLL_OBJECT_COUNT; index++)
+     {
+          if (poll_ids[index] == slave_id)
+          {
+               *p_frame = poll_replies[index];                             // Written before its bit was set in poll_replied
+               return true;
+          }
+     }
+     return false;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Master_Get_Poll_Replied
+
+     Description
+          Returns the bit map of the slaves that have replied to the last poll, the ids OR'ed together
+     
+     Parameters
+          None
+
+****************************************************************************/
+uint32_t CAN_Master_Get_Poll_Replied(void)
+{
+     return poll_replied;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Internal_Bus_Post_Poll_Timeout
+
+     Description
+          The post function for CAN_POLL_TIMER in the TIMER_TABLE, not for calling directly. Ends a poll that is still
+          waiting on replies, and posts ES_CAN_POLL_DONE if it is owed.
+     
+     Parameters
+          ES_Event ThisEvent: the ES_TIMEOUT
+
+     Returns
+          bool: true
+
+     Notes
+          Called by ES_Timer_Tick_Resp from ES_Run, like the service, so only the ISR can get in while it runs. The
+          objects still waiting are cleared, so a late reply goes to MASTER_RX_OBJ_ID like any other frame from its
+          slave; one already in an object is thrown away by the ISR. The timer is not stopped when the last reply comes
+          in, so it also delivers an ES_CAN_POLL_DONE that the ISR could not post.
+
+****************************************************************************/
+bool CAN_Internal_Bus_Post_Poll_Timeout(ES_Event ThisEvent)
+{
+     bool post_done;
+
+     EnterCritical();
+     if (true == poll_active)
+     {
+          poll_active = false;
+          poll_done_owed = true;
+          for (uint8_t index = 0; index < CAN_POLL_OBJECT_COUNT; index++)
+          {
+               if (0 != (poll_pending & poll_ids[index]))
+               {
+                    CANMessageClear(CAN_INTERNAL_BUS_BASE, CAN_POLL_OBJECT_FIRST + index);
+               }
+          }
+     }
+     post_done = poll_done_owed;
+     poll_done_owed = false;
+     ExitCritical();
+
+     if (true == post_done)
+     {
+          ThisEvent.EventType = ES_CAN_POLL_DONE;
+          ThisEvent.EventParam = count_bits(poll_pending);
+          POST_EVENT(ThisEvent);
+     }
+     return true;
+}
+
+/****************************************************************************
+     Public Function
+          CAN_Internal_Bus_ISR
+
+     Description
+          This function handles CAN interrupts on the internal bus
+     
+     Parameters
+          None
+
+     Notes
+          Every message object with an interrupt pending on entry is serviced, received frames go into the receive ring
+          and transmit objects that have finished are loaded with the next queued frame.
+          Objects that become pending while we run keep the interrupt asserted, so we come straight back for them.
+          One ES_CAN_RX, with the number of frames waiting in EventParam, is posted per batch.
+
+****************************************************************************/
+void CAN_Internal_Bus_ISR(void)
+{
+     uint8_t frames_added = 0;
+
+     //
+     // A controller status interrupt (bus off, error passive...) is cleared by reading the status
+     //
+     if (CAN_INT_INTID_STATUS == CANIntStatus(CAN_INTERNAL_BUS_BASE, (tCANIntStsReg) CAN_INT_STS_CAUSE))
+     {
+          uint32_t controller_status = CANStatusGet(CAN_INTERNAL_BUS_BASE, (tCANStsReg) CAN_STS_CONTROL);
+          (void) controller_status;                                        // Nothing to do with it yet
+     }
+
+     //
+     // Service every message object that has an interrupt pending, highest numbered (the receive objects) first
+     //
+     uint32_t pending = CANIntStatus(CAN_INTERNAL_BUS_BASE, (tCANIntStsReg) CAN_INT_STS_OBJECT);
+     while (0 != pending)
+     {
+          uint32_t object_id = ES_GetMSBitSet32(pending) + 1;
+          pending &= ~OBJECT_BIT(object_id);
+
+          if (0 != (rx_object_map & OBJECT_BIT(object_id)))
+          {
+               if (true == can_receive_frame(object_id))
+               {
+                    frames_added++;
+               }
+          }
+          else if (0 != (CAN_TX_OBJECT_MAP & OBJECT_BIT(object_id)))
+          {
+               can_tx_complete(object_id);
+          }
+          else if (0 != (CAN_POLL_OBJECT_MAP & OBJECT_BIT(object_id)))
+          {
+               can_poll_reply(object_id);
+          }
+          else
+          {
+               // A transmission complete outside the pool, nothing to do but clear it
+               CANIntClear(CAN_INTERNAL_BUS_BASE, object_id);
+          }
+     }
+
+     //
+     // Tell the owning service, unless it already has an event on its way for frames that it has not yet taken
+     //
+     if ((0 != frames_added) && (false == rx_event_posted))
+     {
+          ES_Event rx_event;
+          rx_event.EventType = ES_CAN_RX;
+          rx_event.EventParam = (uint8_t)(rx_tail - rx_head);
+          rx_event_posted = POST_FROM_ISR(rx_event);
+     }
+
+     //
+     // Tell the owning service when there is room again after a refused send
+     //
+     if ((true == tx_room_wanted) && (tx_queue_count < CAN_TX_QUEUE_SIZE))
+     {
+          ES_Event tx_event;
+          tx_event.EventType = ES_CAN_TX_READY;
+          tx_event.EventParam = CAN_TX_QUEUE_SIZE - tx_queue_count;
+          tx_room_wanted = !POST_FROM_ISR(tx_event);
+     }
+
+     //
+     // Tell the owning service when the last reply to a poll is in. If the channel is full, the poll timeout posts it
+     //
+     if (true == poll_done_owed)
+     {
+          ES_Event poll_event;
+          poll_event.EventType = ES_CAN_POLL_DONE;
+          poll_event.EventParam = 0;                                       // Everyone replied
+          poll_done_owed = !POST_FROM_ISR(poll_event);
+     }
+
+     //
+     // Tell the owning service when the last frame of a transfer is queued
+     //
+     if (true == tp_tx_done_owed)
+     {
+          ES_Event done_event;
+          done_event.EventType = ES_CAN_TRANSPORT_DONE;
+          done_event.EventParam = tp_tx_result;
+          tp_tx_done_owed = !POST_FROM_ISR(done_event);
+     }
+}
+
+// ######################################################################################################################################################################
+// ---------------------------- Private Functions
+// ######################################################################################################################################################################
+
+/****************************************************************************
+     Private Function
+          can_master_receive_slave
+
+     Description
+          * This function should only be called once as part of the initialization for the internal CAN bus. *
+          Sets up a message object to receive data from any slave node.
+          This will only work IF the object is not cleared when we read the data;
+          IF the object is cleared then we will need to call this as part of every interrupt response.
+          Update: It looks like only the interrupt is cleared. (page 82 of API doc)
+     
+     Parameters
+          None
+
+     Notes
+          We will most likely want to use a mask so that we can use a single object to receive data from multiple message id's
+
+****************************************************************************/
+static void can_master_receive_slave(void)
+{
+     //
+     // Definitions
+     //
+     #define NUM_DATA_BYTES_MASTER_RECEIVE_SLAVE 8                         // Up to a full frame, replies are 2 bytes but transport frames are 8
+
+     //
+     // Configure message (follows from page 85 of peripheral manual)
+     //
+     tCANMsgObject message_object = {0};                                   // Declare struct
+     message_object.ui32MsgID = ALL_SLAVES_ID;                             // The message id for all slaves after the incoming ID is AND'ed with the mask below
+     message_object.ui32MsgIDMask = ALL_SLAVES_ID_MASK;                    // This mask is AND'ed with the incoming ID, if matches ID above, the message is received
+     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE \
+          | MSG_OBJ_USE_ID_FILTER | MSG_OBJ_EXTENDED_ID;                   // Enable RX interrupts and masking of incoming IDs
+     message_object.ui32MsgLen = NUM_DATA_BYTES_MASTER_RECEIVE_SLAVE;      // Number of data bytes we are expecting to receive
+     message_object.pui8MsgData = 0;                                       // Unused pointer value since receives send no data
+
+     //
+     // Message Object ID: use highest ID for incoming data from slaves
+     //
+     uint32_t object_id = MASTER_RX_OBJ_ID;                                // Use highest ID'ed object for incoming data from slaves
+
+     //
+     // Set up message object for receiving data from slaves
+     //
+     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RX);
+}
+
+/****************************************************************************
+     Private Function
+          can_slave_respond_master
+
+     Description
+          * This function should only be called once in the the initialization of a slave *
+          Sets up a message object to automatically respond to data requests from master
+     
+     Parameters
+          ui8 p_cmd_data: pointer to the requested data to be sent
+
+****************************************************************************/
+static void can_slave_respond_master(void)
+{
+     //
+     // Definitions
+     //
+     #define NUM_DATA_BYTES_SLAVE_RESPOND_MASTER 2                         // Number of bytes in data we are sending
+
+     //
+     // Configure message (follows from page 85 of peripheral manual)
+     //
+     tCANMsgObject message_object = {0};                                   // Declare struct
+     message_object.ui32MsgID = *p_My_Node_ID;                             // Message ID (The 11 or 29 bit identifier)
+     message_object.ui32MsgIDMask = 0;                                     // Used to ensure incoming message is a specific data frame, unused for TX, set to 0
+     message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE \
+          | MSG_OBJ_EXTENDED_ID;                                           // Which interrupt flag do we use for this?? !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+     message_object.ui32MsgLen = NUM_DATA_BYTES_SLAVE_RESPOND_MASTER;      // Number of data bytes to send
+     message_object.pui8MsgData = p_My_Remote_Data;                        // Pointer to 1st data byte
+
+     //
+     // Message Object ID: use second highest ID for fulfilling data requests
+     //
+     uint32_t object_id = SLAVE_RESPONSE_OBJ_ID;                           // 1 of 32 object buffers
+
+     //
+     // Set up message object for responding to requests from master
+     //
+     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RXTX_REMOTE);
+}
+
+/****************************************************************************
+     Private Function
+          can_slave_receive_master
+
+     Description
+          * This function should only be called once as part of the initialization for the internal CAN bus. *
+          Sets up a message object on a slave to receive the commands from the master that include this slave, whether
+          they are for this slave alone or for a group.
+          This will only work IF the object is not cleared when we read the data;
+          IF the object is cleared then we will need to call this as part of every interrupt response.
+          Update: It looks like only the interrupt is cleared. (page 82 of API doc)
+     
+     Parameters
+          None
+
+     Notes
+          None
+
+****************************************************************************/
+static void can_slave_receive_master(void)
+{
+     //
+     // Definitions
+     //
+     #define NUM_DATA_BYTES_SLAVE_RECEIVE_MASTER 8                         // Up to a full frame, commands are 2 bytes but lamp and transport frames are 8
+
+     //
+     // Configure message (follows from page 85 of peripheral manual)
+     //
+     tCANMsgObject message_object = {0};                                   // Declare struct
+     message_object.ui32MsgID = MASTER_NODE_ID | *p_My_Node_ID;            // From the master, with our bit set
+     message_object.ui32MsgIDMask = MASTER_NODE_ID | *p_My_Node_ID;        // This mask is AND'ed with the incoming ID, if matches ID above, the message is received
+     message_object.ui32Flags = MSG_OBJ_RX_INT_ENABLE \
+          | MSG_OBJ_USE_ID_FILTER | MSG_OBJ_EXTENDED_ID;                   // Enable RX interrupts and masking of incoming IDs
+     message_object.ui32MsgLen = NUM_DATA_BYTES_SLAVE_RECEIVE_MASTER;      // Number of data bytes we are expecting to receive
+     message_object.pui8MsgData = 0;                                       // Unused pointer value since receives send no data
+
+     //
+     // Message Object ID: use highest ID for incoming data from master
+     //
+     uint32_t object_id = SLAVE_RX_OBJ_ID;                                 // Use highest ID'ed object for incoming data from master
+
+     //
+     // Set up message object for receiving commands from master
+     //
+     CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_RX);
+}
+
+/****************************************************************************
+     Private Function
+          can_receive_frame
+
+     Description
+          Reads a receive object into the next free slot of the receive ring, and clears its interrupt
+     
+     Parameters
+          uint32_t object_id: the message object (1-32)
+
+     Returns
+          bool: true if a frame was added to the ring
+
+     Notes
+          Only called from CAN_Internal_Bus_ISR. When the ring is full the frame is still read, to clear the
+          interrupt, but is dropped.
+
+****************************************************************************/
+static bool can_receive_frame(uint32_t object_id)
+{
+     static uint8_t overflow_data[8];                                      // Where frames go when the ring is full
+     uint8_t tail = rx_tail;                                               // We are the only writer, so this is current
+     bool ring_full = ((uint8_t)(tail - rx_head) >= CAN_RX_RING_SIZE);
+     CAN_Frame_t * p_slot = &rx_ring[tail & CAN_RX_RING_MASK];
+
+     //
+     // Finish reading the head before re-using the slot that the service gave back
+     //
+     ES_MemoryBarrier();
+
+     //
+     // Read the message object straight into the ring
+     //
+     tCANMsgObject message_object = {0};                                   // Declare struct
+     message_object.pui8MsgData = ring_full ? overflow_data : p_slot->data;
+     CANMessageGet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, true);
+
+     if (0 != (message_object.ui32Flags & MSG_OBJ_DATA_LOST))
+     {
+          rx_dropped++;                                                    // The object was overwritten before we got to it
+     }
+     if (ring_full)
+     {
+          rx_dropped++;
+          return false;
+     }
+
+     p_slot->id = message_object.ui32MsgID;
+     p_slot->object = (uint8_t) object_id;
+     p_slot->length = (uint8_t) message_object.ui32MsgLen;
+
+     //
+     // The frame must be complete before the new tail makes it visible
+     //
+     ES_MemoryBarrier();
+     rx_tail = tail + 1;
+     return true;
+}
+
+/****************************************************************************
+     Private Function
+          can_take_frame
+
+     Description
+          Takes the oldest frame out of the receive ring
+     
+     Parameters
+          CAN_Frame_t * p_frame: where to put the frame
+
+     Returns
+          bool: false if the ring is empty
+
+****************************************************************************/
+static bool can_take_frame(CAN_Frame_t * p_frame)
+{
+     uint8_t head = rx_head;                                               // We are the only writer, so this is current
+
+     //
+     // Nothing left, so let the ISR post the next batch. Look once more, a frame that arrived just before we let go
+     // of the event would otherwise wait for the next one.
+     //
+     if (head == rx_tail)
+     {
+          rx_event_posted = false;
+          ES_MemoryBarrier();
+          if (head == rx_tail)
+          {
+               return false;
+          }
+     }
+
+     //
+     // Read the frame only after we have seen the tail that published it, then hand the slot back
+     //
+     ES_MemoryBarrier();
+     *p_frame = rx_ring[head & CAN_RX_RING_MASK];
+     ES_MemoryBarrier();
+     rx_head = head + 1;
+     return true;
+}
+
+/****************************************************************************
+     Private Function
+          can_queue_frame
+
+     Description
+          Adds a frame to the transmit queue, and loads it straight into a transmit object if one is free
+     
+     Parameters
+          uint32_t id: the 11 or 29 bit identifier
+          uint8_t * p_data: the data, copied into the queue
+          uint8_t length: number of data bytes (up to 8)
+
+     Returns
+          bool: false if the queue is full
+
+     Notes
+          Called from the service side, so the queue and CANMessageSet are used with interrupts off.
+
+****************************************************************************/
+static bool can_queue_frame(uint32_t id, uint8_t * p_data, uint8_t length)
+{
+     CAN_Frame_t frame;
+     bool queued = true;
+
+     //
+     // Copy the frame now, so that the caller's data can change while it waits
+     //
+     frame.id = id;
+     frame.object = 0;                                                     // Not known until it is loaded
+     frame.length = (length > sizeof(frame.data)) ? sizeof(frame.data) : length;
+     for (uint8_t i = 0; i < frame.length; i++)
+     {
+          frame.data[i] = p_data[i];
+     }
+
+     EnterCritical();
+     if (tx_queue_count < CAN_TX_QUEUE_SIZE)
+     {
+          tx_queue_push(&frame);
+          can_load_tx_objects();
+     }
+     else
+     {
+          // Backpressure, the owning service hears when there is room
+          tx_room_wanted = true;
+          queued = false;
+     }
+     ExitCritical();
+     return queued;
+}
+
+/****************************************************************************
+     Private Function
+          can_load_tx_objects
+
+     Description
+          Moves frames from the head of the transmit queue into the transmit objects above the highest busy one,
+          until the queue or the pool runs out
+     
+     Parameters
+          None
+
+     Notes
+          Call with interrupts off, or from the ISR.
+          The controller sends the lowest numbered of its pending objects first, so a frame loaded below a busy
+          object would go ahead of it, and with a steady stream the busy object could wait forever. Loading only
+          above the highest busy object keeps the objects going out in the order they were loaded; the pool starts
+          again from object 1 once the top one has gone.
+
+****************************************************************************/
+static void can_load_tx_objects(void)
+{
+     CAN_Frame_t frame;
+     uint32_t object_id = 1;
+
+     if (0 != tx_busy_objects)
+     {
+          object_id = ES_GetMSBitSet32(tx_busy_objects) + 2;               // One above the highest busy object
+     }
+
+     while ((object_id <= CAN_TX_OBJECT_COUNT) && (0 != tx_queue_count))
+     {
+          tx_busy_objects |= OBJECT_BIT(object_id);
+          tx_queue_pop(&frame);
+
+          tCANMsgObject message_object = {0};                              // Declare struct
+          message_object.ui32MsgID = frame.id;                             // Message ID (The 11 or 29 bit identifier)
+          message_object.ui32MsgIDMask = 0;                                // Used to ensure incoming message is a specific data frame, unused for TX, set to 0
+          message_object.ui32Flags = MSG_OBJ_TX_INT_ENABLE \
+               | MSG_OBJ_EXTENDED_ID;                                      // Generate interrupt on TX complete, to load the next frame
+          message_object.ui32MsgLen = frame.length;                        // Number of data bytes to send
+          message_object.pui8MsgData = frame.data;                         // Copied into the object by CANMessageSet
+          CANMessageSet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, (tMsgObjType) MSG_OBJ_TYPE_TX);
+          object_id++;
+     }
+}
+
+/****************************************************************************
+     Private Function
+          can_tx_complete
+
+     Description
+          Handles the TX complete interrupt of a pool object: the object is free again, so load the next frames
+     
+     Parameters
+          uint32_t object_id: the message object (1-32)
+
+     Notes
+          Only called from CAN_Internal_Bus_ISR
+
+****************************************************************************/
+static void can_tx_complete(uint32_t object_id)
+{
+     CANIntClear(CAN_INTERNAL_BUS_BASE, object_id);
+     tx_busy_objects &= ~OBJECT_BIT(object_id);
+     can_transport_pump();                                                 // Top up the queue from a transfer first
+     can_load_tx_objects();
+}
+
+/****************************************************************************
+     Private Function
+          can_poll_reply
+
+     Description
+          Takes a reply to a poll out of its poll object and into the poll table, clears the object, and ends the poll
+          when it was the last one waited for
+     
+     Parameters
+          uint32_t object_id: the message object (1-32)
+
+     Notes
+          Only called from CAN_Internal_Bus_ISR. A reply to a poll that is over, or a second reply, is thrown away.
+
+****************************************************************************/
+static void can_poll_reply(uint32_t object_id)
+{
+     uint8_t index = object_id - CAN_POLL_OBJECT_FIRST;
+     uint8_t data[8];
+
+     //
+     // Read the reply and clear the interrupt
+     //
+     tCANMsgObject message_object = {0};
+     message_object.pui8MsgData = data;
+     CANMessageGet(CAN_INTERNAL_BUS_BASE, object_id, &message_object, true);
+
+     //
+     // The object is done with, left armed it would take every frame the slave sends from now on
+     //
+     CANMessageClear(CAN_INTERNAL_BUS_BASE, object_id);
+
+     //
+     // Keep it if we are still waiting on this slave, the poll timeout may already have ended the poll. Nothing else
+     // touches the poll while we run, so no critical section is needed here
+     //
+     if ((true == poll_active) && (0 != (poll_pending & poll_ids[index])))
+     {
+          CAN_Frame_t * p_reply = &poll_replies[index];
+          p_reply->id = message_object.ui32MsgID;
+          p_reply->object = (uint8_t)object_id;
+          p_reply->length = (message_object.ui32MsgLen > sizeof(p_reply->data)) ? sizeof(p_reply->data) : (uint8_t)message_object.ui32MsgLen;
+          for (uint8_t i = 0; i < p_reply->length; i++)
+          {
+               p_reply->data[i] = data[i];
+          }
+          poll_pending &= ~poll_ids[index];
+          poll_replied |= poll_ids[index];
+          if (0 == poll_pending)
+          {
+               poll_active = false;
+               poll_done_owed = true;
+          }
+     }
+}
+
+/****************************************************************************
+     Private Function
+          count_bits
+
+     Description
+          Returns the number of bits set, one pass per set bit
+     
+     Parameters
+          uint32_t bits: the bit map
+
+****************************************************************************/
+static uint8_t count_bits(uint32_t bits)
+{
+     uint8_t count = 0;
+
+     while (0 != bits)
+     {
+          bits &= bits - 1;                                                // Clear the lowest set bit
+          count++;
+     }
+     return count;
+}
+
+/****************************************************************************
+     Private Function
+          can_pack_lamp_command
+
+     Description
+          Packs a lamp command into CAN_LAMP_COMMAND_BYTES bytes, see CAN_Unpack_Lamp_Commands
+     
+     Parameters
+          CAN_Lamp_Command_t * p_command: the command, already checked
+          uint8_t * p_dest: where to put it
+
+****************************************************************************/
+static void can_pack_lamp_command(CAN_Lamp_Command_t const * p_command, uint8_t * p_dest)
+{
+     p_dest[0] = (uint8_t)(p_command->lamp << 4) | (uint8_t)(p_command->fade_time >> 8);
+     p_dest[1] = (uint8_t) p_command->fade_time;
+     p_dest[2] = p_command->intensity;
+     p_dest[3] = p_command->color;
+}
+
+/****************************************************************************
+     Private Function
+          can_transport_id
+
+     Description
+          Returns the identifier for a transport frame to a node
+     
+     Parameters
+          uint32_t peer: the node at the other end, a single slave or MASTER_NODE_ID
+
+     Notes
+          The master's frames carry the master bit and the slave's bit, so they pass the slave's receive filter. A
+          slave's frames carry only its own bit, so the master can tell who sent them.
+
+****************************************************************************/
+static uint32_t can_transport_id(uint32_t peer)
+{
+     if (MASTER_NODE_ID == *p_My_Node_ID)
+     {
+          return CAN_KIND_TRANSPORT | MASTER_NODE_ID | peer;
+     }
+     return CAN_KIND_TRANSPORT | *p_My_Node_ID;
+}
+
+/****************************************************************************
+     Private Function
+          can_transport_pump
+
+     Description
+          Queues consecutive frames of the transfer being sent, until its block is done or it has its share of the
+          transmit queue
+     
+     Parameters
+          None
+
+     Notes
+          Called with interrupts off, or from CAN_Internal_Bus_ISR. Each frame sent makes room for the next, so the
+          transfer never holds more than CAN_TRANSPORT_TX_SHARE of the queue and commands can still get in.
+
+****************************************************************************/
+static void can_transport_pump(void)
+{
+     CAN_Frame_t frame;
+
+     frame.id = can_transport_id(tp_tx_peer);
+     frame.object = 0;
+     while ((TP_SENDING == tp_tx_state) && (tx_queue_count < CAN_TRANSPORT_TX_SHARE))
+     {
+          uint16_t left = tp_tx_length - tp_tx_queued;
+          uint8_t in_frame = (left > TP_CONSECUTIVE_FRAME_DATA) ? TP_CONSECUTIVE_FRAME_DATA : (uint8_t) left;
+
+          frame.length = in_frame + 1;
+          frame.data[0] = TP_CONSECUTIVE_FRAME | (tp_tx_sequence & 0x0F);
+          for (uint8_t i = 0; i < in_frame; i++)
+          {
+               frame.data[i + 1] = p_tp_tx_data[tp_tx_queued + i];
+          }
+          tx_queue_push(&frame);
+          tp_tx_queued += in_frame;
+          tp_tx_sequence++;
+
+          if (tp_tx_queued >= tp_tx_length)
+          {
+               tp_tx_state = TP_IDLE;
+               tp_tx_result = CAN_TRANSPORT_SENT;
+               tp_tx_done_owed = true;
+          }
+          else if ((0 != tp_tx_block_left) && (0 == --tp_tx_block_left))
+          {
+               tp_tx_state = TP_WAIT_FLOW;                                 // The timer is still running from the flow control
+          }
+     }
+}
+
+/****************************************************************************
+     Private Function
+          can_transport_receive
+
+     Description
+          Handles a transport frame taken out of the receive ring, for either end of a transfer
+     
+     Parameters
+          CAN_Frame_t * p_frame: the frame
+
+     Notes
+          Only called from the owning service. There is one receive buffer: while it waits for CAN_Transport_Get_Rx a
+          single or first frame is held (a first frame with a wait flow control), and anything after that is refused.
+          A reception whose sender has been quiet for CAN_TRANSPORT_TIMEOUT is dropped when the next frame comes in.
+
+****************************************************************************/
+static void can_transport_receive(CAN_Frame_t const * p_frame)
+{
+     uint32_t peer = (0 != (p_frame->id & MASTER_NODE_ID)) ? MASTER_NODE_ID : (p_frame->id & ALL_SLAVE_BITS);
+     bool receiver_free;
+     uint16_t length;
+
+     if (0 == p_frame->length)
+     {
+          return;
+     }
+     if ((TP_RECEIVING == tp_rx_state) && ES_Timer_HasElapsed(tp_rx_last, CAN_TRANSPORT_TIMEOUT))
+     {
+          tp_rx_state = TP_IDLE;
+     }
+
+     //
+     // A new transfer from the node we are receiving from replaces the one it gave up on
+     //
+     receiver_free = (TP_IDLE == tp_rx_state) || ((TP_RECEIVING == tp_rx_state) && (peer == tp_rx_peer));
+
+     switch (p_frame->data[0] & TP_TYPE_MASK)
+     {
+          case TP_SINGLE_FRAME:
+               length = p_frame->data[0] & 0x0F;
+               if ((0 == length) || (length >= p_frame->length))
+               {
+                    break;                                                 // Malformed
+               }
+               if (receiver_free)
+               {
+                    for (uint8_t i = 0; i < length; i++)
+                    {
+                         tp_rx_buffer[i] = p_frame->data[i + 1];
+                    }
+                    tp_rx_length = length;
+                    tp_rx_peer = peer;
+                    tp_rx_state = TP_UNREAD;
+
+                    ES_Event rx_event;
+                    rx_event.EventType = ES_CAN_TRANSPORT_RX;
+                    rx_event.EventParam = length;
+                    POST_EVENT(rx_event);
+               }
+               else if ((TP_UNREAD == tp_rx_state) && (false == tp_rx_holding))
+               {
+                    tp_rx_held = *p_frame;
+                    tp_rx_holding = true;
+               }
+               else
+               {
+                    tp_rx_dropped++;                                       // A single frame has no flow control to refuse it with
+               }
+               break;
+
+          case TP_FIRST_FRAME:
+               length = ((uint16_t)(p_frame->data[0] & 0x0F) << 8) | p_frame->data[1];
+               if ((8 != p_frame->length) || (length <= TP_SINGLE_FRAME_DATA))
+               {
+                    break;                                                 // Malformed
+               }
+               if ((length > CAN_TRANSPORT_RX_SIZE) || ((false == receiver_free) && ((TP_UNREAD != tp_rx_state) || tp_rx_holding)))
+               {
+                    can_transport_send_flow(peer, TP_FLOW_OVERFLOW);
+               }
+               else if (false == receiver_free)
+               {
+                    // Taken once the transfer waiting to be read is out of the way
+                    tp_rx_held = *p_frame;
+                    tp_rx_holding = true;
+                    can_transport_send_flow(peer, TP_FLOW_WAIT);
+               }
+               else
+               {
+                    for (uint8_t i = 0; i < TP_FIRST_FRAME_DATA; i++)
+                    {
+                         tp_rx_buffer[i] = p_frame->data[i + 2];
+                    }
+                    tp_rx_length = length;
+                    tp_rx_received = TP_FIRST_FRAME_DATA;
+                    tp_rx_peer = peer;
+                    tp_rx_sequence = 1;
+                    tp_rx_block_left = CAN_TRANSPORT_BLOCK_SIZE;
+                    tp_rx_last = ES_Timer_GetTime();
+                    tp_rx_state = TP_RECEIVING;
+                    can_transport_send_flow(peer, TP_FLOW_CONTINUE);
+               }
+               break;
+
+          case TP_CONSECUTIVE_FRAME:
+               if ((TP_RECEIVING != tp_rx_state) || (peer != tp_rx_peer))
+               {
+                    break;                                                 // Not part of a transfer we are taking
+               }
+               length = tp_rx_length - tp_rx_received;
+               if (length > TP_CONSECUTIVE_FRAME_DATA)
+               {
+                    length = TP_CONSECUTIVE_FRAME_DATA;
+               }
+               if (((p_frame->data[0] & 0x0F) != (tp_rx_sequence & 0x0F)) || (length >= p_frame->length))
+               {
+                    tp_rx_state = TP_IDLE;                                 // A frame was lost, the sender times out
+                    break;
+               }
+               for (uint8_t i = 0; i < length; i++)
+               {
+                    tp_rx_buffer[tp_rx_received + i] = p_frame->data[i + 1];
+               }
+               tp_rx_received += length;
+               tp_rx_sequence++;
+               tp_rx_last = ES_Timer_GetTime();
+
+               if (tp_rx_received >= tp_rx_length)
+               {
+                    tp_rx_state = TP_UNREAD;
+
+                    ES_Event rx_event;
+                    rx_event.EventType = ES_CAN_TRANSPORT_RX;
+                    rx_event.EventParam = tp_rx_length;
+                    POST_EVENT(rx_event);
+               }
+               else if (0 == --tp_rx_block_left)
+               {
+                    tp_rx_block_left = CAN_TRANSPORT_BLOCK_SIZE;
+                    can_transport_send_flow(peer, TP_FLOW_CONTINUE);
+               }
+               break;
+
+          case TP_FLOW_CONTROL:
+               can_transport_flow(p_frame, peer);
+               break;
+
+          default:
+               break;
+     }
+}
+
+/****************************************************************************
+     Private Function
+          can_transport_flow
+
+     Description
+          Acts on a flow control from the receiver of the transfer we are sending
+     
+     Parameters
+          CAN_Frame_t * p_frame: the flow control
+          uint32_t peer: the node that sent it
+
+     Notes
+          Only called from the owning service. A flow control we are not waiting for is ignored.
+
+****************************************************************************/
+static void can_transport_flow(CAN_Frame_t const * p_frame, uint32_t peer)
+{
+     bool post_done;
+
+     if (p_frame->length < TP_FLOW_CONTROL_LENGTH)
+     {
+          return;
+     }
+
+     EnterCritical();
+     if ((TP_WAIT_FLOW == tp_tx_state) && (peer == tp_tx_peer))
+     {
+          switch (p_frame->data[0] & 0x0F)
+          {
+               case TP_FLOW_CONTINUE:
+                    tp_tx_block_left = p_frame->data[1];                   // 0 for the rest of the transfer
+                    tp_tx_state = TP_SENDING;
+                    START_TIMER(CAN_TRANSPORT_TIMER, CAN_TRANSPORT_TIMEOUT);
+                    can_transport_pump();
+                    can_load_tx_objects();
+                    break;
+
+               case TP_FLOW_WAIT:
+                    START_TIMER(CAN_TRANSPORT_TIMER, CAN_TRANSPORT_TIMEOUT);
+                    break;
+
+               default:
+                    tp_tx_state = TP_IDLE;
+                    tp_tx_result = CAN_TRANSPORT_REFUSED;
+                    tp_tx_done_owed = true;
+                    break;
+          }
+     }
+     post_done = tp_tx_done_owed;                                          // Whether we finished it or the ISR has not managed to
+     tp_tx_done_owed = false;
+     ExitCritical();
+
+     if (true == post_done)
+     {
+          ES_Event done_event;
+          done_event.EventType = ES_CAN_TRANSPORT_DONE;
+          done_event.EventParam = tp_tx_result;
+          POST_EVENT(done_event);
+     }
+}
+
+/****************************************************************************
+     Private Function
+          can_transport_send_flow
+
+     Description
+          Queues a flow control to the sender of a transfer, asking for CAN_TRANSPORT_BLOCK_SIZE frames at a time with
+          no gap between them
+     
+     Parameters
+          uint32_t peer: the sender
+          uint8_t flow_status: TP_FLOW_CONTINUE, TP_FLOW_WAIT or TP_FLOW_OVERFLOW
+
+     Notes
+          If the transmit queue is full the flow control is lost, and the sender times out.
+
+****************************************************************************/
+static void can_transport_send_flow(uint32_t peer, uint8_t flow_status)
+{
+     uint8_t data[TP_FLOW_CONTROL_LENGTH];
+
+     data[0] = TP_FLOW_CONTROL | flow_status;
+     data[1] = CAN_TRANSPORT_BLOCK_SIZE;
+     data[2] = 0;                                                          // Separation time
+     can_queue_frame(can_transport_id(peer), data, TP_FLOW_CONTROL_LENGTH);
+}
+
+/****************************************************************************
+     Private Function
+          tx_entry_before
+
+     Description
+          The bus order of two queued frames: lowest id first, as arbitration would have it, then oldest first
+     
+     Parameters
+          tx_entry_t const * p_a, p_b: the entries to compare
+
+     Returns
+          bool: true if p_a goes before p_b
+
+****************************************************************************/
+static bool tx_entry_before(tx_entry_t const * p_a, tx_entry_t const * p_b)
+{
+     if (p_a->frame.id != p_b->frame.id)
+     {
+          return (p_a->frame.id < p_b->frame.id);
+     }
+     return ((int16_t)(p_a->order - p_b->order) < 0);
+}
+
+/****************************************************************************
+     Private Function
+          tx_queue_push
+
+     Description
+          Adds a frame to the transmit heap, call with interrupts off and only if there is room
+     
+     Parameters
+          CAN_Frame_t const * p_frame: the frame to add
+
+****************************************************************************/
+static void tx_queue_push(CAN_Frame_t const * p_frame)
+{
+     uint8_t child = tx_queue_count++;
+     tx_entry_t entry;
+
+     entry.frame = *p_frame;
+     entry.order = tx_order++;
+
+     //
+     // Sift up: move parents down until the new entry's place is found
+     //
+     while (child > 0)
+     {
+          uint8_t parent = (child - 1) / 2;
+          if (!tx_entry_before(&entry, &tx_queue[parent]))
+          {
+               break;
+          }
+          tx_queue[child] = tx_queue[parent];
+          child = parent;
+     }
+     tx_queue[child] = entry;
+}
+
+/****************************************************************************
+     Private Function
+          tx_queue_pop
+
+     Description
+          Takes the first frame off the transmit heap, call with interrupts off and only if it is not empty
+     
+     Parameters
+          CAN_Frame_t * p_frame: where to put the frame
+
+****************************************************************************/
+static void tx_queue_pop(CAN_Frame_t * p_frame)
+{
+     tx_entry_t * p_last = &tx_queue[--tx_queue_count];
+     uint8_t parent = 0;
+
+     *p_frame = tx_queue[0].frame;
+
+     //
+     // Sift down: move the last entry down from the top until its place is found
+     //
+     while (true)
+     {
+          uint8_t child = 2 * parent + 1;
+          if (child >= tx_queue_count)
+          {
+               break;
+          }
+          if (((child + 1) < tx_queue_count) && tx_entry_before(&tx_queue[child + 1], &tx_queue[child]))
+          {
+               child++;
+          }
+          if (!tx_entry_before(&tx_queue[child], p_last))
+          {
+               break;
+          }
+          tx_queue[parent] = tx_queue[child];
+          parent = child;
+     }
+     tx_queue[parent] = *p_last;
+}
+
+// ######################################################################################################################################################################
+// ---------------------------- Test Harness
+// ######################################################################################################################################################################
+
+/****************************************************************************
+     Test Harness
+
+     Description
+          Host benchmark of the framing and the transport against a simulated 500 kbit/s bus. This module is the master,
+          the harness stands in for its CAN controller, for the owning service, and for slave 1, which runs its own
+          ISO-TP. Frames are timed to the bit: the CRC and the stuff bits are worked out for each one. Un-comment the
+          #define TEST at the top of this file and build with e.g.:
+               gcc -std=gnu99 -O2 -DES_HOST_PORT -DPART_TM4C123GH6PM -IHeaders -I. -I"TIVA Code"
+                   Source/MS_CAN_top_layer.c Source/ES_LookupTables.c
+
+     Notes
+          Reports the bus time to send a lamp scene as 2 byte commands, as packed lamp frames to each slave and as
+          packed frames to ALL_SLAVES_GROUP, and the throughput of 1024 byte transfers each way. Also checks the
+          wait, refusal and timeout paths, the batching and overflow of the receive ring, and a poll of the slaves.
+          Returns non-zero on any error.
+
+****************************************************************************/
+#ifdef SIMULATED_BUS
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_BIT_TIME_NS            2000                  // 500 kbit/s
+#define SIM_FRAME_TAIL_BITS        13                    // CRC delimiter, ACK slot and delimiter, end of frame, intermission
+#define SIM_SCENE_LAMPS            (CAN_LAMP_MAX + 1)
+#define SIM_TRANSFER_LENGTH        CAN_TRANSPORT_RX_SIZE
+#define SIM_PEER_BLOCK_SIZE        8
+#define SIM_PEER_QUEUE_SIZE        64
+#define SIM_EVENT_QUEUE_SIZE       64
+
+typedef enum {PEER_NORMAL, PEER_REFUSE, PEER_SILENT} peer_mode_t;
+
+typedef struct
+{
+     bool loaded;                                  // Has a frame to send
+     bool remote;                                  // The frame is a remote request (MSG_OBJ_TYPE_TX_REMOTE)
+     bool listening;                               // The request went out, it now takes the data frames with its id
+     uint32_t id;
+     uint8_t length;
+     uint8_t data[8];
+     uint32_t flags;
+} sim_object_t;
+
+// The master's controller
+uint32_t _PRIMASK_temp;
+static sim_object_t sim_objects[33];
+static uint32_t sim_pending;                      // Interrupt pending, bit per object
+
+// The bus
+static uint64_t sim_bits;                         // Bit times since the start
+static uint32_t sim_frames;
+static uint32_t sim_last_id;                      // Identifier of the last frame on the bus
+static bool sim_timer_running;
+static uint64_t sim_timer_due;                    // In bit times
+static bool sim_poll_timer_running;
+static uint64_t sim_poll_timer_due;
+
+// The owning service
+static ES_Event sim_events[SIM_EVENT_QUEUE_SIZE];
+static uint8_t sim_event_head;
+static uint8_t sim_event_tail;
+static bool sim_auto_read = true;                 // Take each transfer as soon as it is announced
+static uint8_t sim_master_rx[CAN_TRANSPORT_RX_SIZE];
+static uint16_t sim_master_rx_length;
+static uint32_t sim_master_rx_from;
+static uint32_t sim_master_rx_count;
+static uint64_t sim_master_rx_bits;               // When the last transfer was announced
+static uint32_t sim_done_count;
+static uint16_t sim_done_result;
+static uint64_t sim_done_bits;
+static uint32_t sim_errors;
+static uint32_t sim_rx_events;                    // ES_CAN_RX events taken
+static uint32_t sim_rx_frames;                    // Frames got from CAN_Internal_Bus_Get_Frame
+static CAN_Frame_t sim_rx_last;
+static uint32_t sim_poll_done_count;
+static uint16_t sim_poll_done_param;
+static uint64_t sim_poll_done_bits;
+static bool sim_in_isr;
+static bool sim_frame_at_barrier;                 // Deliver slave 1's next frame in the race window of can_take_frame
+
+// Slave 1
+static peer_mode_t peer_mode;
+static CAN_Frame_t peer_queue[SIM_PEER_QUEUE_SIZE];
+static uint8_t peer_queue_head;
+static uint8_t peer_queue_count;
+static CAN_Lamp_Command_t peer_lamps[SIM_SCENE_LAMPS];
+static uint32_t peer_lamp_commands;
+static uint8_t peer_rx_buffer[CAN_TRANSPORT_MAX_LENGTH];
+static uint16_t peer_rx_length;
+static uint16_t peer_rx_received;
+static uint8_t peer_rx_sequence;
+static uint8_t peer_rx_block_left;
+static uint32_t peer_rx_count;
+static uint64_t peer_rx_bits;                     // When the last transfer was complete
+static uint8_t const * p_peer_tx_data;
+static uint16_t peer_tx_length;
+static uint16_t peer_tx_queued;
+static uint8_t peer_tx_sequence;
+static bool peer_tx_waiting;
+static bool peer_tx_refused;
+
+#define SIM_CHECK(condition) \
+     do { if (!(condition)) { printf("check failed, line %d\n", __LINE__); sim_errors++; } } while (0)
+
+// ---------------------------- Port and TivaWare stand-ins
+
+uint32_t _HW_Host_MaskInts(void) { return 0; }
+void _HW_Host_RestoreInts(uint32_t OldMask) { (void) OldMask; }
+ES_TimerTime_t ES_Timer_GetTime(void) { return (ES_TimerTime_t)((sim_bits * SIM_BIT_TIME_NS) / 1000000); }
+
+void SysCtlPeripheralEnable(uint32_t ui32Peripheral) { (void) ui32Peripheral; }
+bool SysCtlPeripheralReady(uint32_t ui32Peripheral) { (void) ui32Peripheral; return true; }
+void CANInit(uint32_t ui32Base) { memset(sim_objects, 0, sizeof(sim_objects)); sim_pending = 0; }
+void CANBitTimingSet(uint32_t ui32Base, tCANBitClkParms * psClkParms) { (void) psClkParms; }
+void CANEnable(uint32_t ui32Base) { }
+void CANRetrySet(uint32_t ui32Base, bool bAutoRetry) { (void) bAutoRetry; }
+void CANIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags) { (void) ui32IntFlags; }
+void IntEnable(uint32_t ui32Interrupt) { (void) ui32Interrupt; }
+uint32_t CANStatusGet(uint32_t ui32Base, tCANStsReg eStatusReg) { (void) eStatusReg; return 0; }
+void CANIntClear(uint32_t ui32Base, uint32_t ui32IntClr) { sim_pending &= ~OBJECT_BIT(ui32IntClr); }
+
+uint32_t CANIntStatus(uint32_t ui32Base, tCANIntStsReg eIntStsReg)
+{
+     return (CAN_INT_STS_OBJECT == eIntStsReg) ? sim_pending : 0;
+}
+
+void CANMessageSet(uint32_t ui32Base, uint32_t ui32ObjID, tCANMsgObject * psMsgObject, tMsgObjType eMsgType)
+{
+     sim_object_t * p_object = &sim_objects[ui32ObjID];
+
+     if (MSG_OBJ_TYPE_TX_REMOTE == eMsgType)
+     {
+          p_object->loaded = true;
+          p_object->remote = true;
+          p_object->listening = false;
+          p_object->id = psMsgObject->ui32MsgID;
+          p_object->length = (uint8_t) psMsgObject->ui32MsgLen;
+          return;
+     }
+     if (MSG_OBJ_TYPE_TX != eMsgType)
+     {
+          return;                                                          // The receive objects are modelled by bus_step
+     }
+     SIM_CHECK(false == p_object->loaded);
+     p_object->loaded = true;
+     p_object->remote = false;
+     p_object->id = psMsgObject->ui32MsgID;
+     p_object->length = (uint8_t) psMsgObject->ui32MsgLen;
+     memcpy(p_object->data, psMsgObject->pui8MsgData, p_object->length);
+}
+
+// As on the chip, the interrupt pending is left alone
+void CANMessageClear(uint32_t ui32Base, uint32_t ui32ObjID)
+{
+     sim_objects[ui32ObjID].loaded = false;
+     sim_objects[ui32ObjID].remote = false;
+     sim_objects[ui32ObjID].listening = false;
+}
+
+void CANMessageGet(uint32_t ui32Base, uint32_t ui32ObjID, tCANMsgObject * psMsgObject, bool bClrPendingInt)
+{
+     sim_object_t * p_object = &sim_objects[ui32ObjID];
+
+     psMsgObject->ui32MsgID = p_object->id;
+     psMsgObject->ui32MsgLen = p_object->length;
+     psMsgObject->ui32Flags = p_object->flags;
+     memcpy(psMsgObject->pui8MsgData, p_object->data, p_object->length);
+     p_object->flags = 0;
+     if (bClrPendingInt)
+     {
+          sim_pending &= ~OBJECT_BIT(ui32ObjID);
+     }
+}
+
+static bool record_event(ES_Event this_event)
+{
+     if ((uint8_t)(sim_event_tail - sim_event_head) >= SIM_EVENT_QUEUE_SIZE)
+     {
+          return false;
+     }
+     sim_events[sim_event_tail++ % SIM_EVENT_QUEUE_SIZE] = this_event;
+     return true;
+}
+
+static ES_TimerReturn_t record_timer(uint8_t timer, uint16_t time)
+{
+     if (0 == time)
+     {
+          return ES_Timer_ERR;                                             // As ES_Timer_InitTimer
+     }
+     if (CAN_TRANSPORT_TIMER == timer)
+     {
+          sim_timer_running = true;
+          sim_timer_due = sim_bits + ((uint64_t) time * 1000000 / SIM_BIT_TIME_NS);
+     }
+     else if (CAN_POLL_TIMER == timer)
+     {
+          sim_poll_timer_running = true;
+          sim_poll_timer_due = sim_bits + ((uint64_t) time * 1000000 / SIM_BIT_TIME_NS);
+     }
+     return ES_Timer_OK;
+}
+
+// ---------------------------- The bus
+
+// Bits on the wire for an extended data frame: the CRC is worked out so that the stuff bits are exact
+static uint32_t sim_frame_bits(uint32_t id, uint8_t length, uint8_t const * p_data)
+{
+     uint8_t bits[160];
+     uint16_t count = 0;
+     uint16_t crc = 0;
+     uint32_t stuffed = 0;
+     uint8_t run = 0;
+     uint8_t last = 2;
+
+     #define SIM_PUT_BITS(value, width) \
+          for (int8_t b = (width) - 1; b >= 0; b--) { bits[count++] = ((value) >> b) & 1; }
+     SIM_PUT_BITS(0, 1);                                                   // Start of frame
+     SIM_PUT_BITS(id >> 18, 11);
+     SIM_PUT_BITS(3, 2);                                                   // SRR, IDE
+     SIM_PUT_BITS(id & 0x3FFFF, 18);
+     SIM_PUT_BITS(0, 3);                                                   // RTR, r1, r0
+     SIM_PUT_BITS(length, 4);
+     for (uint8_t i = 0; i < length; i++)
+     {
+          SIM_PUT_BITS(p_data[i], 8);
+     }
+     for (uint16_t i = 0; i < count; i++)
+     {
+          bool next = bits[i] ^ ((crc >> 14) & 1);
+          crc = (crc << 1) & 0x7FFF;
+          if (next)
+          {
+               crc ^= 0x4599;
+          }
+     }
+     SIM_PUT_BITS(crc, 15);
+
+     //
+     // A stuff bit follows every 5 equal bits, and starts the next run
+     //
+     for (uint16_t i = 0; i < count; i++)
+     {
+          run = (bits[i] == last) ? run + 1 : 1;
+          last = bits[i];
+          if (5 == run)
+          {
+               stuffed++;
+               last = !last;
+               run = 1;
+          }
+     }
+     return count + stuffed + SIM_FRAME_TAIL_BITS;
+}
+
+static void peer_queue_frame(uint32_t id, uint8_t const * p_data, uint8_t length)
+{
+     CAN_Frame_t * p_frame = &peer_queue[(peer_queue_head + peer_queue_count) % SIM_PEER_QUEUE_SIZE];
+
+     SIM_CHECK(peer_queue_count < SIM_PEER_QUEUE_SIZE);
+     p_frame->id = id;
+     p_frame->length = length;
+     memcpy(p_frame->data, p_data, length);
+     peer_queue_count++;
+}
+
+// ---------------------------- Slave 1, with its own ISO-TP
+
+static void peer_send_flow(uint8_t flow_status)
+{
+     uint8_t data[3] = {0x30 | flow_status, SIM_PEER_BLOCK_SIZE, 0};
+     peer_queue_frame(CAN_KIND_TRANSPORT | SLAVE_NODE_01_ID, data, sizeof(data));
+}
+
+static void peer_send_block(uint8_t block_size)
+{
+     uint8_t data[8];
+
+     for (uint8_t sent = 0; (peer_tx_queued < peer_tx_length) && ((0 == block_size) || (sent < block_size)); sent++)
+     {
+          uint8_t in_frame = ((peer_tx_length - peer_tx_queued) > 7) ? 7 : (uint8_t)(peer_tx_length - peer_tx_queued);
+          data[0] = 0x20 | (peer_tx_sequence++ & 0x0F);
+          memcpy(&data[1], &p_peer_tx_data[peer_tx_queued], in_frame);
+          peer_tx_queued += in_frame;
+          peer_queue_frame(CAN_KIND_TRANSPORT | SLAVE_NODE_01_ID, data, in_frame + 1);
+     }
+     peer_tx_waiting = (peer_tx_queued < peer_tx_length);
+}
+
+static void peer_start_send(uint8_t const * p_data, uint16_t length)
+{
+     uint8_t data[8] = {0x10 | (length >> 8), length & 0xFF};
+
+     memcpy(&data[2], p_data, 6);
+     p_peer_tx_data = p_data;
+     peer_tx_length = length;
+     peer_tx_queued = 6;
+     peer_tx_sequence = 1;
+     peer_tx_waiting = true;
+     peer_tx_refused = false;
+     peer_queue_frame(CAN_KIND_TRANSPORT | SLAVE_NODE_01_ID, data, 8);
+}
+
+static void peer_receive_transport(CAN_Frame_t const * p_frame)
+{
+     uint8_t pci = p_frame->data[0];
+     uint8_t in_frame;
+
+     switch (pci & 0xF0)
+     {
+          case 0x00:
+               peer_rx_length = pci & 0x0F;
+               memcpy(peer_rx_buffer, &p_frame->data[1], peer_rx_length);
+               peer_rx_received = peer_rx_length;
+               peer_rx_count++;
+               peer_rx_bits = sim_bits;
+               break;
+
+          case 0x10:
+               if (PEER_REFUSE == peer_mode)
+               {
+                    peer_send_flow(2);
+               }
+               else if (PEER_NORMAL == peer_mode)
+               {
+                    peer_rx_length = ((uint16_t)(pci & 0x0F) << 8) | p_frame->data[1];
+                    memcpy(peer_rx_buffer, &p_frame->data[2], 6);
+                    peer_rx_received = 6;
+                    peer_rx_sequence = 1;
+                    peer_rx_block_left = SIM_PEER_BLOCK_SIZE;
+                    peer_send_flow(0);
+               }
+               break;
+
+          case 0x20:
+               SIM_CHECK((pci & 0x0F) == (peer_rx_sequence & 0x0F));
+               in_frame = ((peer_rx_length - peer_rx_received) > 7) ? 7 : (uint8_t)(peer_rx_length - peer_rx_received);
+               SIM_CHECK(p_frame->length == in_frame + 1);
+               memcpy(&peer_rx_buffer[peer_rx_received], &p_frame->data[1], in_frame);
+               peer_rx_received += in_frame;
+               peer_rx_sequence++;
+               if (peer_rx_received >= peer_rx_length)
+               {
+                    peer_rx_count++;
+                    peer_rx_bits = sim_bits;
+               }
+               else if (0 == --peer_rx_block_left)
+               {
+                    peer_rx_block_left = SIM_PEER_BLOCK_SIZE;
+                    peer_send_flow(0);
+               }
+               break;
+
+          case 0x30:
+               if (false == peer_tx_waiting)
+               {
+                    break;
+               }
+               if (0 == (pci & 0x0F))
+               {
+                    peer_send_block(p_frame->data[1]);
+               }
+               else if (2 == (pci & 0x0F))
+               {
+                    peer_tx_waiting = false;
+                    peer_tx_refused = true;
+               }
+               break;
+
+          default:
+               break;
+     }
+}
+
+// Slave 1's response object answers a remote request for its id by itself, slave 2 is not on the bus
+static void peer_answer_remote(uint32_t id)
+{
+     uint8_t status[2] = {0x5A, (uint8_t) sim_frames};
+
+     if (SLAVE_NODE_01_ID == id)
+     {
+          peer_queue_frame(SLAVE_NODE_01_ID, status, sizeof(status));
+     }
+}
+
+static void peer_receive(CAN_Frame_t const * p_frame)
+{
+     CAN_Lamp_Command_t commands[CAN_LAMP_COMMANDS_PER_FRAME];
+     uint8_t count;
+
+     if ((MASTER_NODE_ID | SLAVE_NODE_01_ID) != (p_frame->id & (MASTER_NODE_ID | SLAVE_NODE_01_ID)))
+     {
+          return;                                                          // Not for us
+     }
+     switch (CAN_FRAME_KIND(p_frame->id))
+     {
+          case CAN_KIND_COMMAND:
+               // The 2 byte form carries a lamp and its intensity
+               peer_lamps[p_frame->data[0] % SIM_SCENE_LAMPS].intensity = p_frame->data[1];
+               peer_lamp_commands++;
+               break;
+
+          case CAN_KIND_LAMPS:
+               count = CAN_Unpack_Lamp_Commands(p_frame, commands);
+               for (uint8_t i = 0; i < count; i++)
+               {
+                    peer_lamps[commands[i].lamp] = commands[i];
+               }
+               peer_lamp_commands += count;
+               break;
+
+          case CAN_KIND_TRANSPORT:
+               peer_receive_transport(p_frame);
+               break;
+
+          default:
+               break;
+     }
+}
+
+// ---------------------------- The owning service
+
+static void run_service(void)
+{
+     CAN_Frame_t frame;
+
+     while (sim_event_head != sim_event_tail)
+     {
+          ES_Event this_event = sim_events[sim_event_head++ % SIM_EVENT_QUEUE_SIZE];
+          switch (this_event.EventType)
+          {
+               case ES_CAN_RX:
+                    sim_rx_events++;
+                    while (CAN_Internal_Bus_Get_Frame(&frame))
+                    {
+                         sim_rx_frames++;
+                         sim_rx_last = frame;
+                    }
+                    break;
+
+               case ES_CAN_TRANSPORT_RX:
+                    sim_master_rx_count++;
+                    sim_master_rx_bits = sim_bits;
+                    if (sim_auto_read)
+                    {
+                         sim_master_rx_length = CAN_Transport_Get_Rx(sim_master_rx, sizeof(sim_master_rx), &sim_master_rx_from);
+                         SIM_CHECK(sim_master_rx_length == this_event.EventParam);
+                    }
+                    break;
+
+               case ES_CAN_POLL_DONE:
+                    sim_poll_done_count++;
+                    sim_poll_done_param = this_event.EventParam;
+                    sim_poll_done_bits = sim_bits;
+                    break;
+
+               case ES_CAN_TRANSPORT_DONE:
+                    sim_done_count++;
+                    sim_done_result = this_event.EventParam;
+                    sim_done_bits = sim_bits;
+                    break;
+
+               default:
+                    break;
+          }
+     }
+}
+
+// One frame on the bus, the lowest identifier of the master's next object and slave 1's next frame wins. A frame
+// for the master goes to the lowest numbered object listening for its id, or else to MASTER_RX_OBJ_ID, which takes
+// anything not from the master
+static bool bus_step(void)
+{
+     uint8_t object_id = 0;
+     uint8_t rx_object_id = MASTER_RX_OBJ_ID;
+     CAN_Frame_t frame;
+
+     for (uint8_t i = 1; i <= 32; i++)
+     {
+          if (sim_objects[i].loaded)
+          {
+               object_id = i;                                              // The controller sends the lowest numbered first
+               break;
+          }
+     }
+     if ((0 != object_id) && ((0 == peer_queue_count) || (sim_objects[object_id].id < peer_queue[peer_queue_head].id)))
+     {
+          sim_object_t * p_object = &sim_objects[object_id];
+          frame.id = p_object->id;
+          p_object->loaded = false;
+          if (p_object->remote)
+          {
+               // A remote request, timed as a frame with no data. It raises no interrupt, the reply does
+               frame.length = 0;
+               sim_bits += sim_frame_bits(frame.id, 0, frame.data);
+               p_object->listening = true;
+               peer_answer_remote(frame.id);
+          }
+          else
+          {
+               frame.length = p_object->length;
+               memcpy(frame.data, p_object->data, frame.length);
+               sim_bits += sim_frame_bits(frame.id, frame.length, frame.data);
+               sim_pending |= OBJECT_BIT(object_id);
+               sim_in_isr = true;
+               CAN_Internal_Bus_ISR();
+               sim_in_isr = false;
+               peer_receive(&frame);
+          }
+     }
+     else if (0 != peer_queue_count)
+     {
+          frame = peer_queue[peer_queue_head];
+          peer_queue_head = (peer_queue_head + 1) % SIM_PEER_QUEUE_SIZE;
+          peer_queue_count--;
+          sim_bits += sim_frame_bits(frame.id, frame.length, frame.data);
+          for (uint8_t i = MASTER_RX_OBJ_ID - 1; i >= 1; i--)
+          {
+               if (sim_objects[i].listening && (sim_objects[i].id == frame.id))
+               {
+                    rx_object_id = i;
+               }
+          }
+          sim_object_t * p_object = &sim_objects[rx_object_id];
+          if (0 != (sim_pending & OBJECT_BIT(rx_object_id)))
+          {
+               p_object->flags |= MSG_OBJ_DATA_LOST;
+          }
+          p_object->length = frame.length;
+          memcpy(p_object->data, frame.data, frame.length);
+          if (MASTER_RX_OBJ_ID == rx_object_id)
+          {
+               p_object->id = frame.id;                                    // A listening object's id is fixed
+          }
+          sim_pending |= OBJECT_BIT(rx_object_id);
+          sim_in_isr = true;
+          CAN_Internal_Bus_ISR();
+          sim_in_isr = false;
+     }
+     else
+     {
+          return false;
+     }
+     sim_frames++;
+     sim_last_id = frame.id;
+     return true;
+}
+
+// ES_MemoryBarrier. The one that can_take_frame passes with no event outstanding comes after it found the ring empty,
+// so a frame delivered there, with the flag as it was, models one that came in between that look and the service
+// letting go of the event: the ISR saw the event still outstanding, so it did not post
+static void sim_barrier(void)
+{
+     __atomic_thread_fence(__ATOMIC_SEQ_CST);
+     if ((true == sim_frame_at_barrier) && (false == sim_in_isr) && (false == rx_event_posted))
+     {
+          sim_frame_at_barrier = false;
+          rx_event_posted = true;
+          SIM_CHECK(bus_step());
+          rx_event_posted = false;
+     }
+}
+
+// Runs the bus and the service until there is nothing left to send, and on to the timeouts if asked
+static void run_until_quiet(bool wait_for_timer)
+{
+     while (true)
+     {
+          run_service();
+          if (sim_timer_running && (sim_bits >= sim_timer_due))
+          {
+               ES_Event timeout_event;
+               timeout_event.EventType = ES_TIMEOUT;
+               timeout_event.EventParam = CAN_TRANSPORT_TIMER;
+               sim_timer_running = false;
+               CAN_Internal_Bus_Post_Transport_Timeout(timeout_event);
+               continue;
+          }
+          if (sim_poll_timer_running && (sim_bits >= sim_poll_timer_due))
+          {
+               ES_Event timeout_event;
+               timeout_event.EventType = ES_TIMEOUT;
+               timeout_event.EventParam = CAN_POLL_TIMER;
+               sim_poll_timer_running = false;
+               CAN_Internal_Bus_Post_Poll_Timeout(timeout_event);
+               continue;
+          }
+          if (false == bus_step())
+          {
+               if (!(wait_for_timer && (sim_timer_running || sim_poll_timer_running)))
+               {
+                    break;
+               }
+
+               //
+               // Nothing happens until the next timer runs out
+               //
+               if (sim_timer_running && (!sim_poll_timer_running || (sim_timer_due < sim_poll_timer_due)))
+               {
+                    sim_bits = sim_timer_due;
+               }
+               else
+               {
+                    sim_bits = sim_poll_timer_due;
+               }
+          }
+     }
+}
+
+// ---------------------------- The benchmark
+
+// Lamp commands are compared a field at a time, the padding of a copy need not match
+static bool same_lamps(CAN_Lamp_Command_t const * p_a, CAN_Lamp_Command_t const * p_b, uint8_t count)
+{
+     for (uint8_t i = 0; i < count; i++)
+     {
+          if ((p_a[i].lamp != p_b[i].lamp) || (p_a[i].intensity != p_b[i].intensity) || (p_a[i].color != p_b[i].color) ||
+              (p_a[i].fade_time != p_b[i].fade_time))
+          {
+               return false;
+          }
+     }
+     return true;
+}
+
+static void print_rate(char const * p_name, uint32_t frames, uint64_t bits, uint32_t units, char const * p_units)
+{
+     double us = (double) bits * SIM_BIT_TIME_NS / 1000.0;
+     printf("  %-34s %4lu frames %8.0f us  %8.1f %s/ms\n", p_name, (unsigned long) frames, us, units * 1000.0 / us, p_units);
+}
+
+int main(void)
+{
+     static uint8_t tx_data[CAN_TRANSPORT_MAX_LENGTH];
+     static uint8_t peer_data[CAN_TRANSPORT_MAX_LENGTH];
+     CAN_Lamp_Command_t scene[SIM_SCENE_LAMPS];
+     uint32_t node_id = MASTER_NODE_ID;
+     uint8_t rx_store[NUM_DATA_BYTES_DATA_STORE];
+     uint8_t remote_store[NUM_DATA_BYTES_DATA_STORE];
+     uint32_t slaves[2] = {SLAVE_NODE_01_ID, SLAVE_NODE_02_ID};
+     uint64_t start_bits;
+     uint32_t start_frames;
+     uint8_t cmd[2];
+
+     Initialize_CAN_Internal_Bus(&node_id, rx_store, remote_store, 0);
+     for (uint16_t i = 0; i < sizeof(tx_data); i++)
+     {
+          tx_data[i] = (uint8_t)(i * 7 + 3);
+          peer_data[i] = (uint8_t)(i * 13 + 1);
+     }
+     for (uint8_t i = 0; i < SIM_SCENE_LAMPS; i++)
+     {
+          scene[i].lamp = i;
+          scene[i].intensity = 16 * i + 5;
+          scene[i].color = 3 * i;
+          scene[i].fade_time = 100 + 250 * i;
+     }
+
+     //
+     // A lamp scene, the same on both slaves
+     //
+     printf("Lamp scene, %u lamps on each of 2 slaves:\n", SIM_SCENE_LAMPS);
+     start_bits = sim_bits;
+     start_frames = sim_frames;
+     for (uint8_t s = 0; s < 2; s++)
+     {
+          for (uint8_t i = 0; i < SIM_SCENE_LAMPS; i++)
+          {
+               cmd[0] = i;
+               cmd[1] = scene[i].intensity;
+               while (false == CAN_Master_Command_Slave(slaves[s], cmd))
+               {
+                    bus_step();
+               }
+          }
+     }
+     run_until_quiet(false);
+     print_rate("2 byte commands (intensity only)", sim_frames - start_frames, sim_bits - start_bits, 2 * SIM_SCENE_LAMPS, "lamps");
+     SIM_CHECK(peer_lamp_commands == SIM_SCENE_LAMPS);
+
+     memset(peer_lamps, 0, sizeof(peer_lamps));
+     peer_lamp_commands = 0;
+     start_bits = sim_bits;
+     start_frames = sim_frames;
+     for (uint8_t s = 0; s < 2; s++)
+     {
+          SIM_CHECK(CAN_Master_Command_Lamps(slaves[s], scene, SIM_SCENE_LAMPS));
+     }
+     run_until_quiet(false);
+     print_rate("packed, to each slave", sim_frames - start_frames, sim_bits - start_bits, 2 * SIM_SCENE_LAMPS, "lamps");
+     SIM_CHECK((peer_lamp_commands == SIM_SCENE_LAMPS) && same_lamps(peer_lamps, scene, SIM_SCENE_LAMPS));
+
+     memset(peer_lamps, 0, sizeof(peer_lamps));
+     peer_lamp_commands = 0;
+     start_bits = sim_bits;
+     start_frames = sim_frames;
+     SIM_CHECK(CAN_Master_Command_Lamps(ALL_SLAVES_GROUP, scene, SIM_SCENE_LAMPS));
+     run_until_quiet(false);
+     print_rate("packed, to ALL_SLAVES_GROUP", sim_frames - start_frames, sim_bits - start_bits, 2 * SIM_SCENE_LAMPS, "lamps");
+     SIM_CHECK((peer_lamp_commands == SIM_SCENE_LAMPS) && same_lamps(peer_lamps, scene, SIM_SCENE_LAMPS));
+
+     scene[0].lamp = CAN_LAMP_MAX + 1;
+     SIM_CHECK(false == CAN_Master_Command_Lamps(ALL_SLAVES_GROUP, scene, 1));
+     scene[0].lamp = 0;
+     scene[0].fade_time = CAN_LAMP_FADE_MAX + 1;
+     SIM_CHECK(false == CAN_Master_Command_Lamps(ALL_SLAVES_GROUP, scene, 1));
+     scene[0].fade_time = 100;
+
+     //
+     // Transfers each way, with a lamp frame queued part way through the first
+     //
+     printf("Transfers of %u bytes:\n", SIM_TRANSFER_LENGTH);
+     start_bits = sim_bits;
+     start_frames = sim_frames;
+     SIM_CHECK(CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, SIM_TRANSFER_LENGTH));
+     SIM_CHECK(false == CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, SIM_TRANSFER_LENGTH));      // One at a time
+     for (uint8_t i = 0; i < 60; i++)
+     {
+          run_service();
+          bus_step();
+     }
+     uint32_t lamp_queued_frame = sim_frames;
+     SIM_CHECK(CAN_Master_Command_Lamps(SLAVE_NODE_01_ID, scene, 1));
+     while (CAN_KIND_LAMPS != CAN_FRAME_KIND(sim_last_id))
+     {
+          run_service();
+          SIM_CHECK(bus_step());
+     }
+     uint32_t lamp_latency = sim_frames - lamp_queued_frame;
+     run_until_quiet(false);
+     start_frames++;                                                       // Not counting the lamp frame
+     print_rate("master to slave", sim_frames - start_frames, peer_rx_bits - start_bits, SIM_TRANSFER_LENGTH, "bytes");
+     SIM_CHECK((1 == peer_rx_count) && (SIM_TRANSFER_LENGTH == peer_rx_received) && (0 == memcmp(peer_rx_buffer, tx_data, SIM_TRANSFER_LENGTH)));
+     SIM_CHECK((1 == sim_done_count) && (CAN_TRANSPORT_SENT == sim_done_result));
+     printf("  a lamp frame queued mid transfer went out %lu frames later\n", (unsigned long) lamp_latency);
+     SIM_CHECK(lamp_latency <= CAN_TX_OBJECT_COUNT + 1);
+
+     start_bits = sim_bits;
+     start_frames = sim_frames;
+     peer_start_send(peer_data, SIM_TRANSFER_LENGTH);
+     run_until_quiet(false);
+     print_rate("slave to master", sim_frames - start_frames, sim_master_rx_bits - start_bits, SIM_TRANSFER_LENGTH, "bytes");
+     SIM_CHECK((1 == sim_master_rx_count) && (SIM_TRANSFER_LENGTH == sim_master_rx_length) && (SLAVE_NODE_01_ID == sim_master_rx_from));
+     SIM_CHECK(0 == memcmp(sim_master_rx, peer_data, SIM_TRANSFER_LENGTH));
+     SIM_CHECK(0 == CAN_Internal_Bus_Get_Rx_Dropped());
+
+     //
+     // Short transfers go as one frame, and bad ones are refused up front
+     //
+     SIM_CHECK(CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, TP_SINGLE_FRAME_DATA));
+     run_until_quiet(false);
+     SIM_CHECK((2 == peer_rx_count) && (TP_SINGLE_FRAME_DATA == peer_rx_received) && (2 == sim_done_count));
+     SIM_CHECK(false == CAN_Transport_Send(ALL_SLAVES_GROUP, tx_data, 10));
+     SIM_CHECK(false == CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, 0));
+     SIM_CHECK(false == CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, CAN_TRANSPORT_MAX_LENGTH + 1));
+
+     //
+     // A second transfer waits until the first is read
+     //
+     sim_auto_read = false;
+     peer_start_send(peer_data, 100);
+     run_until_quiet(false);
+     peer_start_send(&peer_data[100], 200);
+     run_until_quiet(false);
+     SIM_CHECK((2 == sim_master_rx_count) && peer_tx_waiting);
+     sim_auto_read = true;
+     sim_master_rx_length = CAN_Transport_Get_Rx(sim_master_rx, sizeof(sim_master_rx), &sim_master_rx_from);
+     SIM_CHECK((100 == sim_master_rx_length) && (0 == memcmp(sim_master_rx, peer_data, 100)));
+     run_until_quiet(false);
+     SIM_CHECK((3 == sim_master_rx_count) && (200 == sim_master_rx_length) && (0 == memcmp(sim_master_rx, &peer_data[100], 200)));
+
+     //
+     // Refusals both ways, and a receiver that never answers
+     //
+     peer_start_send(peer_data, CAN_TRANSPORT_RX_SIZE + 1);
+     run_until_quiet(false);
+     SIM_CHECK(peer_tx_refused && (3 == sim_master_rx_count));
+
+     peer_mode = PEER_REFUSE;
+     SIM_CHECK(CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, 100));
+     run_until_quiet(false);
+     SIM_CHECK((3 == sim_done_count) && (CAN_TRANSPORT_REFUSED == sim_done_result));
+
+     peer_mode = PEER_SILENT;
+     start_bits = sim_bits;
+     SIM_CHECK(CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, 100));
+     run_until_quiet(true);
+     SIM_CHECK((4 == sim_done_count) && (CAN_TRANSPORT_TIMED_OUT == sim_done_result));
+     SIM_CHECK((sim_done_bits - start_bits) * SIM_BIT_TIME_NS >= (uint64_t) CAN_TRANSPORT_TIMEOUT * 1000000);
+     SIM_CHECK(CAN_Transport_Send(SLAVE_NODE_01_ID, tx_data, 100));                            // Free again
+     peer_mode = PEER_NORMAL;
+     run_until_quiet(false);
+
+     //
+     // Frames that come in before the service runs make one batch, one ES_CAN_RX
+     //
+     printf("Receive ring of %u frames:\n", CAN_RX_RING_SIZE);
+     sim_rx_events = 0;
+     sim_rx_frames = 0;
+     for (uint8_t i = 0; i < 5; i++)
+     {
+          cmd[0] = i;
+          cmd[1] = 0;
+          peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     }
+     while (bus_step())
+     {
+     }
+     SIM_CHECK((1 == (uint8_t)(sim_event_tail - sim_event_head)) && (ES_CAN_RX == sim_events[sim_event_head % SIM_EVENT_QUEUE_SIZE].EventType));
+     run_service();
+     SIM_CHECK((1 == sim_rx_events) && (5 == sim_rx_frames) && (4 == sim_rx_last.data[0]) && (MASTER_RX_OBJ_ID == sim_rx_last.object));
+     printf("  5 frames in one batch, %lu ES_CAN_RX\n", (unsigned long) sim_rx_events);
+
+     //
+     // A full ring drops the newest frames and counts them, the oldest are kept in order
+     //
+     uint32_t start_dropped = CAN_Internal_Bus_Get_Rx_Dropped();
+     sim_rx_events = 0;
+     sim_rx_frames = 0;
+     for (uint8_t i = 0; i < CAN_RX_RING_SIZE + 4; i++)
+     {
+          cmd[0] = i;
+          peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     }
+     while (bus_step())
+     {
+     }
+     run_service();
+     SIM_CHECK((1 == sim_rx_events) && (CAN_RX_RING_SIZE == sim_rx_frames) && ((CAN_RX_RING_SIZE - 1) == sim_rx_last.data[0]));
+     SIM_CHECK(4 == CAN_Internal_Bus_Get_Rx_Dropped() - start_dropped);
+     printf("  %u frames into a full ring, %lu dropped\n", CAN_RX_RING_SIZE + 4, (unsigned long)(CAN_Internal_Bus_Get_Rx_Dropped() - start_dropped));
+
+     //
+     // A frame that comes in as the service finds the ring empty is taken in the same drain, not left for the next one
+     //
+     sim_rx_events = 0;
+     sim_rx_frames = 0;
+     cmd[0] = 0x55;
+     peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     cmd[0] = 0x56;
+     peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     SIM_CHECK(bus_step());
+     sim_frame_at_barrier = true;
+     run_service();
+     SIM_CHECK((false == sim_frame_at_barrier) && (0 == peer_queue_count));
+     SIM_CHECK((1 == sim_rx_events) && (2 == sim_rx_frames) && (0x56 == sim_rx_last.data[0]));
+     SIM_CHECK((sim_event_head == sim_event_tail) && (false == rx_event_posted));
+
+     //
+     // A poll of slave 1, which answers, and slave 2, which is not on the bus
+     //
+     printf("Poll of 2 slaves, one missing:\n");
+     sim_rx_frames = 0;
+     SIM_CHECK(false == CAN_Master_Poll_Slaves(SLAVE_NODE_01_ID, 0));
+     SIM_CHECK(CAN_Master_Poll_Slaves(ALL_SLAVES_GROUP, 50));
+     SIM_CHECK(false == CAN_Master_Poll_Slaves(SLAVE_NODE_01_ID, 50));                          // One at a time
+     start_bits = sim_bits;
+     run_until_quiet(true);
+     SIM_CHECK((1 == sim_poll_done_count) && (1 == sim_poll_done_param) && (SLAVE_NODE_01_ID == CAN_Master_Get_Poll_Replied()));
+     SIM_CHECK(CAN_Master_Get_Poll_Reply(SLAVE_NODE_01_ID, &sim_rx_last) && (0x5A == sim_rx_last.data[0]));
+     SIM_CHECK(false == CAN_Master_Get_Poll_Reply(SLAVE_NODE_02_ID, &sim_rx_last));
+     SIM_CHECK(0 == sim_rx_frames);                                                             // The reply is not in the ring
+     SIM_CHECK((sim_poll_done_bits - start_bits) * SIM_BIT_TIME_NS == (uint64_t) 50 * 1000000);
+     printf("  ES_CAN_POLL_DONE after %.1f ms, %u missing\n", (double)(sim_poll_done_bits - start_bits) * SIM_BIT_TIME_NS / 1000000.0, sim_poll_done_param);
+
+     //
+     // The poll objects are cleared, so what either slave sends afterwards comes in through the ring again
+     //
+     for (uint8_t i = CAN_POLL_OBJECT_FIRST; i < CAN_POLL_OBJECT_FIRST + CAN_POLL_OBJECT_COUNT; i++)
+     {
+          SIM_CHECK(!sim_objects[i].loaded && !sim_objects[i].listening);
+     }
+     cmd[0] = 0x61;
+     peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     cmd[0] = 0x62;
+     peer_queue_frame(SLAVE_NODE_02_ID, cmd, 2);                                                 // As sent by slave 2
+     run_until_quiet(false);
+     SIM_CHECK((2 == sim_rx_frames) && (0x62 == sim_rx_last.data[0]) && (MASTER_RX_OBJ_ID == sim_rx_last.object));
+
+     //
+     // When every slave answers the poll ends on the last reply, and a smaller poll leaves no stale slave behind
+     //
+     SIM_CHECK(CAN_Master_Poll_Slaves(SLAVE_NODE_01_ID, 50));
+     SIM_CHECK(0 == poll_ids[1]);
+     run_until_quiet(false);
+     SIM_CHECK((2 == sim_poll_done_count) && (0 == sim_poll_done_param) && (SLAVE_NODE_01_ID == CAN_Master_Get_Poll_Replied()));
+     SIM_CHECK(false == CAN_Master_Get_Poll_Reply(SLAVE_NODE_02_ID, &sim_rx_last));
+     SIM_CHECK(!sim_objects[CAN_POLL_OBJECT_FIRST].loaded && !sim_objects[CAN_POLL_OBJECT_FIRST].listening);
+     cmd[0] = 0x63;
+     peer_queue_frame(SLAVE_NODE_01_ID, cmd, 2);
+     run_until_quiet(false);
+     SIM_CHECK((3 == sim_rx_frames) && (0x63 == sim_rx_last.data[0]));
+     SIM_CHECK(0 == CAN_Internal_Bus_Get_Rx_Dropped() - start_dropped - 4);
+
+     //
+     // Single frames while one is unread: the next is held, any more are dropped and counted with the rest
+     //
+     start_dropped = CAN_Internal_Bus_Get_Rx_Dropped();
+     sim_auto_read = false;
+     for (uint8_t i = 0; i < 3; i++)
+     {
+          uint8_t single[3] = {TP_SINGLE_FRAME | 2, i, 0};
+          peer_queue_frame(CAN_KIND_TRANSPORT | SLAVE_NODE_01_ID, single, sizeof(single));
+     }
+     run_until_quiet(false);
+     SIM_CHECK((4 == sim_master_rx_count) && (1 == CAN_Internal_Bus_Get_Rx_Dropped() - start_dropped));
+     sim_auto_read = true;
+     sim_master_rx_length = CAN_Transport_Get_Rx(sim_master_rx, sizeof(sim_master_rx), &sim_master_rx_from);
+     SIM_CHECK((2 == sim_master_rx_length) && (0 == sim_master_rx[0]));
+     run_service();
+     SIM_CHECK((5 == sim_master_rx_count) && (2 == sim_master_rx_length) && (1 == sim_master_rx[0]));
+
+     printf("%lu errors\n", (unsigned long) sim_errors);
+     return (0 == sim_errors) ? 0 : 1;
 }
+#endif /* SIMULATED_BUS */
@@ -102,15 +102,15 @@ bool Init_Master_Main_Service ( uint8_t Priority ) {
 //    LastButtonState = HWREG(GPIO_PORTA_BASE + (GPIO_O_DATA + ALL_BITS)) & BIT7HI;
 	
 		// Set up our ID and stuff
-		My_Node_ID = 0x01;
+		My_Node_ID = MASTER_NODE_ID;
 		My_Current_Command[0] = 0xf2;
 		My_Current_Command[1] = 0x31;
 	
 		// Initialize CAN bus
-		Initialize_CAN_Internal_Bus(&My_Node_ID, p_My_RX_Data, p_My_Remote_Data);
+		Initialize_CAN_Internal_Bus(&My_Node_ID, p_My_RX_Data, p_My_Remote_Data, MyPriority);
 
-    // Start debounce timer (timer posts to ButtonDebounceSM)
-    ES_Timer_InitTimer(MASTER_NODE_TIMER, 1000);
+    // Start the command timer, it times out every second until stopped
+    ES_Timer_InitPeriodicTimer(MASTER_NODE_TIMER, 1000);
 
     // post the initial transition event
     ThisEvent.EventType = ES_INIT;
@@ -149,8 +149,34 @@ ES_Event Run_Master_Main_Service( ES_Event ThisEvent ) {
 		if (ThisEvent.EventType == ES_TIMEOUT)
 		{
 			printf("\r\nMaster Sending Data: %d", My_Remote_Data[0]);
-			CAN_Master_Command_Slave(0x02, p_My_Current_Command);
-			ES_Timer_InitTimer(MASTER_NODE_TIMER, 1000);
+			CAN_Master_Command_Slave(ALL_SLAVES_GROUP, p_My_Current_Command);
+			// Ask every slave for its status at once, the replies come back in ES_CAN_POLL_DONE
+			CAN_Master_Poll_Slaves(ALL_SLAVES_GROUP, 50);
+		}
+		else if (ThisEvent.EventType == ES_CAN_POLL_DONE)
+		{
+			CAN_Frame_t Frame;
+			if (CAN_Master_Get_Poll_Reply(SLAVE_NODE_01_ID, &Frame) == true)
+			{
+				printf("\r\nSlave 1 Status: %d", Frame.data[0]);
+			}
+			if (CAN_Master_Get_Poll_Reply(SLAVE_NODE_02_ID, &Frame) == true)
+			{
+				printf("\r\nSlave 2 Status: %d", Frame.data[0]);
+			}
+			if (ThisEvent.EventParam != 0)
+			{
+				printf("\r\n%d Slaves Did Not Reply", ThisEvent.EventParam);
+			}
+		}
+		else if (ThisEvent.EventType == ES_CAN_RX)
+		{
+			// Take every frame of the batch, the module copies the data into our data stores as it goes
+			CAN_Frame_t Frame;
+			while (CAN_Internal_Bus_Get_Frame(&Frame) == true)
+			{
+				printf("\r\nMaster Received From %x: %d", (unsigned int)Frame.id, Frame.data[0]);
+			}
 		}
 
     return ReturnEvent;
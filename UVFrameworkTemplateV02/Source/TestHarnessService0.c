@@ -14,6 +14,10 @@
  History
  When           Who     What/Why
  -------------- ---     --------
+ 10/18/26 12:00 as       size the deferral queue with ES_DEFERRAL_BLOCK_SIZE
+ 10/17/26 22:00 as       SERVICE0_TIMER is periodic rather than restarted on
+                         every timeout
+ 10/17/26 16:00 as       size the deferral queue with ES_QUEUE_BLOCK_SIZE
  11/02/13 17:21 jec      added exercise of the event deferral/recall module
  08/05/13 20:33 jec      converted to test harness service
  01/16/12 09:58 jec      began conversion from TemplateFSM.c
@@ -53,8 +57,8 @@ static void BlinkLED(void);
 /*---------------------------- Module Variables ---------------------------*/
 // with the introduction of Gen2, we need a module level Priority variable
 static uint8_t MyPriority;
-// add a deferral queue for up to 3 pending deferrals +1 to allow for ovehead
-static ES_Event DeferralQueue[3+1];
+// add a deferral queue for up to 3 pending deferrals plus the queue overhead
+static ES_Event DeferralQueue[ES_DEFERRAL_BLOCK_SIZE(3)];
 
 /*------------------------------ Module Code ------------------------------*/
 /****************************************************************************
@@ -156,11 +160,11 @@ ES_Event RunTestHarnessService0( ES_Event ThisEvent )
   switch (ThisEvent.EventType){
     case ES_INIT :
       ES_Timer_InitTimer(SERVICE0_TIMER, HALF_SEC);
+      ES_Timer_SetPeriod(SERVICE0_TIMER, FIVE_SEC);
       puts("Service 00:");
       printf("\rES_INIT received in Service %d\r\n", MyPriority);
       break;
-    case ES_TIMEOUT :  // re-start timer & announce
-      ES_Timer_InitTimer(SERVICE0_TIMER, FIVE_SEC);
+    case ES_TIMEOUT :  // announce, the timer reloads itself
       printf("ES_TIMEOUT received from Timer %d in Service %d\r\n", 
               ThisEvent.EventParam, MyPriority);
 			BlinkLED();